@@ -28,7 +28,12 @@ def main():
     
     # 0. Prepare running
     # Get the arguments
-    size, params, seed, num_runs, clrtxt, remote_be = utils.parse_submission_arguments('Run ML Inference FHE benchmark.')
+    size, params, seed, num_runs, clrtxt, remote_be, cascade = utils.parse_submission_arguments('Run ML Inference FHE benchmark.')
+    # Cascade: the first pass runs the MLP, and the re-run step sends its
+    # low-margin samples through LeNet-5.
+    first_pass = ["--cascade"] if cascade else []
+    if cascade and remote_be:
+        sys.exit("Error: --cascade is not supported by the remote backend")
     test = instance_name(size)
     print(f"\n[harness] Running submission for {test} inference")
 
@@ -58,7 +63,7 @@ def main():
     # 2.1 Communication: Get cryptographic context
     if remote_be:
         utils.run_exe_or_python(exec_dir, "server_get_params", str(size))
-        utils.log_step(2.1 , "Communication: Get cryptographic context")
+        utils.log_step(2.1 , "Communication: Get cryptographic context", cpu=False)
         # Report size of context
         utils.log_size(io_dir / "client_data", "Cryptographic Context")
 
@@ -66,7 +71,7 @@ def main():
     # Note: this does not use the rng seed above, it lets the implementation
     #   handle its own prg needs. It means that even if called with the same
     #   seed multiple times, the keys and ciphertexts will still be different.
-    utils.run_exe_or_python(exec_dir, "client_key_generation", str(size))
+    utils.run_exe_or_python(exec_dir, "client_key_generation", str(size), *first_pass)
     utils.log_step(2.2 , "Client: Key Generation")
     # Report size of keys and encrypted data
     utils.log_size(io_dir / "public_keys", "Client: Public and evaluation keys")
@@ -74,17 +79,20 @@ def main():
     # 2.3 Communication: Upload evaluation key
     if remote_be:
         utils.run_exe_or_python(exec_dir, "server_upload_ek", str(size))
-        utils.log_step(2.3 , "Communication: Upload evaluation key")
+        utils.log_step(2.3 , "Communication: Upload evaluation key", cpu=False)
 
     # 3. Server-side: Preprocess the (encrypted) dataset using exec_dir/server_preprocess_model
     utils.run_exe_or_python(exec_dir, "server_preprocess_model")
-    utils.log_step(3, "Server: (Encrypted) model preprocessing")
+    # With the remote backend the server stages run elsewhere, and this
+    # process cannot see their CPU time.
+    utils.log_step(3, "Server: (Encrypted) model preprocessing", cpu=not remote_be)
 
     # Run steps 4-10 multiple times if requested
     for run in range(num_runs):
         run_path = params.measuredir() / f"results-{run+1}.json"
         if num_runs > 1:
             print(f"\n         [harness] Run {run+1} of {num_runs}")
+        utils.begin_run()
 
         # 4. Client-side: Generate a new random input using harness/generate_input.py
         cmd_args = [str(size),]
@@ -101,20 +109,32 @@ def main():
         utils.log_step(5, "Client: Input preprocessing")
 
         # 6. Client-side: Encrypt the input
-        utils.run_exe_or_python(exec_dir, "client_encode_encrypt_input", str(size))
+        utils.run_exe_or_python(exec_dir, "client_encode_encrypt_input", str(size), *first_pass)
         utils.log_step(6, "Client: Input encryption")
         utils.log_size(io_dir / "ciphertexts_upload", "Client: Encrypted input")
 
         # 7. Server side: Run the encrypted processing run exec_dir/server_encrypted_compute
-        utils.run_exe_or_python(exec_dir, "server_encrypted_compute", str(size))
-        utils.log_step(7, "Server: Encrypted ML Inference computation")
+        utils.run_exe_or_python(exec_dir, "server_encrypted_compute", str(size), *first_pass)
+        utils.log_step(7, "Server: Encrypted ML Inference computation", cpu=not remote_be)
+        utils.log_layers(io_dir / "server_layers.json", "Server: Encrypted ML Inference computation")
         # Report size of encrypted results
         utils.log_size(io_dir / "ciphertexts_download", "Client: Encrypted results")
 
         # 8. Client-side: decrypt
-        utils.run_exe_or_python(exec_dir, "client_decrypt_decode", str(size))
+        utils.run_exe_or_python(exec_dir, "client_decrypt_decode", str(size), *first_pass)
         utils.log_step(8, "Client: Result decryption")
 
+        # 8.1 Re-run the samples the fast path (or, in a cascade, the MLP)
+        #     could not decide under the high-precision plan, and replace
+        #     their predictions.
+        rerun_file = params.iodir() / "rerun_samples.txt"
+        if rerun_file.exists() and rerun_file.read_text().strip():
+            utils.run_exe_or_python(exec_dir, "client_encode_encrypt_input", str(size), "--rerun")
+            utils.run_exe_or_python(exec_dir, "server_encrypted_compute", str(size), "--rerun")
+            utils.run_exe_or_python(exec_dir, "client_decrypt_decode", str(size), "--rerun")
+            utils.log_step(8.1, "Client+Server: High-precision re-run", cpu=not remote_be)
+            utils.log_layers(io_dir / "server_layers_rerun.json", "Client+Server: High-precision re-run")
+
         # 9. Client-side: post-process
         utils.run_exe_or_python(exec_dir, "client_postprocess", str(size))
         utils.log_step(9, "Client: Result postprocessing")
@@ -139,7 +159,7 @@ def main():
             # 10.2 Run the quality calculation
             utils.calculate_quality(ground_truth_labels, encrypted_model_preds, "Encrypted model")
             utils.calculate_quality(ground_truth_labels, harness_model_preds, "Harness model")
-            utils.log_step(10.2, "Harness: Run quality check")
+            utils.log_step(10.2, "Harness: Run quality check", cpu=False)
 
         # 11. Store measurements
         run_path.parent.mkdir(parents=True, exist_ok=True)
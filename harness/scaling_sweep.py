@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+"""
+scaling_sweep.py - measure how encrypted inference scales with threads,
+concurrent workers, batch size and packing factor.
+"""
+# Copyright 2025 Google LLC
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import argparse
+import csv
+import json
+import os
+import re
+import subprocess
+import time
+from pathlib import Path
+
+import utils
+from params import InstanceParams, SINGLE, LARGE, instance_name
+
+LATENCY_RE = re.compile(r"Execution time for ciphertext (\d+) : (\d+) ms")
+
+FIELDS = ["size", "batch", "packing", "threads", "workers", "numa_keys", "wall_s",
+          "throughput_per_s", "latency_mean_ms", "latency_p50_ms",
+          "latency_p95_ms", "latency_max_ms", "max_rss_mb",
+          "speedup", "efficiency"]
+
+
+def int_list(text):
+    return [int(v) for v in text.split(",") if v]
+
+
+def run_measured(cmd, env=None):
+    """
+    Run cmd to completion. Returns (wall seconds, peak RSS in MB, stdout).
+    The child is reaped with wait4 so its own rusage is reported, not the
+    running maximum over all children.
+    """
+    start = time.perf_counter()
+    proc = subprocess.Popen([str(c) for c in cmd], env=env, text=True,
+                            stdout=subprocess.PIPE)
+    out = proc.stdout.read()
+    proc.stdout.close()
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall = time.perf_counter() - start
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    if proc.returncode != 0:
+        raise subprocess.CalledProcessError(proc.returncode, cmd, out)
+    # ru_maxrss is in KiB on Linux
+    return wall, usage.ru_maxrss / 1024.0, out
+
+
+def percentile(values, q):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    k = min(len(ordered) - 1, max(0, round(q / 100.0 * (len(ordered) - 1))))
+    return float(ordered[k])
+
+
+def build(rootdir, packing):
+    """ Build the submission with the given packing factor in its own tree. """
+    build_dir = rootdir / "submission" / f"build-pack{packing}"
+    subprocess.run(["cmake", "-S", rootdir / "submission", "-B", build_dir,
+                    f"-DCMAKE_PREFIX_PATH={rootdir / 'third_party' / 'openfhe'}",
+                    f"-DLENET5_PACKING={packing}"], check=True)
+    subprocess.run(["cmake", "--build", build_dir, "-j", str(os.cpu_count())],
+                   check=True)
+    return build_dir
+
+
+def prepare(rootdir, build_dir, size):
+    """ Keys and encrypted inputs for one instance size, as run_submission does. """
+    params = InstanceParams(size, rootdir)
+    harness_dir = rootdir / "harness"
+    io_dir = params.iodir()
+    if io_dir.exists():
+        subprocess.run(["rm", "-rf", str(io_dir)], check=True)
+    io_dir.mkdir(parents=True)
+    utils.run_exe_or_python(harness_dir, "generate_dataset",
+                            str(params.datadir() / "dataset.txt"))
+    for stage in ["client_key_generation", "server_preprocess_model"]:
+        subprocess.run([build_dir / stage, str(size)], check=True)
+    utils.run_exe_or_python(harness_dir, "generate_input", str(size))
+    for stage in ["client_preprocess_input", "client_encode_encrypt_input"]:
+        subprocess.run([build_dir / stage, str(size)], check=True)
+
+
+def measure(build_dir, size, threads, workers, numa_keys=False):
+    env = dict(os.environ, OMP_NUM_THREADS=str(threads))
+    cmd = [build_dir / "server_encrypted_compute", str(size), "--workers", str(workers)]
+    if numa_keys:
+        cmd.append("--numa-keys")
+    wall, rss, out = run_measured(cmd, env)
+    latencies = [int(m.group(2)) for m in LATENCY_RE.finditer(out)]
+    batch = InstanceParams(size).get_batch_size()
+    return {
+        "size": instance_name(size),
+        "batch": batch,
+        "threads": threads,
+        "workers": workers,
+        "numa_keys": numa_keys,
+        "wall_s": round(wall, 3),
+        "throughput_per_s": round(batch / wall, 4) if wall > 0 else 0.0,
+        "latency_mean_ms": round(sum(latencies) / len(latencies), 1) if latencies else 0.0,
+        "latency_p50_ms": percentile(latencies, 50),
+        "latency_p95_ms": percentile(latencies, 95),
+        "latency_max_ms": float(max(latencies)) if latencies else 0.0,
+        "max_rss_mb": round(rss, 1),
+    }
+
+
+def add_efficiency(points):
+    """
+    Speedup and parallel efficiency against the 1 thread x 1 worker point of
+    the same size and packing (or the smallest configuration measured).
+    """
+    groups = {}
+    for p in points:
+        groups.setdefault((p["size"], p["packing"], p["numa_keys"]), []).append(p)
+    for group in groups.values():
+        base = min(group, key=lambda p: p["threads"] * p["workers"])
+        base_cores = base["threads"] * base["workers"]
+        for p in group:
+            speedup = p["throughput_per_s"] / base["throughput_per_s"] \
+                if base["throughput_per_s"] > 0 else 0.0
+            cores = p["threads"] * p["workers"] / base_cores
+            p["speedup"] = round(speedup, 3)
+            p["efficiency"] = round(speedup / cores, 3)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--sizes", type=int_list, default=[SINGLE],
+                        help=f"Instance sizes {SINGLE}-{LARGE} (default: 0)")
+    parser.add_argument("--threads", type=int_list, default=[1, 2, 4, 8],
+                        help="OMP_NUM_THREADS values (default: 1,2,4,8)")
+    parser.add_argument("--workers", type=int_list, default=[1],
+                        help="Concurrent inferences in the server (default: 1)")
+    parser.add_argument("--packing", type=int_list, default=[4],
+                        help="LENET5_PACKING values, 1, 2 or 4 (default: 4)")
+    parser.add_argument("--numa-keys", action="store_true",
+                        help="Replicate the evaluation keys per NUMA node in the server")
+    parser.add_argument("--out", type=Path, default=None,
+                        help="Output prefix (default: measurements/scaling/sweep)")
+    args = parser.parse_args()
+
+    rootdir = Path.cwd()
+    utils.ensure_directories(rootdir)
+    out = args.out or rootdir / "measurements" / "scaling" / "sweep"
+    out.parent.mkdir(parents=True, exist_ok=True)
+
+    subprocess.run([rootdir / "scripts" / "get_openfhe.sh"], check=True)
+    points = []
+    for packing in args.packing:
+        build_dir = build(rootdir, packing)
+        for size in args.sizes:
+            # Keys depend on the packing factor, inputs on the size.
+            prepare(rootdir, build_dir, size)
+            for threads in args.threads:
+                for workers in args.workers:
+                    point = measure(build_dir, size, threads, workers, args.numa_keys)
+                    point["packing"] = packing
+                    points.append(point)
+                    print(f"[sweep] {point['size']} packing={packing} "
+                          f"threads={threads} workers={workers}: "
+                          f"{point['throughput_per_s']}/s, "
+                          f"p95 {point['latency_p95_ms']} ms, "
+                          f"{point['max_rss_mb']} MB")
+    add_efficiency(points)
+
+    with open(out.with_suffix(".csv"), "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=FIELDS)
+        writer.writeheader()
+        writer.writerows(points)
+    json.dump(points, open(out.with_suffix(".json"), "w"), indent=2)
+    print(f"[sweep] wrote {out.with_suffix('.csv')} and {out.with_suffix('.json')}")
+
+
+if __name__ == "__main__":
+    main()
@@ -19,6 +19,8 @@ import sys
 import subprocess
 import argparse
 import json
+import os
+import resource
 from datetime import datetime
 from pathlib import Path
 from params import InstanceParams, SINGLE, LARGE
@@ -29,12 +31,19 @@ _last_timestamp: datetime = None
 # Global variable to store measured times
 _timestamps = {}
 _timestampsStr = {}
+# CPU time of the child processes at the last step, and per-stage efficiency
+_last_cpu = None
+_cpu_usage = {}
+# Per-layer timings reported by the server
+_layers = {}
+# Stages logged before the first run (setup), kept for every run
+_setup_stages = None
 # Global variable to store measured sizes
 _bandwidth = {}
 # Global variable to store model quality metrics
 _model_quality = {}
 
-def parse_submission_arguments(workload: str) -> Tuple[int, InstanceParams, int, int, int, bool]:
+def parse_submission_arguments(workload: str) -> Tuple[int, InstanceParams, int, int, int, bool, bool]:
     """
     Get the arguments of the submission. Populate arguments as needed for the workload.
     """
@@ -50,6 +59,8 @@ def parse_submission_arguments(workload: str) -> Tuple[int, InstanceParams, int,
                         help='Specify with 1 if to rerun the cleartext computation')
     parser.add_argument('--remote', action='store_true',
                         help='Run example submission in remote backend mode')
+    parser.add_argument('--cascade', action='store_true',
+                        help='Run the MLP on the batch and LeNet-5 only on its low-margin samples')
 
     args = parser.parse_args()
     size = args.size
@@ -57,10 +68,11 @@ def parse_submission_arguments(workload: str) -> Tuple[int, InstanceParams, int,
     num_runs = args.num_runs
     clrtxt = args.clrtxt
     remote_be = args.remote
+    cascade = args.cascade
 
     # Use params.py to get instance parameters
     params = InstanceParams(size)
-    return size, params, seed, num_runs, clrtxt, remote_be
+    return size, params, seed, num_runs, clrtxt, remote_be, cascade
 
 def ensure_directories(rootdir: Path):
     """ Check that the current directory has sub-directories
@@ -92,14 +104,20 @@ class TextFormat:
     RED = "\033[31m"
     RESET = "\033[0m"
 
-def log_step(step_num: int, step_name: str, start: bool = False):
+def log_step(step_num: int, step_name: str, start: bool = False, cpu: bool = True):
     """ 
     Helper function to print timestamp after each step with second precision 
+    cpu=False skips the CPU accounting for stages that do not run as local
+    child processes (harness code in this process, a remote server).
     """
     global _last_timestamp
     global _timestamps
     global _timestampsStr
+    global _last_cpu
     now = datetime.now()
+    # The stages run as child processes; their user and system time is
+    # reported to this process once they exit.
+    usage = resource.getrusage(resource.RUSAGE_CHILDREN)
     # Format with milliseconds precision
     timestamp = now.strftime("%H:%M:%S")
 
@@ -112,11 +130,61 @@ def log_step(step_num: int, step_name: str, start: bool = False):
 
     # Update the last timestamp for the next call
     _last_timestamp = now
+    previous_cpu, _last_cpu = _last_cpu, usage
 
     if (not start):
         print(f"{TextFormat.BLUE}{timestamp} [harness] {step_num}: {step_name} completed{elapsed_str}{TextFormat.RESET}")
         _timestampsStr[step_name] = f"{round(elapsed_seconds, 4)}s"
         _timestamps[step_name] = elapsed_seconds
+        if cpu and previous_cpu is not None:
+            log_cpu(step_name, elapsed_seconds,
+                    usage.ru_utime - previous_cpu.ru_utime,
+                    usage.ru_stime - previous_cpu.ru_stime)
+
+def available_cores() -> int:
+    """ Cores this process (and so each stage) may run on. """
+    return len(os.sched_getaffinity(0))
+
+def log_cpu(step_name: str, wall: float, user: float, system: float):
+    """
+    Record the CPU time of a stage next to its wall time. Parallel efficiency
+    is CPU-seconds / (wall x cores): 1.0 keeps every core busy, 1/cores is a
+    serial stage.
+    """
+    cores = available_cores()
+    efficiency = (user + system) / (wall * cores) if wall > 0 else 0
+    _cpu_usage[step_name] = {
+        "wall_s": round(wall, 4),
+        "user_s": round(user, 4),
+        "sys_s": round(system, 4),
+        "cores": cores,
+        "parallel_efficiency": round(efficiency, 4),
+    }
+    print(f"         [harness] {step_name}: {round(user + system, 2)} CPU-s on {cores} cores, "
+          f"efficiency {efficiency:.2f}")
+
+def begin_run():
+    """
+    Forget the per-run stages of the previous run, so a stage it ran and this
+    run skips (e.g. the re-run) is not reported again. Setup stages stay.
+    """
+    global _setup_stages
+    if _setup_stages is None:
+        _setup_stages = set(_timestamps)
+    for stages in (_timestamps, _timestampsStr, _cpu_usage):
+        for name in [name for name in stages if name not in _setup_stages]:
+            del stages[name]
+    _layers.clear()
+
+def log_layers(path: Path, tag: str):
+    """
+    Add the per-layer wall and CPU time the server wrote to path (see
+    server_encrypted_compute) to the results under tag.
+    """
+    if path.exists():
+        _layers[tag] = json.loads(path.read_text())
+        # Consumed, so a later run that skips the stage cannot report it again.
+        path.unlink()
 
 def log_size(path: Path, object_name: str, flag: bool = False, previous: int = 0):
     global _bandwidth
@@ -154,12 +222,16 @@ def save_run(path: Path, size: int = 0):
         json.dump({
             "total_latency_ms": round(sum(_timestamps.values()), 4),
             "per_stage": _timestampsStr,
+            "per_stage_cpu": _cpu_usage,
+            "per_layer": _layers,
             "bandwidth": _bandwidth,
         }, open(path,"w"), indent=2)
     else:
         json.dump({
             "total_latency_ms": round(sum(_timestamps.values()), 4),
             "per_stage": _timestampsStr,
+            "per_stage_cpu": _cpu_usage,
+            "per_layer": _layers,
             "bandwidth": _bandwidth,
             "mnist_model_quality" : _model_quality,
         }, open(path,"w"), indent=2)
@@ -35,6 +35,7 @@
 #include <filesystem>
 #include <iostream>
 #include <cmath>
+#include <mutex>
 #include <thread>
 #include "FHEONANNController.h"
 
@@ -42,6 +43,73 @@ namespace fs = std::filesystem;
 
 void FHEONANNController::setContext(CryptoContext<DCRTPoly>& in_context){
     context = in_context;
+    hoisted.clear();
+    // The mask cache belongs to the previous context.
+    masks = nullptr;
+}
+
+/**
+ * @brief Rotate a ciphertext with hoisting, through the rotation memo.
+ *
+ * The first rotation of an input precomputes its digits; later rotations of
+ * the same input reuse them, and a rotation already computed is returned
+ * without a key switch.
+ *
+ * @param input  Ciphertext to rotate; must not be modified in place afterwards.
+ * @param index  Rotation index.
+ *
+ * @return Rotated ciphertext, possibly shared with an earlier caller.
+ */
+Ctext FHEONANNController::hoisted_rotation(const Ctext& input, int index) {
+    auto entry = hoisted.find(input.get());
+    if (entry != hoisted.end() && entry->second.input.lock() != input) {
+        // A dead input's address was reused.
+        hoisted.erase(entry);
+        entry = hoisted.end();
+    }
+    if (entry == hoisted.end()) {
+        prune_hoisted();
+        HoistedInput fresh;
+        fresh.input = input;
+        fresh.digits = context->EvalFastRotationPrecompute(input);
+        entry = hoisted.emplace(input.get(), std::move(fresh)).first;
+    }
+    auto rotation = entry->second.rotations.find(index);
+    if (rotation != entry->second.rotations.end()) {
+        reuse.keySwitches++;
+        return rotation->second;
+    }
+    Ctext rotated = context->EvalFastRotation(input, index, context->GetCyclotomicOrder(), entry->second.digits);
+    entry->second.rotations.emplace(index, rotated);
+    return rotated;
+}
+
+/**
+ * @brief Drop memo entries whose input is no longer referenced.
+ */
+void FHEONANNController::prune_hoisted() {
+    for (auto entry = hoisted.begin(); entry != hoisted.end();) {
+        if (entry->second.input.expired()) {
+            entry = hoisted.erase(entry);
+        } else {
+            ++entry;
+        }
+    }
+}
+
+FHEONReuseStats FHEONANNController::take_reuse_stats() {
+    prune_hoisted();
+    FHEONReuseStats taken = reuse;
+    reuse = FHEONReuseStats();
+    return taken;
+}
+
+string FHEONANNController::mask_key(const char* kind, initializer_list<int> params) {
+    string key = kind;
+    for (int param : params) {
+        key += ":" + to_string(param);
+    }
+    return key;
 }
 
 /**
@@ -397,6 +465,58 @@ vector <int> FHEONANNController::generate_avgpool_optimized_rotation_positions(i
     return keys_position;
 }
 
+/**
+ * @brief Generate the rotation positions required by he_convolution_replicated.
+ *
+ * Covers the tap rotations, the channel summation and row compaction inside
+ * each copy, the per-channel placement shifts (r * region - oc * outputSize)
+ * and, when the server has to build the copies itself, the doubling rotations
+ * used by he_replicate_input.
+ *
+ * @param inputWidth       Width of the input feature map (assumed square).
+ * @param inputChannels    Number of input channels.
+ * @param outputChannels   Number of output channels.
+ * @param kernelWidth      Width of the convolution kernel (assumed square).
+ * @param region           Slot distance between two copies of the input.
+ * @param replicas         Number of copies of the input.
+ * @param replicateInput   True if the input is replicated by he_replicate_input.
+ *
+ * @return A vector of integers representing the rotation positions required.
+ */
+vector <int> FHEONANNController::generate_replicated_convolution_rotation_positions(int inputWidth, int inputChannels,
+                                        int outputChannels, int kernelWidth, int region, int replicas, bool replicateInput){
+
+    vector<int> keys_position;
+    int inputSize = inputWidth * inputWidth;
+    int outputWidth = inputWidth - kernelWidth + 1;
+    int outputSize = outputWidth * outputWidth;
+
+    keys_position.push_back(inputWidth);
+    for(int j=1; j < kernelWidth; j++){
+        keys_position.push_back(j);
+    }
+    if(inputChannels > 1){
+        keys_position.push_back(inputSize);
+    }
+    for(int l=1; l < outputWidth; l++){
+        keys_position.push_back(-(l*outputWidth));
+    }
+    for(int oc=0; oc < outputChannels; oc++){
+        keys_position.push_back((oc % replicas)*region - oc*outputSize);
+    }
+    if(replicateInput){
+        for(int s=1; s < replicas; s *= 2){
+            keys_position.push_back(-(s*region));
+        }
+    }
+
+    std::sort(keys_position.begin(), keys_position.end());
+    auto new_end = std::remove(keys_position.begin(), keys_position.end(), 0);
+    new_end = std::unique(keys_position.begin(), new_end);
+    keys_position.erase(new_end, keys_position.end());
+    return keys_position;
+}
+
 /**
  * @brief Generate rotation positions for fully connected (FC) layers 
  *        in homomorphic encryption.
@@ -436,6 +556,77 @@ vector <int> FHEONANNController::generate_linear_rotation_positions(int maxFCLay
     return keys_position;
 }
 
+/**
+ * @brief Multiply the rotated input slices by their kernel taps and sum them.
+ *
+ * The products are fused (fused_inner_product): no product ciphertext is written.
+ *
+ * @param rotatedInputs   The k^2 rotated copies of the input.
+ * @param kernelData      One plaintext per tap.
+ *
+ * @return Ctext          Sum of the k^2 products.
+ */
+Ctext FHEONANNController::multiply_taps(const vector<Ctext>& rotatedInputs, vector<Ptext>& kernelData) {
+    vector<Ctext> taps(rotatedInputs.begin(), rotatedInputs.begin() + kernelData.size());
+    return fused_inner_product(context, taps, kernelData);
+}
+
+/**
+ * @brief Multiply the rotated input slices by encrypted kernel taps and sum them.
+ *
+ * The products are left as three-element ciphertexts and added up before a single
+ * Relinearize, so a channel pays one key switch instead of k^2.
+ *
+ * @param rotatedInputs   The k^2 rotated copies of the input.
+ * @param kernelData      One ciphertext per tap.
+ *
+ * @return Ctext          Relinearized sum of the k^2 products.
+ */
+Ctext FHEONANNController::multiply_taps(const vector<Ctext>& rotatedInputs, vector<Ctext>& kernelData) {
+    Ctext conv_sum = context->EvalMultNoRelin(rotatedInputs[0], kernelData[0]);
+    for (size_t k = 1; k < kernelData.size(); k++) {
+        context->EvalAddInPlace(conv_sum, context->EvalMultNoRelin(rotatedInputs[k], kernelData[k]));
+    }
+    return context->Relinearize(conv_sum);
+}
+
+/**
+ * @brief Add one tap product into a streaming accumulator (empty on the first tap).
+ *
+ * @param accumulator    Running sum; an empty Ctext starts it.
+ * @param rotatedInput   Rotated copy of the input for this tap.
+ * @param kernelTap      Plaintext of the tap.
+ */
+void FHEONANNController::accumulate_tap(Ctext& accumulator, const Ctext& rotatedInput, Ptext& kernelTap) {
+    fused_multiply_accumulate(context, accumulator, rotatedInput, kernelTap);
+}
+
+/**
+ * @brief Encrypted-tap form of accumulate_tap. Products stay unrelinearized, as in
+ * multiply_taps, until finish_taps.
+ */
+void FHEONANNController::accumulate_tap(Ctext& accumulator, const Ctext& rotatedInput, Ctext& kernelTap) {
+    if (!accumulator) {
+        accumulator = context->EvalMultNoRelin(rotatedInput, kernelTap);
+        return;
+    }
+    context->EvalAddInPlace(accumulator, context->EvalMultNoRelin(rotatedInput, kernelTap));
+}
+
+/**
+ * @brief Close a streaming accumulator: nothing to do for plaintext taps.
+ */
+Ctext FHEONANNController::finish_taps(Ctext& accumulator, const vector<Ptext>& kernelData) {
+    return accumulator;
+}
+
+/**
+ * @brief Close a streaming accumulator of encrypted taps with its single Relinearize.
+ */
+Ctext FHEONANNController::finish_taps(Ctext& accumulator, const vector<Ctext>& kernelData) {
+    return context->Relinearize(accumulator);
+}
+
 /**
  * @brief Perform a secure convolution operation on encrypted data.
  *
@@ -465,8 +656,28 @@ vector <int> FHEONANNController::generate_linear_rotation_positions(int maxFCLay
  */
 Ctext FHEONANNController::he_convolution(Ctext& encryptedInput, vector<vector<Ptext>>& kernelData, Ptext& biasInput,
         int inputWidth,  int inputChannels, int outputChannels,  int kernelWidth, int paddingLen, int stride) {
+    return convolution(encryptedInput, kernelData, biasInput, inputWidth, inputChannels, outputChannels,
+                       kernelWidth, paddingLen, stride);
+}
+
+/**
+ * @brief he_convolution with encrypted kernels (model-private deployments).
+ *
+ * kernelData[out_ch] holds the ciphertexts of FHEONHEController::encrypt_kernel_packed,
+ * one per tap with the tap value of every input channel, i.e. the encode_kernel layout.
+ * The k^2 ciphertext products of a channel are accumulated unrelinearized and
+ * relinearized once, see multiply_taps().
+ */
+Ctext FHEONANNController::he_convolution(Ctext& encryptedInput, vector<vector<Ctext>>& kernelData, Ctext& biasInput,
+        int inputWidth,  int inputChannels, int outputChannels,  int kernelWidth, int paddingLen, int stride) {
+    return convolution(encryptedInput, kernelData, biasInput, inputWidth, inputChannels, outputChannels,
+                       kernelWidth, paddingLen, stride);
+}
+
+template <typename T>
+Ctext FHEONANNController::convolution(Ctext& encryptedInput, vector<vector<T>>& kernelData, T& biasInput,
+        int inputWidth,  int inputChannels, int outputChannels,  int kernelWidth, int paddingLen, int stride) {
 
-    int kernelSq = kernelWidth * kernelWidth;
     int inputSize = inputWidth * inputWidth;
     int outputWidth = ((inputWidth - kernelWidth) / stride) + 1;
     int outputSize = outputWidth * outputWidth;
@@ -499,14 +710,8 @@ Ctext FHEONANNController::he_convolution(Ctext& encryptedInput, vector<vector<Pt
     Ctext strided_cipher;
     vector<Ctext> final_vec;
     for (int out_ch = 0; out_ch < outputChannels; out_ch++) {
-        vector<Ctext> mult_results;
-
         // Per-kernel value multiplies
-        for (int k = 0; k < kernelSq; k++) {
-            mult_results.push_back(context->EvalMult(rotated_ciphertexts[k], kernelData[out_ch][k]));
-        }
-
-        Ctext conv_sum = context->EvalAddMany(mult_results);
+        Ctext conv_sum = multiply_taps(rotated_ciphertexts, kernelData[out_ch]);
 
         // STEP 4 - Sum all input channels (rotating and adding)
         if (inputChannels > 1) {
@@ -550,6 +755,158 @@ Ctext FHEONANNController::he_convolution(Ctext& encryptedInput, vector<vector<Pt
     return context->EvalAdd(context->EvalAddMany(final_vec), biasInput);;
 }
 
+/**
+ * @brief Perform a secure convolution on an input holding several copies of itself.
+ *
+ * The input ciphertext holds `replicas` cyclic copies of the activation, one every
+ * `region` slots (mlp_encrypt already packs the image this way; he_replicate_input
+ * builds the copies for later layers). Each plaintext multiply of pass p applies the
+ * taps of output channels p*replicas ... p*replicas+replicas-1 to the respective
+ * copies, so a layer takes ceil(outputChannels / replicas) passes instead of
+ * outputChannels. Channel summation and row compaction run on all copies at once;
+ * a split mask then isolates each copy before it is rotated to its output channel
+ * position. For stride 1 the row mask only reads slots inside the first channel
+ * block of each copy, so the cleaning mask of he_convolution is not needed and the
+ * layer keeps the same depth (3).
+ *
+ * The output layout, and therefore the bias, is identical to he_convolution.
+ *
+ * @param encryptedInput   Encrypted, replicated input feature map (ciphertext).
+ * @param kernelData       Kernels encoded by encode_kernel_replicated, [pass][tap].
+ * @param biasInput        Bias term for each output channel (plaintext).
+ * @param inputWidth       Width of the input feature map (assumed square).
+ * @param inputChannels    Number of input channels.
+ * @param outputChannels   Number of output channels.
+ * @param kernelWidth      Width of the convolution kernel (assumed square).
+ * @param region           Slot distance between two copies of the input.
+ * @param replicas         Number of copies of the input.
+ *
+ * @return Ctext           Ciphertext representing the encrypted result of 
+ *                         the convolution operation (stride 1, no padding).
+ *
+ * @see he_convolution()
+ * @see generate_replicated_convolution_rotation_positions()
+ */
+Ctext FHEONANNController::he_convolution_replicated(Ctext& encryptedInput, vector<vector<Ptext>>& kernelData, Ptext& biasInput,
+        int inputWidth, int inputChannels, int outputChannels, int kernelWidth, int region, int replicas) {
+    return convolution_replicated(encryptedInput, kernelData, biasInput, inputWidth, inputChannels, outputChannels,
+                                  kernelWidth, region, replicas);
+}
+
+/**
+ * @brief he_convolution_replicated with encrypted kernels from
+ *        FHEONHEController::encrypt_kernel_replicated.
+ *
+ * Each pass relinearizes once, after its k^2 ciphertext products are summed.
+ */
+Ctext FHEONANNController::he_convolution_replicated(Ctext& encryptedInput, vector<vector<Ctext>>& kernelData, Ctext& biasInput,
+        int inputWidth, int inputChannels, int outputChannels, int kernelWidth, int region, int replicas) {
+    return convolution_replicated(encryptedInput, kernelData, biasInput, inputWidth, inputChannels, outputChannels,
+                                  kernelWidth, region, replicas);
+}
+
+template <typename T>
+Ctext FHEONANNController::convolution_replicated(Ctext& encryptedInput, vector<vector<T>>& kernelData, T& biasInput,
+        int inputWidth, int inputChannels, int outputChannels, int kernelWidth, int region, int replicas) {
+
+    int inputSize = inputWidth * inputWidth;
+    int outputWidth = inputWidth - kernelWidth + 1;
+    int outputSize = outputWidth * outputWidth;
+    int encode_level = encryptedInput->GetLevel();
+    int maskSize = replicas * region;
+
+    // STEP 1 - Row mask for every copy, and one split mask per copy
+    vector<double> row_mask(maskSize, 0.0);
+    vector<Ptext> split_masks;
+    for (int r = 0; r < replicas; r++) {
+        fill_n(row_mask.begin() + r * region, outputWidth, 1.0);
+        vector<double> split_mask(maskSize, 0.0);
+        fill_n(split_mask.begin() + r * region, outputSize, 1.0);
+        split_masks.push_back(context->MakeCKKSPackedPlaintext(split_mask, 1, encode_level));
+    }
+    Ptext cleaning_mask_out = context->MakeCKKSPackedPlaintext(row_mask, 1, encode_level);
+
+    // STEP 2 - ROTATE INPUT TO FORM k^2 slices
+    vector<Ctext> rotated_ciphertexts;
+    Ctext rowInput = encryptedInput;
+    for (int i = 0; i < kernelWidth; i++) {
+        if (i > 0) {
+            rowInput = context->EvalRotate(rowInput, inputWidth);
+        }
+        rotated_ciphertexts.push_back(rowInput);
+        for (int j = 1; j < kernelWidth; j++) {
+            rotated_ciphertexts.push_back(context->EvalRotate(rowInput, j));
+        }
+    }
+
+    // STEP 3 - Each pass computes `replicas` output channels
+    vector<Ctext> final_vec;
+    int passes = kernelData.size();
+    for (int p = 0; p < passes; p++) {
+        Ctext conv_sum = multiply_taps(rotated_ciphertexts, kernelData[p]);
+
+        // Sum the input channels inside every copy
+        if (inputChannels > 1) {
+            vector<Ctext> channel_sums = { conv_sum };
+            for (int ch = 1; ch < inputChannels; ch++) {
+                conv_sum = context->EvalRotate(conv_sum, inputSize);
+                channel_sums.push_back(conv_sum);
+            }
+            conv_sum = context->EvalAddMany(channel_sums);
+        }
+
+        // STEP 4 - Row compaction on all copies at once
+        vector<Ctext> strided_vec;
+        for (int l = 0; l < outputWidth; l++) {
+            if (l == 0) {
+                strided_vec.push_back(context->EvalMult(conv_sum, cleaning_mask_out));
+            } else {
+                conv_sum = context->EvalRotate(conv_sum, inputWidth);
+                strided_vec.push_back(context->EvalRotate(context->EvalMult(conv_sum, cleaning_mask_out), -(outputWidth * l)));
+            }
+        }
+        Ctext strided_cipher = context->EvalAddMany(strided_vec);
+
+        // STEP 5 - Split the copies and move each to its output channel position
+        for (int r = 0; r < replicas; r++) {
+            int out_ch = p * replicas + r;
+            if (out_ch >= outputChannels) {
+                break;
+            }
+            Ctext channel_cipher = context->EvalMult(strided_cipher, split_masks[r]);
+            int shift = r * region - out_ch * outputSize;
+            if (shift != 0) {
+                channel_cipher = context->EvalRotate(channel_cipher, shift);
+            }
+            final_vec.push_back(channel_cipher);
+        }
+    }
+    rotated_ciphertexts.clear();
+    return context->EvalAdd(context->EvalAddMany(final_vec), biasInput);
+}
+
+/**
+ * @brief Fill a ciphertext with cyclic copies of its first region.
+ *
+ * Slots outside [0, region) must be zero on input. Uses log2(replicas) rotations
+ * and additions and no multiplicative depth.
+ *
+ * @param encryptedInput   Encrypted input, zero outside its first region.
+ * @param region           Slot distance between two copies.
+ * @param replicas         Number of copies to build (power of two).
+ *
+ * @return Ctext           Ciphertext holding `replicas` copies of the input.
+ *
+ * @see he_convolution_replicated()
+ */
+Ctext FHEONANNController::he_replicate_input(Ctext& encryptedInput, int region, int replicas) {
+    Ctext replicated = encryptedInput;
+    for (int s = 1; s < replicas; s *= 2) {
+        replicated = context->EvalAdd(replicated, context->EvalRotate(replicated, -(s * region)));
+    }
+    return replicated;
+}
+
 /**
 * @brief Perform a secure convolution operation with explicit padding 
  *        on encrypted data.
@@ -680,17 +1037,16 @@ Ctext FHEONANNController::he_convolution_optimized(Ctext& encryptedInput,  vecto
     int encode_level = encryptedInput->GetLevel();
     vector<Ctext> rotated_ciphertexts;
     
-    auto digits = context->EvalFastRotationPrecompute(encryptedInput);
-    Ctext first_shot = context->EvalFastRotation(encryptedInput, -1, context->GetCyclotomicOrder(), digits);
-    Ctext second_shot = context->EvalFastRotation(encryptedInput, 1, context->GetCyclotomicOrder(), digits);
+    Ctext first_shot = hoisted_rotation(encryptedInput, -1);
+    Ctext second_shot = hoisted_rotation(encryptedInput, 1);
     rotated_ciphertexts.push_back(context->EvalRotate(first_shot, -inputWidth));
-    rotated_ciphertexts.push_back(context->EvalFastRotation(encryptedInput, -inputWidth, context->GetCyclotomicOrder(), digits));
+    rotated_ciphertexts.push_back(hoisted_rotation(encryptedInput, -inputWidth));
     rotated_ciphertexts.push_back(context->EvalRotate(second_shot, -inputWidth));
     rotated_ciphertexts.push_back(first_shot);
     rotated_ciphertexts.push_back(encryptedInput);
     rotated_ciphertexts.push_back(second_shot);
     rotated_ciphertexts.push_back(context->EvalRotate(first_shot, inputWidth));
-    rotated_ciphertexts.push_back(context->EvalFastRotation(encryptedInput, inputWidth, context->GetCyclotomicOrder(), digits));
+    rotated_ciphertexts.push_back(hoisted_rotation(encryptedInput, inputWidth));
     rotated_ciphertexts.push_back(context->EvalRotate(second_shot, inputWidth));
     Ptext cleaning_mask =  context->MakeCKKSPackedPlaintext(generate_mixed_mask(inputSize, (inputChannels*inputSize)), 1, encode_level);
             
@@ -770,17 +1126,16 @@ Ctext  FHEONANNController::he_convolution_optimized_with_multiple_channels(Ctext
     Ptext cleaningoutputMask = context->MakeCKKSPackedPlaintext(generate_mixed_mask((inputChannels*outputSize), vectorSize), 1, encodeLevel);
     
     // Horizontal rotations
-    auto digits = context->EvalFastRotationPrecompute(encryptedInput);
-    Ctext first_shot = context->EvalFastRotation(encryptedInput, -1, context->GetCyclotomicOrder(), digits);
-    Ctext second_shot = context->EvalFastRotation(encryptedInput, 1, context->GetCyclotomicOrder(), digits);
+    Ctext first_shot = hoisted_rotation(encryptedInput, -1);
+    Ctext second_shot = hoisted_rotation(encryptedInput, 1);
     rotatedInputs.push_back(context->EvalRotate(first_shot, -inputWidth));
-    rotatedInputs.push_back(context->EvalFastRotation(encryptedInput, -inputWidth, context->GetCyclotomicOrder(), digits));
+    rotatedInputs.push_back(hoisted_rotation(encryptedInput, -inputWidth));
     rotatedInputs.push_back(context->EvalRotate(second_shot, -inputWidth));
     rotatedInputs.push_back(first_shot);
     rotatedInputs.push_back(encryptedInput);
     rotatedInputs.push_back(second_shot);
     rotatedInputs.push_back(context->EvalRotate(first_shot, inputWidth));
-    rotatedInputs.push_back(context->EvalFastRotation(encryptedInput, inputWidth, context->GetCyclotomicOrder(), digits));
+    rotatedInputs.push_back(hoisted_rotation(encryptedInput, inputWidth));
     rotatedInputs.push_back(context->EvalRotate(second_shot, inputWidth));
 
     // Create vectors to store results
@@ -975,17 +1330,16 @@ vector<Ctext>  FHEONANNController::he_convolution_and_shortcut_optimized( const
     Ptext cleaningMask = context->MakeCKKSPackedPlaintext(generate_mixed_mask(inputSize, vectorSize), 1, encodeLevel);
     
     // Horizontal rotations
-    auto digits = context->EvalFastRotationPrecompute(encryptedInput);
-    Ctext first_shot = context->EvalFastRotation(encryptedInput, -1, context->GetCyclotomicOrder(), digits);
-    Ctext second_shot = context->EvalFastRotation(encryptedInput, 1, context->GetCyclotomicOrder(), digits);
+    Ctext first_shot = hoisted_rotation(encryptedInput, -1);
+    Ctext second_shot = hoisted_rotation(encryptedInput, 1);
     rotatedInputs.push_back(context->EvalRotate(first_shot, -inputWidth));
-    rotatedInputs.push_back(context->EvalFastRotation(encryptedInput, -inputWidth, context->GetCyclotomicOrder(), digits));
+    rotatedInputs.push_back(hoisted_rotation(encryptedInput, -inputWidth));
     rotatedInputs.push_back(context->EvalRotate(second_shot, -inputWidth));
     rotatedInputs.push_back(first_shot);
     rotatedInputs.push_back(encryptedInput);
     rotatedInputs.push_back(second_shot);
     rotatedInputs.push_back(context->EvalRotate(first_shot, inputWidth));
-    rotatedInputs.push_back(context->EvalFastRotation(encryptedInput, inputWidth, context->GetCyclotomicOrder(), digits));
+    rotatedInputs.push_back(hoisted_rotation(encryptedInput, inputWidth));
     rotatedInputs.push_back(context->EvalRotate(second_shot, inputWidth));
 
     // Create vectors to store results
@@ -1095,17 +1449,16 @@ vector<Ctext>  FHEONANNController::he_convolution_and_shortcut_optimized_with_mu
     Ptext cleaningoutputMask = context->MakeCKKSPackedPlaintext(generate_mixed_mask((inputChannels*outputSize), vectorSize), 1, encodeLevel);
     
     // Horizontal rotations
-    auto digits = context->EvalFastRotationPrecompute(encryptedInput);
-    Ctext first_shot = context->EvalFastRotation(encryptedInput, -1, context->GetCyclotomicOrder(), digits);
-    Ctext second_shot = context->EvalFastRotation(encryptedInput, 1, context->GetCyclotomicOrder(), digits);
+    Ctext first_shot = hoisted_rotation(encryptedInput, -1);
+    Ctext second_shot = hoisted_rotation(encryptedInput, 1);
     rotatedInputs.push_back(context->EvalRotate(first_shot, -inputWidth));
-    rotatedInputs.push_back(context->EvalFastRotation(encryptedInput, -inputWidth, context->GetCyclotomicOrder(), digits));
+    rotatedInputs.push_back(hoisted_rotation(encryptedInput, -inputWidth));
     rotatedInputs.push_back(context->EvalRotate(second_shot, -inputWidth));
     rotatedInputs.push_back(first_shot);
     rotatedInputs.push_back(encryptedInput);
     rotatedInputs.push_back(second_shot);
     rotatedInputs.push_back(context->EvalRotate(first_shot, inputWidth));
-    rotatedInputs.push_back(context->EvalFastRotation(encryptedInput, inputWidth, context->GetCyclotomicOrder(), digits));
+    rotatedInputs.push_back(hoisted_rotation(encryptedInput, inputWidth));
     rotatedInputs.push_back(context->EvalRotate(second_shot, inputWidth));
 
     // Create vectors to store results
@@ -1368,11 +1721,10 @@ Ctext FHEONANNController::he_avgpool_optimzed(Ctext& encryptedInput,  int inputW
     
     /*** STEP 1 - ROTATE THE CIPHERTEXT into by k^2-1 and create a k^2 rotated right positions ***/
     vector<Ctext> rotated_ciphertexts;
-    auto digits = context->EvalFastRotationPrecompute(encryptedInput);
     rotated_ciphertexts.push_back(encryptedInput);
-    rotated_ciphertexts.push_back(context->EvalFastRotation(encryptedInput, 1, context->GetCyclotomicOrder(), digits));
-    rotated_ciphertexts.push_back(context->EvalFastRotation(encryptedInput, inputWidth, context->GetCyclotomicOrder(), digits));
-    rotated_ciphertexts.push_back(context->EvalRotate(context->EvalFastRotation(encryptedInput, inputWidth, context->GetCyclotomicOrder(), digits), 1));
+    rotated_ciphertexts.push_back(hoisted_rotation(encryptedInput, 1));
+    rotated_ciphertexts.push_back(hoisted_rotation(encryptedInput, inputWidth));
+    rotated_ciphertexts.push_back(context->EvalRotate(hoisted_rotation(encryptedInput, inputWidth), 1));
     Ctext sum_cipher = context->EvalAddMany(rotated_ciphertexts);
 
     /*** STEP 3: Multiply the scale value with the sum cipher */
@@ -1439,11 +1791,10 @@ Ctext FHEONANNController::he_avgpool_optimzed_with_multiple_channels(Ctext& encr
     
     /*** STEP 1 - ROTATE THE CIPHERTEXT into by k^2-1 and create a k^2 rotated right positions ***/
     vector<Ctext> rotated_ciphertexts;
-    auto digits = context->EvalFastRotationPrecompute(encryptedInput);
     rotated_ciphertexts.push_back(encryptedInput);
-    rotated_ciphertexts.push_back(context->EvalFastRotation(encryptedInput, 1, context->GetCyclotomicOrder(), digits));
-    rotated_ciphertexts.push_back(context->EvalFastRotation(encryptedInput, inputWidth, context->GetCyclotomicOrder(), digits));
-    rotated_ciphertexts.push_back(context->EvalRotate(context->EvalFastRotation(encryptedInput, inputWidth, context->GetCyclotomicOrder(), digits), 1));
+    rotated_ciphertexts.push_back(hoisted_rotation(encryptedInput, 1));
+    rotated_ciphertexts.push_back(hoisted_rotation(encryptedInput, inputWidth));
+    rotated_ciphertexts.push_back(context->EvalRotate(hoisted_rotation(encryptedInput, inputWidth), 1));
     Ctext sum_cipher = context->EvalAddMany(rotated_ciphertexts);
 
     /*** STEP 3: Multiply the scale value with the sum cipher */
@@ -1578,6 +1929,23 @@ Ctext FHEONANNController::he_globalavgpool(Ctext& encryptedInput,  int inputWidt
  */
 Ctext FHEONANNController::he_linear(Ctext& encryptedInput, vector<Ptext>& weightMatrix, Ptext& biasInput, 
                     int inputSize, int outputSize, int rotatePositions){
+    return linear(encryptedInput, weightMatrix, biasInput, inputSize, outputSize, rotatePositions);
+}
+
+/**
+ * @brief he_linear with encrypted weight rows and bias.
+ *
+ * Every product feeds EvalSum's rotations, so it is relinearized straight away;
+ * that adds one key switch per log2(inputSize) rotations of the summation.
+ */
+Ctext FHEONANNController::he_linear(Ctext& encryptedInput, vector<Ctext>& weightMatrix, Ctext& biasInput, 
+                    int inputSize, int outputSize, int rotatePositions){
+    return linear(encryptedInput, weightMatrix, biasInput, inputSize, outputSize, rotatePositions);
+}
+
+template <typename T>
+Ctext FHEONANNController::linear(Ctext& encryptedInput, vector<T>& weightMatrix, T& biasInput, 
+                    int inputSize, int outputSize, int rotatePositions){
 
     int output_size = weightMatrix.size();
     if(outputSize > output_size){
@@ -1681,7 +2049,7 @@ Ctext FHEONANNController::he_relu(Ctext& encryptedInput, double scaleValue,  int
     
     auto encryptInn = encryptedInput->Clone();
     if(scaleValue > 1){
-        auto mask_data = context->MakeCKKSPackedPlaintext(generate_scale_mask(scaleValue, vectorSize), 1, 0, nullptr, nextPowerOf2(vectorSize));
+        auto mask_data = generate_scale_plaintext(scaleValue, vectorSize, 0, nextPowerOf2(vectorSize));
         encryptInn = context->EvalMult(encryptedInput, mask_data);
     }
     else{
@@ -1791,17 +2159,16 @@ Ctext FHEONANNController::downsample(const Ctext& input, int inputWidth, int str
         );
     }
     result = context->EvalAdd(result, context->EvalRotate(result, pow(2, (log2(outputWidth)-1))));
-    // Step 2: Row processing with optimized rotations
-    Ctext downsampledrows = context->EvalMult(input, generate_zero_mask(inputSize, input->GetLevel()));
-    
+    // Step 2: Row processing with optimized rotations. The rows are summed once at
+    // the end rather than into a zero-masked copy of the input.
+    vector<Ctext> rows(outputWidth);
     for (int row = 0; row < outputWidth; ++row) {
-        Ctext masked = context->EvalMult(result, generate_row_mask(row, outputWidth, inputSize, stride, input->GetLevel()));
-        downsampledrows = context->EvalAdd(downsampledrows, masked);
+        rows[row] = context->EvalMult(result, generate_row_mask(row, outputWidth, inputSize, stride, input->GetLevel()));
         if(row < outputWidth-1){
             result = context->EvalRotate(result, (stride*inputWidth - outputWidth));
         }
     }
-    return downsampledrows;
+    return context->EvalAddMany(rows);
 }
 
 /**
@@ -1829,8 +2196,6 @@ Ctext FHEONANNController::downsample_with_multiple_channels(const Ctext& input,
     const int level        = input->GetLevel();
     int outputSize = outputWidth * outputWidth;
 
-    Ctext encryptedzeros =  context->EvalMult(input, generate_zero_mask_channels(inputSize, numChannels, input->GetLevel()));
-
     // 2) binary-row decomposition
     Ctext result = context->EvalMult(input, first_mask_with_channels(inputWidth, inputSize, stride, numChannels, level));
 
@@ -1844,27 +2209,28 @@ Ctext FHEONANNController::downsample_with_multiple_channels(const Ctext& input,
 
     result = context->EvalAdd(result, context->EvalRotate(result, pow(2, (log2(outputWidth)-1))));
 
-    // Step 2: Row processing with optimized rotations
-    Ctext downsampledrows = encryptedzeros->Clone();
+    // Step 2: Row processing with optimized rotations; rows and channels are summed
+    // once instead of into a zero-masked copy of the input.
+    vector<Ctext> rows(outputWidth);
     for (int row = 0; row < outputWidth; row++) {
-        Ctext masked = context->EvalMult(result, generate_row_mask_with_channels(row, outputWidth, inputSize, stride, numChannels, input->GetLevel()));
-        downsampledrows = context->EvalAdd(downsampledrows, masked);
+        rows[row] = context->EvalMult(result, generate_row_mask_with_channels(row, outputWidth, inputSize, stride, numChannels, input->GetLevel()));
         if(row < outputWidth-1){
             result = context->EvalRotate(result, (stride*inputWidth - outputWidth));
         }
     }
+    Ctext downsampledrows = context->EvalAddMany(rows);
 
     /***
     * step 3: process per channel
     ******/ 
-    Ctext downsampledchannels =  encryptedzeros->Clone();
+    vector<Ctext> channels(numChannels);
     for (int ch=0; ch < numChannels; ch++){
-        Ctext masked = context->EvalMult(downsampledrows, generate_channel_mask_with_zeros(ch, outputSize, numChannels, input->GetLevel()));
-        downsampledchannels = context->EvalAdd(downsampledchannels, masked);
+        channels[ch] = context->EvalMult(downsampledrows, generate_channel_mask_with_zeros(ch, outputSize, numChannels, input->GetLevel()));
         if(ch < numChannels-1){
             downsampledrows = context->EvalRotate(downsampledrows, (inputSize - outputSize));
         }
     }
+    Ctext downsampledchannels = context->EvalAddMany(channels);
 
     /***
     * step 3: process per channel
@@ -1893,16 +2259,18 @@ Ctext FHEONANNController::downsample_with_multiple_channels(const Ctext& input,
  * @return Packed plaintext mask with selected elements set to 1.
  */
 Ptext FHEONANNController::first_mask(int width, int inputSize, int stride, int level) {
-    vector<double> mask(inputSize, 0);
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < width; j++) {
-            if (j % stride == 0 && i % stride == 0) {
-                int index = i * width + j;
-                mask[index] = 1.0;
+    return cached_mask(mask_key("first_mask", {width, inputSize, stride, level}), [&]() {
+        vector<double> mask(inputSize, 0);
+        for (int i = 0; i < width; i++) {
+            for (int j = 0; j < width; j++) {
+                if (j % stride == 0 && i % stride == 0) {
+                    int index = i * width + j;
+                    mask[index] = 1.0;
+                }
             }
         }
-    }
-    return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+        return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    });
 }
 
 /**
@@ -1915,22 +2283,24 @@ Ptext FHEONANNController::first_mask(int width, int inputSize, int stride, int l
  * @return Packed plaintext mask with repeating binary pattern.
  */
 Ptext FHEONANNController::generate_binary_mask(int pattern, int inputSize, int stride, int level) {
-    vector<double> mask;
-    int copy_interval = pattern;
-    for (int i = 0; i < inputSize; i++) {
-        if (copy_interval > 0) {
-            mask.push_back(1);
-        } else {
-            mask.push_back(0);
-        }
+    return cached_mask(mask_key("generate_binary_mask", {pattern, inputSize, stride, level}), [&]() {
+        vector<double> mask;
+        int copy_interval = pattern;
+        for (int i = 0; i < inputSize; i++) {
+            if (copy_interval > 0) {
+                mask.push_back(1);
+            } else {
+                mask.push_back(0);
+            }
 
-        copy_interval--;
+            copy_interval--;
 
-        if (copy_interval <= -pattern) {
-            copy_interval = pattern;
+            if (copy_interval <= -pattern) {
+                copy_interval = pattern;
+            }
         }
-    }
-    return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+        return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    });
 }
 
 /**
@@ -1944,18 +2314,20 @@ Ptext FHEONANNController::generate_binary_mask(int pattern, int inputSize, int s
  * @return Packed plaintext mask with the specified row set to 1.
  */
 Ptext FHEONANNController::generate_row_mask(int row, int width, int inputSize, int stride, int level) {
-    vector<double> mask;
+    return cached_mask(mask_key("generate_row_mask", {row, width, inputSize, stride, level}), [&]() {
+        vector<double> mask;
 
-    for (int j = 0; j < (row * width); j++) {
-        mask.push_back(0);
-    }
-    for (int j = 0; j < width; j++) {
-        mask.push_back(1);
-    }
-    for (int j = 0; j < (inputSize - width - (row * width)); j++) {
-        mask.push_back(0);
-    }
-    return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+        for (int j = 0; j < (row * width); j++) {
+            mask.push_back(0);
+        }
+        for (int j = 0; j < width; j++) {
+            mask.push_back(1);
+        }
+        for (int j = 0; j < (inputSize - width - (row * width)); j++) {
+            mask.push_back(0);
+        }
+        return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    });
 }
 
 /**
@@ -1966,8 +2338,25 @@ Ptext FHEONANNController::generate_row_mask(int row, int width, int inputSize, i
  * @return Packed plaintext mask with all zeros.
  */
 Ptext FHEONANNController::generate_zero_mask(int size, int level) {
-    vector<double> mask(size, 0.0);
-    return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    return cached_mask(mask_key("generate_zero_mask", {size, level}), [&]() {
+        vector<double> mask(size, 0.0);
+        return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    });
+}
+
+/**
+ * @brief Encode generate_scale_mask() as a plaintext, cached like the other masks.
+ *
+ * @param scaleValue Divisor applied to every slot (the pooling window area, the ReLU range).
+ * @param vectorSize Number of elements in the mask.
+ * @param level Encryption level for CKKS plaintext.
+ * @param slots Plaintext slots (0 keeps the context default).
+ * @return Packed plaintext mask with 1/scaleValue in every slot.
+ */
+Ptext FHEONANNController::generate_scale_plaintext(int scaleValue, int vectorSize, int level, int slots) {
+    return cached_mask(mask_key("generate_scale_mask", {scaleValue, vectorSize, level, slots}), [&]() {
+        return context->MakeCKKSPackedPlaintext(generate_scale_mask(scaleValue, vectorSize), 1, level, nullptr, slots);
+    });
 }
 
 /**
@@ -1981,14 +2370,15 @@ Ptext FHEONANNController::generate_zero_mask(int size, int level) {
  * @return Packed plaintext mask with the selected block set to 1.
  */
 Ptext FHEONANNController::generate_channel_full_mask(int n, int in_elements, int out_elements, int numChannels, int level) {
-
-    const int totalSlots = in_elements * numChannels;
-    std::vector<double> mask(totalSlots, 0.0);
-    const int base = n * in_elements;
-    for (int i = 0; i < out_elements; ++i){
-        mask[base + i] = 1.0;
-    } 
-    return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    return cached_mask(mask_key("generate_channel_full_mask", {n, in_elements, out_elements, numChannels, level}), [&]() {
+        const int totalSlots = in_elements * numChannels;
+        std::vector<double> mask(totalSlots, 0.0);
+        const int base = n * in_elements;
+        for (int i = 0; i < out_elements; ++i){
+            mask[base + i] = 1.0;
+        } 
+        return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    });
 }
 
 /**
@@ -2000,10 +2390,11 @@ Ptext FHEONANNController::generate_channel_full_mask(int n, int in_elements, int
  * @return Packed plaintext mask with all zeros.
  */
 Ptext FHEONANNController::generate_zero_mask_channels(int inputSize, int numChannels, int level) {
-    
-    int totalSlots = inputSize * numChannels;
-    vector<double> mask(totalSlots, 0.0);
-    return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    return cached_mask(mask_key("generate_zero_mask_channels", {inputSize, numChannels, level}), [&]() {
+        int totalSlots = inputSize * numChannels;
+        vector<double> mask(totalSlots, 0.0);
+        return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    });
 }
 
 /**
@@ -2017,22 +2408,24 @@ Ptext FHEONANNController::generate_zero_mask_channels(int inputSize, int numChan
  * @return Packed plaintext mask with selected elements in all channels.
  */
 Ptext FHEONANNController::first_mask_with_channels(int inputWidth, int inputSize, int stride, int numChannels, int level) {
-    // int outputWidth = inputWidth / stride;
-    vector<double> mask;
-    vector<double> baseMask(inputSize, 0.0);
-    for (int i = 0; i < inputWidth; i++) {
-        for (int j = 0; j < inputWidth; j++) {
-            if (j % stride == 0 && i % stride == 0) {
-                int index =(i * inputWidth + j);
-                baseMask[index] = 1.0;
+    return cached_mask(mask_key("first_mask_with_channels", {inputWidth, inputSize, stride, numChannels, level}), [&]() {
+        // int outputWidth = inputWidth / stride;
+        vector<double> mask;
+        vector<double> baseMask(inputSize, 0.0);
+        for (int i = 0; i < inputWidth; i++) {
+            for (int j = 0; j < inputWidth; j++) {
+                if (j % stride == 0 && i % stride == 0) {
+                    int index =(i * inputWidth + j);
+                    baseMask[index] = 1.0;
+                }
             }
         }
-    }
 
-    for (int ch = 0; ch < numChannels; ch++) {
-        mask.insert(mask.end(), baseMask.begin(), baseMask.end());
-    }
-    return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+        for (int ch = 0; ch < numChannels; ch++) {
+            mask.insert(mask.end(), baseMask.begin(), baseMask.end());
+        }
+        return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    });
 }
 
 /**
@@ -2045,32 +2438,33 @@ Ptext FHEONANNController::first_mask_with_channels(int inputWidth, int inputSize
  * @param level Encryption level for CKKS plaintext.
  * @return Packed plaintext mask with repeated binary pattern across channels.
  */
-Ptext FHEONANNController::generate_binary_mask_with_channels(int pattern, int inputSize, int stride,  int numChannels, int level) {
-   
-    vector<double> baseMask;
-    int copy_interval = pattern;
-    for (int i = 0; i < inputSize; i++) {
-        if (copy_interval > 0) {
-            baseMask.push_back(1);
-        } else {
-            baseMask.push_back(0);
-        }
+Ptext FHEONANNController::generate_binary_mask_with_channels(int pattern, int inputSize, int stride, int numChannels, int level) {
+    return cached_mask(mask_key("generate_binary_mask_with_channels", {pattern, inputSize, stride, numChannels, level}), [&]() {
+        vector<double> baseMask;
+        int copy_interval = pattern;
+        for (int i = 0; i < inputSize; i++) {
+            if (copy_interval > 0) {
+                baseMask.push_back(1);
+            } else {
+                baseMask.push_back(0);
+            }
 
-        copy_interval--;
+            copy_interval--;
 
-        if (copy_interval <= -pattern) {
-            copy_interval = pattern;
+            if (copy_interval <= -pattern) {
+                copy_interval = pattern;
+            }
         }
-    }
 
-    // repeat baseMask n times
-    vector<double> mask;
-    mask.reserve(baseMask.size() * numChannels);
-    for (int i = 0; i < numChannels; i++) {
-        mask.insert(mask.end(), baseMask.begin(), baseMask.end());
-    }
+        // repeat baseMask n times
+        vector<double> mask;
+        mask.reserve(baseMask.size() * numChannels);
+        for (int i = 0; i < numChannels; i++) {
+            mask.insert(mask.end(), baseMask.begin(), baseMask.end());
+        }
 
-    return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+        return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    });
 }
 
 /**
@@ -2085,26 +2479,27 @@ Ptext FHEONANNController::generate_binary_mask_with_channels(int pattern, int in
  * @return Packed plaintext mask with the row selected in all channels.
  */
 Ptext FHEONANNController::generate_row_mask_with_channels(int row, int width, int inputSize, int stride, int numChannels, int level) {
-    
-    vector<double> baseMask;
-    for (int j = 0; j < (row * width); j++) {
-        baseMask.push_back(0);
-    }
-    for (int j = 0; j < width; j++) {
-        baseMask.push_back(1);
-    }
-    for (int j = 0; j < (inputSize - width - (row * width)); j++) {
-        baseMask.push_back(0);
-    }
+    return cached_mask(mask_key("generate_row_mask_with_channels", {row, width, inputSize, stride, numChannels, level}), [&]() {
+        vector<double> baseMask;
+        for (int j = 0; j < (row * width); j++) {
+            baseMask.push_back(0);
+        }
+        for (int j = 0; j < width; j++) {
+            baseMask.push_back(1);
+        }
+        for (int j = 0; j < (inputSize - width - (row * width)); j++) {
+            baseMask.push_back(0);
+        }
 
-    // repeat baseMask n times
-    vector<double> mask;
-    mask.reserve(baseMask.size() * numChannels);
-    for (int i = 0; i < numChannels; i++) {
-        mask.insert(mask.end(), baseMask.begin(), baseMask.end());
-    }
+        // repeat baseMask n times
+        vector<double> mask;
+        mask.reserve(baseMask.size() * numChannels);
+        for (int i = 0; i < numChannels; i++) {
+            mask.insert(mask.end(), baseMask.begin(), baseMask.end());
+        }
 
-    return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+        return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    });
 }
 
 /**
@@ -2116,14 +2511,15 @@ Ptext FHEONANNController::generate_row_mask_with_channels(int row, int width, in
  * @param level Encryption level for CKKS plaintext.
  * @return Packed plaintext mask with the selected channel set to 1.
  */
-Ptext FHEONANNController::generate_channel_mask_with_zeros(int channel, int outputSize, int numChannels, int level ){
-    
-    int totalSlots = outputSize * numChannels;
-    vector<double> mask(totalSlots, 0.0);
+Ptext FHEONANNController::generate_channel_mask_with_zeros(int channel, int outputSize, int numChannels, int level) {
+    return cached_mask(mask_key("generate_channel_mask_with_zeros", {channel, outputSize, numChannels, level}), [&]() {
+        int totalSlots = outputSize * numChannels;
+        vector<double> mask(totalSlots, 0.0);
 
-    int pos = channel * outputSize;
-    for (int i = 0; i < outputSize; i++) {
-        mask[pos + i] = 1.0;
-    }
-    return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+        int pos = channel * outputSize;
+        for (int i = 0; i < outputSize; i++) {
+            mask[pos + i] = 1.0;
+        }
+        return context->MakeCKKSPackedPlaintext(mask, 1.0, level);
+    });
 }
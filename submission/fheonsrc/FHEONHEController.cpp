@@ -42,6 +42,7 @@ SOFTWARE.
 namespace fs = std::filesystem;
 
 #include "FHEONHEController.h"
+#include "FHEONTrace.h"
 
 /**
  * @brief Compute the PQ value, which defines the application's security level.
@@ -114,6 +115,7 @@ void FHEONHEController::generate_context(int ringDim, int numSlots,
        << ", available multiplications: " << circuit_depth - 2 << endl;
 
   context = GenCryptoContext(parameters);
+  maskCache.clear();
   context->Enable(PKE);
   context->Enable(KEYSWITCH);
   context->Enable(LEVELEDSHE);
@@ -201,6 +203,7 @@ void FHEONHEController::generate_context(int ringDim, int numSlots,
 
   parameters.SetMultiplicativeDepth(circuit_depth);
   context = GenCryptoContext(parameters);
+  maskCache.clear();
 
   context->Enable(PKE);
   context->Enable(KEYSWITCH);
@@ -334,6 +337,7 @@ void FHEONHEController::load_context(bool verbose) {
          << keys_folder + "/crypto-context.bin" << endl;
     exit(1);
   }
+  maskCache.clear();
 
   PublicKey<DCRTPoly> clientPublicKey;
   if (!Serial::DeserializeFromFile(keys_folder + "/public-key.bin",
@@ -653,10 +657,39 @@ void FHEONHEController::clear_context(int bootstrapping_key_slots) {
  */
 Ctext FHEONHEController::bootstrap_function(Ctext &encryptedInput,
                                             int encode_level) {
-  Ctext boots_ciphertext = context->EvalBootstrap(encryptedInput, encode_level);
+  Ctext boots_ciphertext =
+      TracedContext(context)->EvalBootstrap(encryptedInput, encode_level);
   return boots_ciphertext;
 }
 
+/**
+ * @brief Drop the towers a ciphertext will not need before its next bootstrap.
+ *
+ * After bootstrapping the ciphertext sits at the top of the post-bootstrap
+ * chain. Every rotation and multiplication pays for all of its towers, even
+ * if the following layers only consume a few levels. This keeps exactly
+ * `depth` consumable levels (one tower per level plus the base tower) and
+ * drops the rest with Compress. LevelReduce is not usable here: under
+ * FLEXIBLEAUTO it leaves the towers in place.
+ *
+ * @param encryptedInput  Ciphertext to reduce.
+ * @param depth           Levels the following layers still consume.
+ *
+ * @return Ciphertext with depth + 1 towers, or the input if it has no more.
+ */
+Ctext FHEONHEController::reduce_to_depth(Ctext &encryptedInput, int depth) {
+  int available = encryptedInput->GetElements()[0].GetNumOfElements() - 1;
+  if (available <= depth)
+    return encryptedInput;
+  Ctext reduced = TracedContext(context)->Compress(encryptedInput, depth + 1);
+  int towers = reduced->GetElements()[0].GetNumOfElements();
+  if (towers != depth + 1) {
+    throw runtime_error("reduce_to_depth: kept " + to_string(towers) +
+                        " towers, expected " + to_string(depth + 1));
+  }
+  return reduced;
+}
+
 /**
  * @brief Encrypt a vector of input data into a packed ciphertext.
  *
@@ -727,15 +760,10 @@ Ptext FHEONHEController::encode_input(vector<double> &inputData, int num_slots,
  */
 Ptext FHEONHEController::encode_shortcut_kernel(vector<double> &inputData,
                                                 int cols_square) {
-  int dim1 = inputData.size();
-  vector<double> main_kernel;
-  for (int t = 0; t < dim1; t++) {
-    double cell_value = inputData[t];
-    vector<double> repeated(cols_square, cell_value);
-    main_kernel.insert(main_kernel.end(), repeated.begin(), repeated.end());
-  }
-  Ptext plaintext = context->MakeCKKSPackedPlaintext(main_kernel, 1, 1);
-  return plaintext;
+  EncodeJob job;
+  job.values = inputData;
+  job.repeat = cols_square;
+  return encode_batch({job})[0];
 }
 
 /**
@@ -753,17 +781,93 @@ Ptext FHEONHEController::encode_shortcut_kernel(vector<double> &inputData,
  */
 Ptext FHEONHEController::encode_bais_input(vector<double> &inputData,
                                            int cols_square, int encode_level) {
-  int dim1 = inputData.size();
-  vector<double> main_kernel;
-  for (int t = 0; t < dim1; t++) {
-    double cell_value = inputData[t];
-    vector<double> repeated(cols_square, cell_value);
-    main_kernel.insert(main_kernel.end(), repeated.begin(), repeated.end());
+  EncodeJob job;
+  job.values = inputData;
+  job.repeat = cols_square;
+  job.level = encode_level;
+  return encode_batch({job})[0];
+}
+
+/**
+ * @brief Encode a batch of packed plaintexts in parallel.
+ *
+ * Each job is expanded straight into its final slot vector (every value written
+ * job.repeat times), so no per-tap or per-channel temporaries are built. The jobs
+ * are then encoded concurrently across OpenMP threads. The first job is encoded
+ * before the parallel region so the encoder's lazily built tables already exist
+ * when the worker threads start.
+ *
+ * @param jobs  Plaintexts to encode (values, repeat count, level, slots).
+ *
+ * @return Plaintexts in the same order as the jobs.
+ */
+vector<Ptext> FHEONHEController::encode_batch(const vector<EncodeJob> &jobs) {
+  int num_jobs = jobs.size();
+  vector<Ptext> encoded(num_jobs);
+  if (num_jobs == 0)
+    return encoded;
+
+  auto encode_job = [this](const EncodeJob &job) {
+    if (job.repeat == 1) {
+      return context->MakeCKKSPackedPlaintext(job.values, 1, job.level,
+                                              nullptr, job.slots);
+    }
+    vector<double> packed;
+    packed.reserve(job.values.size() * job.repeat);
+    for (double value : job.values) {
+      packed.insert(packed.end(), job.repeat, value);
+    }
+    return context->MakeCKKSPackedPlaintext(packed, 1, job.level, nullptr,
+                                            job.slots);
+  };
+
+  encoded[0] = encode_job(jobs[0]);
+#pragma omp parallel for schedule(dynamic)
+  for (int i = 1; i < num_jobs; i++) {
+    encoded[i] = encode_job(jobs[i]);
   }
+  return encoded;
+}
 
-  Ptext plaintext =
-      context->MakeCKKSPackedPlaintext(main_kernel, 1, encode_level);
-  return plaintext;
+/**
+ * @brief Build the encoding jobs for a convolution kernel.
+ *
+ * Produces one job per kernel tap. The job holds the tap's value for every
+ * input channel, each repeated cols_square times, matching the layout used by
+ * he_convolution.
+ *
+ * @param kernelData    Kernel of one output channel, [in_channel][row][col].
+ * @param cols_square   Size of the column square for the encoding.
+ * @param encode_level  Encoding level to use for the plaintexts.
+ *
+ * @return k^2 encoding jobs, one per kernel tap.
+ */
+vector<EncodeJob> FHEONHEController::kernel_encode_jobs(
+    vector<vector<vector<double>>> &kernelData, int cols_square,
+    int encode_level) {
+  size_t dim1 = kernelData.size();
+  if (dim1 == 0)
+    return {};
+  size_t dim2 = kernelData[0].size();
+  if (dim2 == 0)
+    return {};
+  size_t dim3 = kernelData[0][0].size();
+  if (dim3 == 0)
+    return {};
+
+  vector<EncodeJob> jobs(dim2 * dim3);
+  for (size_t i = 0; i < dim2; i++) {
+    for (size_t j = 0; j < dim3; j++) {
+      EncodeJob &job = jobs[i * dim3 + j];
+      job.values.reserve(dim1);
+      for (size_t k = 0; k < dim1; k++) {
+        job.values.push_back(kernelData[k][i][j]);
+      }
+      job.repeat = cols_square;
+      job.level = encode_level;
+    }
+  }
+  return jobs;
 }
 
 /**
@@ -842,6 +946,220 @@ FHEONHEController::encrypt_kernel(vector<vector<vector<double>>> &kernelData,
   return encrypt_kernel;
 }
 
+/**
+ * @brief Build the encoding jobs for a convolution over a replicated input.
+ *
+ * The input ciphertext holds `replicas` cyclic copies of the activation, one
+ * every `region` slots. Pass p multiplies copy r by the taps of output channel
+ * p * replicas + r, so each plaintext carries up to `replicas` output channels.
+ * Copies without an output channel in the last pass are left at zero.
+ *
+ * @param kernelData    Kernel, [out_channel][in_channel][row][col].
+ * @param cols_square   Size of the column square of one input channel.
+ * @param region        Slot distance between two copies of the input.
+ * @param replicas      Number of copies of the input.
+ * @param encode_level  Encoding level to use for the plaintexts.
+ *
+ * @return passes * k^2 encoding jobs, pass-major.
+ */
+vector<EncodeJob> FHEONHEController::replicated_kernel_encode_jobs(
+    vector<vector<vector<vector<double>>>> &kernelData, int cols_square,
+    int region, int replicas, int encode_level) {
+  int out_channels = kernelData.size();
+  if (out_channels == 0 || kernelData[0].empty() || kernelData[0][0].empty())
+    return {};
+  int in_channels = kernelData[0].size();
+  int kernel_rows = kernelData[0][0].size();
+  int kernel_cols = kernelData[0][0][0].size();
+  if (in_channels * cols_square > region) {
+    cerr << "Replicated convolution: " << in_channels << " channels of "
+         << cols_square << " slots do not fit in a region of " << region
+         << endl;
+    exit(1);
+  }
+
+  int passes = (out_channels + replicas - 1) / replicas;
+  int taps = kernel_rows * kernel_cols;
+  vector<EncodeJob> jobs(passes * taps);
+  for (int p = 0; p < passes; p++) {
+    int copies = min(replicas, out_channels - p * replicas);
+    for (int i = 0; i < kernel_rows; i++) {
+      for (int j = 0; j < kernel_cols; j++) {
+        EncodeJob &job = jobs[p * taps + i * kernel_cols + j];
+        job.values.assign((copies - 1) * region + in_channels * cols_square,
+                          0.0);
+        for (int r = 0; r < copies; r++) {
+          auto &kernel = kernelData[p * replicas + r];
+          for (int c = 0; c < in_channels; c++) {
+            fill_n(job.values.begin() + r * region + c * cols_square,
+                   cols_square, kernel[c][i][j]);
+          }
+        }
+        job.level = encode_level;
+      }
+    }
+  }
+  return jobs;
+}
+
+/**
+ * @brief Build the encoding jobs for he_convolution_polyphase.
+ *
+ * Same pass structure as replicated_kernel_encode_jobs, but each tap only
+ * covers the valid output positions of one phase block: rows and columns
+ * below (inputWidth - k + 1) / 2, at a row stride of inputWidth / 2. The four
+ * output phases share these plaintexts.
+ *
+ * @param kernelData    Kernel, [out_channel][1][row][col].
+ * @param inputWidth    Width of the (square, single-channel) input image.
+ * @param region        Slot distance between two copies of the input.
+ * @param replicas      Number of copies of the input.
+ * @param encode_level  Encoding level to use for the plaintexts.
+ *
+ * @return passes * k^2 encoding jobs, pass-major.
+ */
+vector<EncodeJob> FHEONHEController::polyphase_kernel_encode_jobs(
+    vector<vector<vector<vector<double>>>> &kernelData, int inputWidth,
+    int region, int replicas, int encode_level) {
+  int out_channels = kernelData.size();
+  if (out_channels == 0 || kernelData[0].empty() || kernelData[0][0].empty())
+    return {};
+  if (kernelData[0].size() != 1) {
+    cerr << "Polyphase convolution: only one input channel is supported, got "
+         << kernelData[0].size() << endl;
+    exit(1);
+  }
+  int kernel_rows = kernelData[0][0].size();
+  int kernel_cols = kernelData[0][0][0].size();
+  int row_stride = inputWidth / 2;
+  int phase_width = (inputWidth - kernel_cols + 1) / 2;
+
+  int passes = (out_channels + replicas - 1) / replicas;
+  int taps = kernel_rows * kernel_cols;
+  vector<EncodeJob> jobs(passes * taps);
+  for (int p = 0; p < passes; p++) {
+    int copies = min(replicas, out_channels - p * replicas);
+    for (int i = 0; i < kernel_rows; i++) {
+      for (int j = 0; j < kernel_cols; j++) {
+        EncodeJob &job = jobs[p * taps + i * kernel_cols + j];
+        job.values.assign((copies - 1) * region + phase_width * row_stride,
+                          0.0);
+        for (int r = 0; r < copies; r++) {
+          double tap = kernelData[p * replicas + r][0][i][j];
+          for (int row = 0; row < phase_width; row++) {
+            fill_n(job.values.begin() + r * region + row * row_stride,
+                   phase_width, tap);
+          }
+        }
+        job.level = encode_level;
+      }
+    }
+  }
+  return jobs;
+}
+
+/**
+ * @brief Encode convolution kernels for he_convolution_replicated.
+ *
+ * @param kernelData    Kernel, [out_channel][in_channel][row][col].
+ * @param cols_square   Size of the column square of one input channel.
+ * @param region        Slot distance between two copies of the input.
+ * @param replicas      Number of copies of the input.
+ * @param encode_level  Encoding level to use for the plaintexts.
+ *
+ * @return Plaintexts indexed [pass][tap].
+ */
+vector<vector<Ptext>> FHEONHEController::encode_kernel_replicated(
+    vector<vector<vector<vector<double>>>> &kernelData, int cols_square,
+    int region, int replicas, int encode_level) {
+  auto encoded = encode_batch(replicated_kernel_encode_jobs(
+      kernelData, cols_square, region, replicas, encode_level));
+  if (encoded.empty())
+    return {};
+  size_t taps = kernelData[0][0].size() * kernelData[0][0][0].size();
+  vector<vector<Ptext>> kernel;
+  for (size_t t = 0; t < encoded.size(); t += taps) {
+    kernel.emplace_back(encoded.begin() + t, encoded.begin() + t + taps);
+  }
+  return kernel;
+}
+
+/**
+ * @brief Encrypt a batch of packed vectors in parallel.
+ *
+ * The jobs are encoded with encode_batch and each plaintext is then encrypted
+ * at its job's level. Used for model-private deployments, where the weights
+ * are encrypted under the inference key instead of being encoded in the clear.
+ *
+ * @param jobs       Vectors to encrypt (values, repeat count, level, slots).
+ * @param publicKey  Key to encrypt under.
+ *
+ * @return Ciphertexts in the same order as the jobs.
+ */
+vector<Ctext> FHEONHEController::encrypt_batch(const vector<EncodeJob> &jobs,
+                                               PublicKey<DCRTPoly> &publicKey) {
+  vector<Ptext> encoded = encode_batch(jobs);
+  int num_jobs = encoded.size();
+  vector<Ctext> encrypted(num_jobs);
+#pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < num_jobs; i++) {
+    encrypted[i] = context->Encrypt(publicKey, encoded[i]);
+  }
+  return encrypted;
+}
+
+/**
+ * @brief Encrypt a convolution kernel, one ciphertext per tap.
+ *
+ * Same layout as encode_kernel: the ciphertext of a tap holds the tap's value
+ * for every input channel, each repeated cols_square times. This replaces the
+ * one-ciphertext-per-value layout of encrypt_kernel, so he_convolution needs
+ * k^2 ciphertext products per output channel instead of k^2 * in_channels.
+ *
+ * @param kernelData    Kernel of one output channel, [in_channel][row][col].
+ * @param cols_square   Size of the column square for the encoding.
+ * @param publicKey     Key to encrypt under.
+ * @param encode_level  Level of the ciphertexts.
+ *
+ * @return k^2 ciphertexts, one per kernel tap.
+ */
+vector<Ctext> FHEONHEController::encrypt_kernel_packed(
+    vector<vector<vector<double>>> &kernelData, int cols_square,
+    PublicKey<DCRTPoly> &publicKey, int encode_level) {
+  return encrypt_batch(kernel_encode_jobs(kernelData, cols_square, encode_level),
+                       publicKey);
+}
+
+/**
+ * @brief Encrypt convolution kernels for he_convolution_replicated.
+ *
+ * @param kernelData    Kernel, [out_channel][in_channel][row][col].
+ * @param cols_square   Size of the column square of one input channel.
+ * @param region        Slot distance between two copies of the input.
+ * @param replicas      Number of copies of the input.
+ * @param publicKey     Key to encrypt under.
+ * @param encode_level  Level of the ciphertexts.
+ *
+ * @return Ciphertexts indexed [pass][tap].
+ */
+vector<vector<Ctext>> FHEONHEController::encrypt_kernel_replicated(
+    vector<vector<vector<vector<double>>>> &kernelData, int cols_square,
+    int region, int replicas, PublicKey<DCRTPoly> &publicKey,
+    int encode_level) {
+  auto encrypted = encrypt_batch(
+      replicated_kernel_encode_jobs(kernelData, cols_square, region, replicas,
+                                    encode_level),
+      publicKey);
+  if (encrypted.empty())
+    return {};
+  size_t taps = kernelData[0][0].size() * kernelData[0][0][0].size();
+  vector<vector<Ctext>> kernel;
+  for (size_t t = 0; t < encrypted.size(); t += taps) {
+    kernel.emplace_back(encrypted.begin() + t, encrypted.begin() + t + taps);
+  }
+  return kernel;
+}
+
 /**
  * @brief Encode kernel data for fully connected layers.
  *
@@ -856,18 +1174,12 @@ FHEONHEController::encrypt_kernel(vector<vector<vector<double>>> &kernelData,
  */
 vector<Ptext> FHEONHEController::encode_kernel(vector<double> &kernelData,
                                                int cols_square) {
-  size_t dim1 = kernelData.size();
-  if (dim1 == 0)
-    return {};
-
-  vector<Ptext> encrypt_kernel;
-  for (size_t j = 0; j < dim1; j++) {
-    double cell_value = kernelData[j];
-    vector<double> repeated(cols_square, cell_value);
-    Ptext encrypted_val = encode_input(repeated);
-    encrypt_kernel.push_back(encrypted_val);
+  vector<EncodeJob> jobs(kernelData.size());
+  for (size_t j = 0; j < kernelData.size(); j++) {
+    jobs[j].values = {kernelData[j]};
+    jobs[j].repeat = cols_square;
   }
-  return encrypt_kernel;
+  return encode_batch(jobs);
 }
 
 /**
@@ -888,43 +1200,7 @@ vector<Ptext> FHEONHEController::encode_kernel(vector<double> &kernelData,
 vector<Ptext>
 FHEONHEController::encode_kernel(vector<vector<vector<double>>> &kernelData,
                                  int cols_square) {
-  size_t dim1 = kernelData.size();
-  if (dim1 == 0)
-    return {};
-  size_t dim2 = kernelData[0].size();
-  if (dim2 == 0)
-    return {};
-  size_t dim3 = kernelData[0][0].size();
-  if (dim3 == 0)
-    return {};
-  // cout <<"input kernel shape: " << dim1 << "*" << dim2 << "*" << dim3 <<endl;
-
-  int kernelWidth_sq = pow(dim2, 2);
-  vector<vector<double>> main_kernel(kernelWidth_sq, vector<double>());
-  for (size_t k = 0; k < dim1; k++) {
-    vector<vector<double>> filters;
-    for (size_t i = 0; i < dim2; i++) {
-      for (size_t j = 0; j < dim3; j++) {
-        double cell_value = kernelData[k][i][j];
-        // cout << "Kernel value at position (" << k << ", " << i << ", " << j
-        // << "): " << cell_value << endl; if(cell_value == 0)
-        //     cell_value = 1e-40;
-        vector<double> repeated(cols_square, cell_value);
-        filters.push_back(repeated);
-      }
-    }
-    for (int t = 0; t < kernelWidth_sq; t++) {
-      main_kernel[t].insert(main_kernel[t].end(), filters[t].begin(),
-                            filters[t].end());
-    }
-  }
-  vector<Ptext> encoded_kernel;
-  for (int s = 0; s < kernelWidth_sq; s++) {
-    // cout << "Kernel size: " << main_kernel[s].size() << endl;
-    Ptext encoded_val = encode_input(main_kernel[s]);
-    encoded_kernel.push_back(encoded_val);
-  }
-  return encoded_kernel;
+  return encode_batch(kernel_encode_jobs(kernelData, cols_square));
 }
 
 /**
@@ -0,0 +1,245 @@
+/***********************************************************************************************************************
+*
+* @author: Nges Brian, Njungle
+*
+* MIT License
+* Copyright (c) 2025 Secure, Trusted and Assured Microelectronics, Arizona State University
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+********************************************************************************************************************/
+
+/**
+ * @brief Tower-major multiply-accumulate for ciphertext x plaintext sums.
+ *
+ * Both ciphertext elements of every tower are independent, so they are split
+ * across OpenMP threads. Within a tower, a block of coefficients is
+ * accumulated over all k operands in unsigned __int128 registers. Products of
+ * moduli below 2^60 leave room for 256 of them before a lazy reduction, and
+ * each output coefficient pays one final 128-by-64-bit reduction.
+ */
+
+#include "FHEONInnerProduct.h"
+#include "FHEONTrace.h"
+
+#if NATIVEINT == 64 && defined(__SIZEOF_INT128__)
+#define FHEON_FUSED_MAC 1
+#else
+#define FHEON_FUSED_MAC 0
+#endif
+
+namespace {
+
+// Coefficients accumulated together: 256 x 16 bytes stays in L1.
+constexpr size_t kBlock = 256;
+
+/**
+ * @brief Whether EvalMult would multiply these operands as they are.
+ *
+ * @param reference  Ciphertext the others must match (towers, level, scale).
+ * @param ciphertext Ciphertext operand.
+ * @param plaintext  Plaintext operand.
+ */
+bool fusable(const Ctext &reference, const Ctext &ciphertext,
+             const Ptext &plaintext) {
+  const auto &elements = ciphertext->GetElements();
+  if (elements.size() != 2 || ciphertext->GetNoiseScaleDeg() != 1 ||
+      elements[0].GetFormat() != Format::EVALUATION ||
+      elements[0].GetNumOfElements() !=
+          reference->GetElements()[0].GetNumOfElements() ||
+      ciphertext->GetLevel() != reference->GetLevel() ||
+      ciphertext->GetScalingFactor() != reference->GetScalingFactor()) {
+    return false;
+  }
+  const DCRTPoly &pt = plaintext->GetElement<DCRTPoly>();
+  return pt.GetFormat() == Format::EVALUATION &&
+         pt.GetNumOfElements() >= elements[0].GetNumOfElements();
+}
+
+#if FHEON_FUSED_MAC
+/**
+ * @brief One tower of one ciphertext element: out = sum_k a_k * b_k mod q.
+ *
+ * @param a       Tower t of element e of each ciphertext.
+ * @param b       Tower t of each plaintext.
+ * @param addend  Optional tower of a running sum to add (or nullptr).
+ * @param out     Destination tower; may alias addend.
+ */
+void mac_tower(const vector<const NativePoly *> &a,
+               const vector<const NativePoly *> &b, const NativePoly *addend,
+               NativePoly &out) {
+  uint64_t q = out.GetModulus().ConvertToInt<uint64_t>();
+  // Products that fit on top of a reduced accumulator before the next reduction.
+  unsigned __int128 square = (unsigned __int128)(q - 1) * (q - 1);
+  unsigned __int128 room = square == 0 ? a.size() : ~(unsigned __int128)0 / square - 1;
+  size_t lazy = (size_t)min<unsigned __int128>(max<unsigned __int128>(room, 1), a.size() + 1);
+  size_t n = out.GetLength();
+  unsigned __int128 acc[kBlock];
+  for (size_t start = 0; start < n; start += kBlock) {
+    size_t len = min(kBlock, n - start);
+    for (size_t i = 0; i < len; i++) {
+      acc[i] = addend ? (*addend)[start + i].ConvertToInt<uint64_t>() : 0;
+    }
+    for (size_t k = 0; k < a.size(); k++) {
+      const NativePoly &ak = *a[k];
+      const NativePoly &bk = *b[k];
+      for (size_t i = 0; i < len; i++) {
+        acc[i] += (unsigned __int128)ak[start + i].ConvertToInt<uint64_t>() *
+                  bk[start + i].ConvertToInt<uint64_t>();
+      }
+      if ((k + 1) % lazy == 0) {
+        for (size_t i = 0; i < len; i++) {
+          acc[i] %= q;
+        }
+      }
+    }
+    for (size_t i = 0; i < len; i++) {
+      out[start + i] = NativeInteger((uint64_t)(acc[i] % q));
+    }
+  }
+}
+
+/**
+ * @brief Set the scale bookkeeping of a ciphertext x plaintext product, as
+ * EvalMult does.
+ */
+void set_product_scale(Ctext &result, const Ctext &ciphertext,
+                       const Ptext &plaintext) {
+  result->SetNoiseScaleDeg(ciphertext->GetNoiseScaleDeg() +
+                           plaintext->GetNoiseScaleDeg());
+  result->SetScalingFactor(ciphertext->GetScalingFactor() *
+                           plaintext->GetScalingFactor());
+}
+
+/**
+ * @brief Fused sum of products into result (which already has its shape). When
+ * accumulate is set, result's current value is added in.
+ */
+void fused_sum(Ctext &result, const vector<Ctext> &ciphertexts,
+               const vector<Ptext> &plaintexts, bool accumulate) {
+  auto &outElements = result->GetElements();
+  int towers = outElements[0].GetNumOfElements();
+  int count = 2 * towers;
+#pragma omp parallel for schedule(static)
+  for (int job = 0; job < count; job++) {
+    int e = job / towers;
+    int t = job % towers;
+    vector<const NativePoly *> a(ciphertexts.size());
+    vector<const NativePoly *> b(plaintexts.size());
+    for (size_t k = 0; k < ciphertexts.size(); k++) {
+      a[k] = &ciphertexts[k]->GetElements()[e].GetElementAtIndex(t);
+      b[k] = &plaintexts[k]->GetElement<DCRTPoly>().GetElementAtIndex(t);
+    }
+    NativePoly &out = outElements[e].GetAllElements()[t];
+    mac_tower(a, b, accumulate ? &out : nullptr, out);
+  }
+}
+#endif
+
+} // namespace
+
+/**
+ * @brief Inner product of ciphertexts with plaintexts.
+ *
+ * @param context      Crypto context of the operands.
+ * @param ciphertexts  k ciphertexts.
+ * @param plaintexts   k plaintexts, same order.
+ *
+ * @return sum_k ciphertexts[k] * plaintexts[k].
+ */
+static Ctext inner_product(CryptoContext<DCRTPoly> &context,
+                           const vector<Ctext> &ciphertexts,
+                           const vector<Ptext> &plaintexts) {
+  bool fuse = FHEON_FUSED_MAC && !ciphertexts.empty() &&
+              ciphertexts.size() == plaintexts.size();
+  for (size_t k = 0; fuse && k < ciphertexts.size(); k++) {
+    fuse = fusable(ciphertexts[0], ciphertexts[k], plaintexts[k]) &&
+           plaintexts[k]->GetScalingFactor() == plaintexts[0]->GetScalingFactor() &&
+           plaintexts[k]->GetNoiseScaleDeg() == plaintexts[0]->GetNoiseScaleDeg();
+  }
+  if (!fuse) {
+    vector<Ctext> products;
+    for (size_t k = 0; k < plaintexts.size(); k++) {
+      products.push_back(context->EvalMult(ciphertexts[k], plaintexts[k]));
+    }
+    return context->EvalAddMany(products);
+  }
+#if FHEON_FUSED_MAC
+  Ctext result = ciphertexts[0]->Clone();
+  set_product_scale(result, ciphertexts[0], plaintexts[0]);
+  fused_sum(result, ciphertexts, plaintexts, false);
+  return result;
+#else
+  return nullptr;
+#endif
+}
+
+/**
+ * @brief accumulator += ciphertext * plaintext.
+ *
+ * @param context      Crypto context of the operands.
+ * @param accumulator  Running sum; an empty Ctext starts it.
+ * @param ciphertext   Ciphertext operand.
+ * @param plaintext    Plaintext operand.
+ */
+static void multiply_accumulate(CryptoContext<DCRTPoly> &context,
+                                Ctext &accumulator, const Ctext &ciphertext,
+                                const Ptext &plaintext) {
+  if (!accumulator) {
+    accumulator = context->EvalMult(ciphertext, plaintext);
+    return;
+  }
+#if FHEON_FUSED_MAC
+  if (fusable(ciphertext, ciphertext, plaintext) &&
+      accumulator->GetElements().size() == 2 &&
+      accumulator->GetLevel() == ciphertext->GetLevel() &&
+      accumulator->GetNoiseScaleDeg() ==
+          ciphertext->GetNoiseScaleDeg() + plaintext->GetNoiseScaleDeg() &&
+      accumulator->GetScalingFactor() ==
+          ciphertext->GetScalingFactor() * plaintext->GetScalingFactor()) {
+    fused_sum(accumulator, {ciphertext}, {plaintext}, true);
+    return;
+  }
+#endif
+  context->EvalAddInPlace(accumulator, context->EvalMult(ciphertext, plaintext));
+}
+
+/**
+ * @brief Traced inner_product: a trace records the fused kernel as one
+ * operation.
+ */
+Ctext fused_inner_product(CryptoContext<DCRTPoly> &context,
+                          const vector<Ctext> &ciphertexts,
+                          const vector<Ptext> &plaintexts) {
+  return trace_op(
+      "FusedInnerProduct",
+      [&]() { return inner_product(context, ciphertexts, plaintexts); },
+      ciphertexts, plaintexts);
+}
+
+/**
+ * @brief Traced multiply_accumulate. An empty accumulator is recorded as a
+ * null argument.
+ */
+void fused_multiply_accumulate(CryptoContext<DCRTPoly> &context,
+                               Ctext &accumulator, const Ctext &ciphertext,
+                               const Ptext &plaintext) {
+  trace_op(
+      "FusedMultiplyAccumulate",
+      [&]() { multiply_accumulate(context, accumulator, ciphertext, plaintext); },
+      accumulator, ciphertext, plaintext);
+}
@@ -0,0 +1,132 @@
+/***********************************************************************************************************************
+*
+* @author: Nges Brian, Njungle
+*
+* MIT License
+* Copyright (c) 2025 Secure, Trusted and Assured Microelectronics, Arizona State University
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+********************************************************************************************************************/
+
+/**
+ * @brief Mask plaintexts (downsampling, scale, channel masks) keyed by their
+ * parameters and level.
+ *
+ * The cache belongs to the FHEONHEController that owns the context, so masks
+ * never outlive it or leak into another context. Least recently used masks
+ * are dropped once the encoded bytes exceed the budget; a dropped mask is
+ * simply encoded again on its next use.
+ */
+
+#include "FHEONMaskCache.h"
+
+/**
+ * @brief Approximate memory held by an encoded plaintext.
+ *
+ * @param plaintext  Encoded plaintext.
+ *
+ * @return RNS towers x ring dimension x 8 bytes.
+ */
+size_t plaintext_bytes(const Ptext &plaintext) {
+  const DCRTPoly &element = plaintext->GetElement<DCRTPoly>();
+  return element.GetNumOfElements() * element.GetRingDimension() *
+         sizeof(uint64_t);
+}
+
+/**
+ * @brief Drop every cached mask.
+ */
+void FHEONMaskCache::clear() {
+  lock_guard<mutex> lock(entriesMutex);
+  entries.clear();
+  lru.clear();
+  residentBytes = 0;
+}
+
+/**
+ * @brief Change the budget, evicting right away if it shrank.
+ *
+ * @param byteBudget  Encoded bytes the cache may hold.
+ */
+void FHEONMaskCache::set_budget(size_t byteBudget) {
+  lock_guard<mutex> lock(entriesMutex);
+  budget = byteBudget;
+  evict_to_budget();
+}
+
+/**
+ * @brief Encoded bytes currently held by the cache.
+ */
+size_t FHEONMaskCache::resident_bytes() {
+  lock_guard<mutex> lock(entriesMutex);
+  return residentBytes;
+}
+
+/**
+ * @brief Look a mask up and mark it recently used.
+ *
+ * @return The cached plaintext, or nullptr on a miss.
+ */
+Ptext FHEONMaskCache::find(const string &key) {
+  lock_guard<mutex> lock(entriesMutex);
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    return nullptr;
+  }
+  lru.splice(lru.begin(), lru, it->second.lru);
+  return it->second.mask;
+}
+
+/**
+ * @brief Store a freshly encoded mask unless another caller stored one first.
+ *
+ * @return The plaintext now cached under key (or mask itself if it does not
+ * fit the budget at all).
+ */
+Ptext FHEONMaskCache::insert(const string &key, Ptext mask) {
+  size_t bytes = plaintext_bytes(mask);
+  lock_guard<mutex> lock(entriesMutex);
+  auto it = entries.find(key);
+  if (it != entries.end()) {
+    return it->second.mask;
+  }
+  if (bytes > budget) {
+    return mask;
+  }
+  lru.push_front(key);
+  Entry &entry = entries[key];
+  entry.mask = mask;
+  entry.bytes = bytes;
+  entry.lru = lru.begin();
+  residentBytes += bytes;
+  evict_to_budget();
+  return mask;
+}
+
+/**
+ * @brief Drop least recently used masks until the budget is met. Callers
+ * keep their own references, so evicting a mask in use is safe.
+ */
+void FHEONMaskCache::evict_to_budget() {
+  while (residentBytes > budget && !lru.empty()) {
+    auto it = entries.find(lru.back());
+    residentBytes -= it->second.bytes;
+    entries.erase(it);
+    lru.pop_back();
+  }
+}
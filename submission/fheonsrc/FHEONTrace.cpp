@@ -0,0 +1,161 @@
+/***********************************************************************************************************************
+*
+* @author: Nges Brian, Njungle
+*
+* MIT License
+* Copyright (c) 2025 Secure, Trusted and Assured Microelectronics, Arizona State University
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+********************************************************************************************************************/
+
+/**
+ * @brief Recording side of operation traces (see FHEONTrace.h).
+ *
+ * Trace file format: a "# fheon-trace 1" header, then one line per
+ * operation with its name, wall seconds, result descriptor and argument
+ * descriptors, separated by spaces.
+ */
+
+#include "FHEONTrace.h"
+
+#include <iomanip>
+
+static thread_local FHEONTraceRecorder *activeRecorder = nullptr;
+
+static string pointer_id(const void *pointer) {
+  ostringstream id;
+  id << hex << reinterpret_cast<uintptr_t>(pointer);
+  return id.str();
+}
+
+FHEONTraceRecorder::Scope::Scope(FHEONTraceRecorder &recorder)
+    : previous(activeRecorder) {
+  activeRecorder = &recorder;
+}
+
+FHEONTraceRecorder::Scope::~Scope() { activeRecorder = previous; }
+
+FHEONTraceRecorder *FHEONTraceRecorder::active() { return activeRecorder; }
+
+/**
+ * @brief Write the trace.
+ *
+ * @param path  Output file; replaced if it exists.
+ */
+void FHEONTraceRecorder::save(const string &path) const {
+  ofstream out(path);
+  if (!out.is_open()) {
+    throw runtime_error("Failed to write trace " + path);
+  }
+  out << "# fheon-trace 1" << endl;
+  out << setprecision(9);
+  for (const auto &op : ops) {
+    out << op.name << ' ' << op.seconds << ' ' << op.result;
+    for (const auto &arg : op.args) {
+      out << ' ' << arg;
+    }
+    out << '\n';
+  }
+}
+
+/**
+ * @brief Read a trace written by save().
+ *
+ * @param path  Trace file.
+ *
+ * @return Operations in issue order. Vector descriptors stay split into
+ *         their count token and element tokens.
+ */
+vector<FHEONTraceOp> FHEONTraceRecorder::load(const string &path) {
+  ifstream in(path);
+  if (!in.is_open()) {
+    throw runtime_error("Failed to open trace " + path);
+  }
+  vector<FHEONTraceOp> ops;
+  string line;
+  while (getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    istringstream fields(line);
+    FHEONTraceOp op;
+    if (!(fields >> op.name >> op.seconds >> op.result)) {
+      throw runtime_error("Malformed trace line: " + line);
+    }
+    for (string arg; fields >> arg;) {
+      op.args.push_back(arg);
+    }
+    ops.push_back(std::move(op));
+  }
+  return ops;
+}
+
+string trace_describe(const ConstCiphertext<DCRTPoly> &ciphertext) {
+  if (!ciphertext) {
+    return "n";
+  }
+  const auto &elements = ciphertext->GetElements();
+  size_t towers = elements.empty() ? 0 : elements[0].GetNumOfElements();
+  return "c:" + pointer_id(ciphertext.get()) + ":" + to_string(towers) + ":" +
+         to_string(ciphertext->GetNoiseScaleDeg()) + ":" +
+         to_string(elements.size()) + ":" + to_string(ciphertext->GetSlots());
+}
+
+string trace_describe(const Ctext &ciphertext) {
+  return trace_describe(ConstCiphertext<DCRTPoly>(ciphertext));
+}
+
+string trace_describe(const Ptext &plaintext) {
+  if (!plaintext) {
+    return "n";
+  }
+  size_t towers = plaintext->GetElement<DCRTPoly>().GetNumOfElements();
+  return "p:" + to_string(towers) + ":" +
+         to_string(plaintext->GetNoiseScaleDeg()) + ":" +
+         to_string(plaintext->GetSlots());
+}
+
+string trace_describe(const shared_ptr<vector<DCRTPoly>> &digits) {
+  return "k:" + pointer_id(digits.get());
+}
+
+string trace_describe(const vector<Ctext> &ciphertexts) {
+  string text = "V:" + to_string(ciphertexts.size());
+  for (const auto &ciphertext : ciphertexts) {
+    text += " " + trace_describe(ciphertext);
+  }
+  return text;
+}
+
+string trace_describe(const vector<Ptext> &plaintexts) {
+  string text = "W:" + to_string(plaintexts.size());
+  for (const auto &plaintext : plaintexts) {
+    text += " " + trace_describe(plaintext);
+  }
+  return text;
+}
+
+string trace_describe(const vector<double> &values) {
+  return "x:" + to_string(values.size());
+}
+
+string trace_describe_number(double value) {
+  ostringstream text;
+  text << "d:" << setprecision(17) << value;
+  return text.str();
+}
@@ -0,0 +1,246 @@
+/***********************************************************************************************************************
+*
+* @author: Nges Brian, Njungle
+*
+* MIT License
+* Copyright (c) 2025 Secure, Trusted and Assured Microelectronics, Arizona State University
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+********************************************************************************************************************/
+
+/**
+ * @brief Layer-by-layer source of plaintext weights for the controllers.
+ *
+ * In PreEncoded mode every layer is encoded once by prepare() and stays
+ * resident. In JustInTime mode only the raw values are kept; a layer is
+ * encoded the first time it is requested, a background thread encodes the
+ * following layer while the current one is evaluated, and least recently used
+ * layers are dropped whenever the encoded bytes exceed the budget. The
+ * controller's cached masks count against the same budget.
+ */
+
+#include "FHEONWeightProvider.h"
+
+/**
+ * @brief Create an empty provider.
+ *
+ * @param controller  Controller whose encode_batch produces the plaintexts.
+ * @param mode        PreEncoded or JustInTime.
+ * @param byteBudget  Resident encoded bytes allowed in JustInTime mode (0 = no cap).
+ */
+FHEONWeightProvider::FHEONWeightProvider(FHEONHEController &controller,
+                                         Mode mode, size_t byteBudget)
+    : controller(controller), providerMode(mode), budget(byteBudget) {}
+
+FHEONWeightProvider::~FHEONWeightProvider() {
+  {
+    lock_guard<mutex> lock(entriesMutex);
+    stopping = true;
+  }
+  prefetchReady.notify_all();
+  if (prefetchThread.joinable()) {
+    prefetchThread.join();
+  }
+}
+
+/**
+ * @brief Register the encoding jobs of one layer. Must precede prepare().
+ *
+ * @param jobs  Plaintexts of the layer, in the order the network reads them.
+ *
+ * @return Index of the layer, to be passed to layer().
+ */
+int FHEONWeightProvider::add_layer(vector<EncodeJob> jobs) {
+  lock_guard<mutex> lock(entriesMutex);
+  Entry entry;
+  entry.jobs = std::move(jobs);
+  entries.push_back(std::move(entry));
+  return entries.size() - 1;
+}
+
+/**
+ * @brief Finish registration.
+ *
+ * PreEncoded: encodes all layers in one batch and releases the raw values.
+ * JustInTime: starts the prefetch thread and queues the first layer.
+ */
+void FHEONWeightProvider::prepare() {
+  if (providerMode == Mode::PreEncoded) {
+    vector<EncodeJob> all;
+    for (auto &entry : entries) {
+      all.insert(all.end(), make_move_iterator(entry.jobs.begin()),
+                 make_move_iterator(entry.jobs.end()));
+    }
+    auto encodedAll = controller.encode_batch(all);
+    auto next = encodedAll.begin();
+    lock_guard<mutex> lock(entriesMutex);
+    for (auto &entry : entries) {
+      size_t count = entry.jobs.size();
+      auto plaintexts = make_shared<vector<Ptext>>(next, next + count);
+      next += count;
+      for (auto &plaintext : *plaintexts) {
+        entry.bytes += plaintext_bytes(plaintext);
+      }
+      residentBytes += entry.bytes;
+      entry.plaintexts = std::move(plaintexts);
+      vector<EncodeJob>().swap(entry.jobs);
+    }
+    return;
+  }
+  prefetchThread = thread(&FHEONWeightProvider::prefetch_loop, this);
+  if (!entries.empty()) {
+    lock_guard<mutex> lock(entriesMutex);
+    prefetchQueue.push_back(0);
+  }
+  prefetchReady.notify_one();
+}
+
+/**
+ * @brief Plaintexts of one layer, encoding them on this thread if needed.
+ *
+ * In JustInTime mode the following layer (wrapping around to the first, for
+ * the next inference) is queued for the prefetch thread. The returned pointer
+ * pins the layer against eviction until it is released.
+ *
+ * @param index  Layer index returned by add_layer.
+ *
+ * @return Plaintexts of the layer, in job order.
+ */
+FHEONWeightProvider::Layer FHEONWeightProvider::layer(int index) {
+  unique_lock<mutex> lock(entriesMutex);
+  entries[index].lastUse = ++useClock;
+  Layer plaintexts = encode_layer(lock, index);
+  if (providerMode == Mode::JustInTime) {
+    int following = (index + 1) % entries.size();
+    Entry &next = entries[following];
+    if (!next.plaintexts && !next.encoding) {
+      prefetchQueue.push_back(following);
+      prefetchReady.notify_one();
+    }
+  }
+  return plaintexts;
+}
+
+/**
+ * @brief Encoded bytes currently held by the provider.
+ */
+size_t FHEONWeightProvider::resident_bytes() {
+  lock_guard<mutex> lock(entriesMutex);
+  return residentBytes;
+}
+
+/**
+ * @brief Return a layer's plaintexts, encoding them if they are not resident.
+ *
+ * Called with the lock held. If another thread is already encoding the layer
+ * this waits for it; otherwise the lock is released around encode_batch so
+ * other layers stay readable meanwhile.
+ *
+ * @param lock   Held lock on entriesMutex.
+ * @param index  Layer index.
+ *
+ * @return Plaintexts of the layer.
+ */
+FHEONWeightProvider::Layer
+FHEONWeightProvider::encode_layer(unique_lock<mutex> &lock, int index) {
+  Entry &entry = entries[index];
+  encoded.wait(lock, [&entry] { return !entry.encoding; });
+  if (entry.plaintexts) {
+    return entry.plaintexts;
+  }
+  entry.encoding = true;
+  lock.unlock();
+  Layer plaintexts;
+  size_t bytes = 0;
+  try {
+    // jobs is only written before prepare(), so it is safe to read unlocked.
+    plaintexts = make_shared<const vector<Ptext>>(controller.encode_batch(entry.jobs));
+    for (auto &plaintext : *plaintexts) {
+      bytes += plaintext_bytes(plaintext);
+    }
+  } catch (...) {
+    lock.lock();
+    entry.encoding = false;
+    encoded.notify_all();
+    throw;
+  }
+  lock.lock();
+  entry.plaintexts = plaintexts;
+  entry.bytes = bytes;
+  entry.encoding = false;
+  // A freshly prefetched layer is about to be used: it counts as recent.
+  entry.lastUse = ++useClock;
+  residentBytes += bytes;
+  evict_to_budget(index);
+  encoded.notify_all();
+  return plaintexts;
+}
+
+/**
+ * @brief Drop least recently used layers until the budget is met.
+ *
+ * Layers still held by a reader, and the layer just encoded, are kept, so the
+ * budget is soft when everything resident is in use.
+ *
+ * @param keep  Layer that must stay resident.
+ */
+void FHEONWeightProvider::evict_to_budget(int keep) {
+  if (budget == 0) {
+    return;
+  }
+  while (residentBytes + controller.masks().resident_bytes() > budget) {
+    int victim = -1;
+    for (int i = 0; i < (int)entries.size(); i++) {
+      const Entry &entry = entries[i];
+      if (i == keep || !entry.plaintexts || entry.plaintexts.use_count() > 1) {
+        continue;
+      }
+      if (victim < 0 || entry.lastUse < entries[victim].lastUse) {
+        victim = i;
+      }
+    }
+    if (victim < 0) {
+      return;
+    }
+    entries[victim].plaintexts.reset();
+    residentBytes -= entries[victim].bytes;
+    entries[victim].bytes = 0;
+  }
+}
+
+/**
+ * @brief Background encoder for JustInTime mode. Failures are left for the
+ * next layer() call to surface on the caller's thread.
+ */
+void FHEONWeightProvider::prefetch_loop() {
+  unique_lock<mutex> lock(entriesMutex);
+  for (;;) {
+    prefetchReady.wait(lock, [this] { return stopping || !prefetchQueue.empty(); });
+    if (stopping) {
+      return;
+    }
+    int index = prefetchQueue.front();
+    prefetchQueue.pop_front();
+    try {
+      encode_layer(lock, index);
+    } catch (const exception &e) {
+      cerr << "         [weights] prefetch of layer " << index
+           << " failed: " << e.what() << endl;
+    }
+  }
+}
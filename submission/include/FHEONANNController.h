@@ -33,9 +33,13 @@
 #define FHEON_ANNCONCROLLER_H
 
 #include <openfhe.h>
+#include <map>
 #include <thread>
 
 #include "./FHEONHEController.h"
+#include "./FHEONInnerProduct.h"
+#include "./FHEONLayerShapes.h"
+#include "./FHEONTrace.h"
 
 #include "Utils.h"
 #include "UtilsData.h"
@@ -47,16 +51,41 @@ using namespace std;
 using namespace utils;
 using namespace utilsdata;
 
+/*
+ * Work the controller skipped because an identical result was already at hand: key switches
+ * of hoisted rotations found in the rotation memo, and mask plaintexts found in the mask cache. */
+struct FHEONReuseStats {
+    size_t keySwitches = 0;
+    size_t maskEncodes = 0;
+};
+
 class FHEONANNController{
 
 private:
-    CryptoContext<DCRTPoly> context;
+    // Every operation goes through trace_op, so lenet5() can be recorded (FHEONTrace.h).
+    TracedContext context;
+
+    /*
+     * Rotation memo. Hoisted rotations of one input share its precomputed digits, and a
+     * rotation asked for again, in the same kernel or by a later layer reading the same
+     * input, is returned without a key switch. Entries live as long as their input does;
+     * memoised inputs and rotations must not be modified in place. */
+    struct HoistedInput {
+        weak_ptr<CiphertextImpl<DCRTPoly>> input;
+        shared_ptr<vector<DCRTPoly>> digits;
+        map<int, Ctext> rotations;
+    };
+    map<const void*, HoistedInput> hoisted;
+    // Masks of this context, owned by its FHEONHEController; masks are encoded per call without one.
+    FHEONMaskCache* masks = nullptr;
+    FHEONReuseStats reuse;
 
 public:
     string public_data = "sskeys";
     int num_slots = 1 << 14;
     
-    FHEONANNController(CryptoContext<DCRTPoly>& ctx) : context(ctx) {}
+    FHEONANNController(CryptoContext<DCRTPoly>& ctx, FHEONMaskCache* maskCache = nullptr)
+        : context(ctx), masks(maskCache) {}
     void setContext(CryptoContext<DCRTPoly>& in_context);
     void setNumSlots(int numSlots){
         num_slots = 1<< numSlots;
@@ -71,9 +100,18 @@ public:
                                             int outputChannels, int Stride = 1, string stridingType="multi_channels");
     vector<int> generate_avgpool_optimized_rotation_positions(int inputWidth,  int inputChannels, 
                                             int kernelWidth, int Stride, bool globalPooling=false, string stridingType="multi_channels", int rotationIndex=16);
+    vector<int> generate_replicated_convolution_rotation_positions(int inputWidth, int inputChannels, int outputChannels,
+                                            int kernelWidth, int region, int replicas, bool replicateInput);
 
     Ctext he_convolution(Ctext& encryptedInput, vector<vector<Ptext>>& kernelData, Ptext& biasInput,
                             int inputWidth, int inputChannels, int outputChannels, int kernelWidth, int padding=0, int stride=1);
+    Ctext he_convolution_replicated(Ctext& encryptedInput, vector<vector<Ptext>>& kernelData, Ptext& biasInput,
+                            int inputWidth, int inputChannels, int outputChannels, int kernelWidth, int region, int replicas);
+    Ctext he_convolution(Ctext& encryptedInput, vector<vector<Ctext>>& kernelData, Ctext& biasInput,
+                            int inputWidth, int inputChannels, int outputChannels, int kernelWidth, int padding=0, int stride=1);
+    Ctext he_convolution_replicated(Ctext& encryptedInput, vector<vector<Ctext>>& kernelData, Ctext& biasInput,
+                            int inputWidth, int inputChannels, int outputChannels, int kernelWidth, int region, int replicas);
+    Ctext he_replicate_input(Ctext& encryptedInput, int region, int replicas);
     Ctext he_convolution_advanced(Ctext& encryptedInput, vector<vector<Ptext>>& kernelData, Ptext& biasInput,
                             int inputWidth, int inputChannels, int outputChannels, int kernelWidth, int padding, int stride);
     Ctext he_convolution_optimized(Ctext& encryptedInput,  vector<vector<Ptext>>& kernelData, Ptext& biasInput, 
@@ -96,17 +134,58 @@ public:
     Ctext he_globalavgpool(Ctext& encryptedInput, int inputWidth, int outputChannels, int kernelWidth, int rotatePositions);
     
     Ctext he_linear(Ctext& encryptedInput, vector<Ptext>& weightMatrix, Ptext& biasInput, int inputSize, int outputSize, int rotatePositions);
+    Ctext he_linear(Ctext& encryptedInput, vector<Ctext>& weightMatrix, Ctext& biasInput, int inputSize, int outputSize, int rotatePositions);
     Ctext he_linear_optimized(Ctext& encryptedInput, vector<Ptext>& weightMatrix, Ptext& biasInput, int inputSize, int outputSize);
 
     Ctext he_relu(Ctext& encryptedInput, double scale, int vectorSize, int polyDegree = 59);
     Ctext he_sum_two_ciphertexts(Ctext& firstInput, Ctext& secondInput); 
+
+    /** Reuse counted since the previous call (the caller's layer); also drops memo entries of dead inputs */
+    FHEONReuseStats take_reuse_stats();
+
+    /** Shape-specialised kernels: the layer dimensions come from a FHEONLayerShapes.h type */
+    template <typename Shape, typename T>
+    Ctext he_convolution_replicated(Ctext& encryptedInput, vector<vector<T>>& kernelData, T& biasInput);
+    template <typename Shape>
+    Ctext he_avgpool_optimzed(Ctext& encryptedInput);
+    template <typename Shape, typename T>
+    Ctext he_linear(Ctext& encryptedInput, vector<T>& weightMatrix, T& biasInput);
+    template <typename Shape, typename T>
+    Ctext he_convolution_polyphase(Ctext& encryptedInput, vector<vector<T>>& kernelData, T& biasInput);
+    template <typename Shape>
+    Ctext he_avgpool_polyphase(Ctext& encryptedInput);
     
 private:
+    /** Shared bodies of the plaintext- and ciphertext-weight layers (T = Ptext or Ctext) */
+    template <typename T>
+    Ctext convolution(Ctext& encryptedInput, vector<vector<T>>& kernelData, T& biasInput,
+                            int inputWidth, int inputChannels, int outputChannels, int kernelWidth, int padding, int stride);
+    template <typename T>
+    Ctext convolution_replicated(Ctext& encryptedInput, vector<vector<T>>& kernelData, T& biasInput,
+                            int inputWidth, int inputChannels, int outputChannels, int kernelWidth, int region, int replicas);
+    template <typename T>
+    Ctext linear(Ctext& encryptedInput, vector<T>& weightMatrix, T& biasInput, int inputSize, int outputSize, int rotatePositions);
+    Ctext multiply_taps(const vector<Ctext>& rotatedInputs, vector<Ptext>& kernelData);
+    Ctext multiply_taps(const vector<Ctext>& rotatedInputs, vector<Ctext>& kernelData);
+    /** Streaming form of multiply_taps: add one tap product into an accumulator, then finish it */
+    void accumulate_tap(Ctext& accumulator, const Ctext& rotatedInput, Ptext& kernelTap);
+    void accumulate_tap(Ctext& accumulator, const Ctext& rotatedInput, Ctext& kernelTap);
+    Ctext finish_taps(Ctext& accumulator, const vector<Ptext>& kernelData);
+    Ctext finish_taps(Ctext& accumulator, const vector<Ctext>& kernelData);
+
     Ctext basic_striding(Ctext in_cipher, int inputWidth, int widthOut,  int Stride);
     Ctext downsample(const Ctext& input, int inputWidth, int stride);
     Ctext downsample_with_multiple_channels(const Ctext& input, int inputWidth, int stride, int numChannels);
+    template <typename Shape>
+    Ctext downsample(const Ctext& input);
     Ctext batch_convolution_operation(const vector<Ctext>& rotatedInputs, const vector<Ptext>& kernelData, int kernelWidth, int inputSize,  int inputChannels);
 
+    Ctext hoisted_rotation(const Ctext& input, int index);
+    void prune_hoisted();
+    static string mask_key(const char* kind, std::initializer_list<int> params);
+    template <typename Build>
+    Ptext cached_mask(const string& key, Build build);
+
     Ptext first_mask(int width, int inputSize, int stride, int level);
     Ptext first_mask_with_channels(int width, int inputSize, int stride, int numChannels, int level);
     
@@ -117,10 +196,390 @@ private:
     Ptext generate_row_mask_with_channels(int row, int width, int inputSize, int stride, int numChannels,int level);
 
     Ptext generate_zero_mask(int size, int level);
+    Ptext generate_scale_plaintext(int scaleValue, int vectorSize, int level, int slots = 0);
     Ptext generate_zero_mask_channels(int size, int numChannels, int level);
     Ptext generate_channel_full_mask(int n, int in_elements, int out_elements, int numChannels, int level);
     Ptext generate_channel_mask_with_zeros(int channel, int outputSize, int numChannels, int level);
 
 };
 
+/**
+ * @brief Return the mask plaintext for key from the context's mask cache, encoding it
+ * with build() on a miss. Masks depend only on their parameters and level, so the
+ * controllers of concurrent workers and successive inferences share them.
+ */
+template <typename Build>
+Ptext FHEONANNController::cached_mask(const string& key, Build build) {
+    if (masks == nullptr) {
+        return build();
+    }
+    bool hit = false;
+    Ptext mask = masks->get(key, build, hit);
+    if (hit) {
+        reuse.maskEncodes++;
+    }
+    return mask;
+}
+
+/*************************************************************************************************
+ * Shape-specialised kernels. Same computations as the runtime-shaped layers above, with every
+ * loop bound, slot offset and rotation step a compile-time constant of the Shape, so they are
+ * defined here for the network that instantiates them.
+ *************************************************************************************************/
+
+/**
+ * @brief he_convolution_replicated() for a ReplicatedConvShape.
+ *
+ * When Shape::streamTaps holds, the rotated taps are produced one at a time and folded
+ * into per-pass accumulators instead of all being kept alive (see the shape's
+ * materializedCiphertexts / streamedCiphertexts).
+ *
+ * @param encryptedInput   Input holding Shape::replicas copies of the feature map.
+ * @param kernelData       Shape::passes passes of Shape::taps kernel taps.
+ * @param biasInput        Packed bias of all output channels.
+ *
+ * @return Ctext           Output channels packed back to back.
+ */
+template <typename Shape, typename T>
+Ctext FHEONANNController::he_convolution_replicated(Ctext& encryptedInput, vector<vector<T>>& kernelData, T& biasInput) {
+
+    if ((int)kernelData.size() != Shape::passes) {
+        throw std::runtime_error("he_convolution_replicated: expected " + std::to_string(Shape::passes) +
+                                 " kernel passes, got " + std::to_string(kernelData.size()));
+    }
+    int encode_level = encryptedInput->GetLevel();
+
+    vector<Ptext> split_masks(Shape::replicas);
+    for (int r = 0; r < Shape::replicas; r++) {
+        split_masks[r] = cached_mask(mask_key("replicated_split_mask", {Shape::maskSize, Shape::region, Shape::outputSize, r, encode_level}), [&]() {
+            vector<double> split_mask(Shape::maskSize, 0.0);
+            fill_n(split_mask.begin() + r * Shape::region, Shape::outputSize, 1.0);
+            return context->MakeCKKSPackedPlaintext(split_mask, 1, encode_level);
+        });
+    }
+    Ptext cleaning_mask_out = cached_mask(mask_key("replicated_row_mask", {Shape::maskSize, Shape::region, Shape::outputWidth, Shape::replicas, encode_level}), [&]() {
+        vector<double> row_mask(Shape::maskSize, 0.0);
+        for (int r = 0; r < Shape::replicas; r++) {
+            fill_n(row_mask.begin() + r * Shape::region, Shape::outputWidth, 1.0);
+        }
+        return context->MakeCKKSPackedPlaintext(row_mask, 1, encode_level);
+    });
+
+    vector<Ctext> conv_sums(Shape::passes);
+    if constexpr (Shape::streamTaps) {
+        // Tap-major: each row shift is decomposed once, each column tap is rotated from it,
+        // added into every pass and dropped before the next one is made.
+        uint32_t cyclotomicOrder = context->GetCyclotomicOrder();
+        Ctext rowInput = encryptedInput;
+        for (int i = 0; i < Shape::kernelWidth; i++) {
+            if (i > 0) {
+                rowInput = context->EvalRotate(rowInput, Shape::inputWidth);
+            }
+            auto digits = context->EvalFastRotationPrecompute(rowInput);
+            for (int j = 0; j < Shape::kernelWidth; j++) {
+                Ctext tap = j == 0 ? rowInput : context->EvalFastRotation(rowInput, j, cyclotomicOrder, digits);
+                for (int p = 0; p < Shape::passes; p++) {
+                    accumulate_tap(conv_sums[p], tap, kernelData[p][i * Shape::kernelWidth + j]);
+                }
+            }
+        }
+        for (int p = 0; p < Shape::passes; p++) {
+            conv_sums[p] = finish_taps(conv_sums[p], kernelData[p]);
+        }
+    } else {
+        vector<Ctext> rotated_ciphertexts(Shape::taps);
+        Ctext rowInput = encryptedInput;
+        for (int i = 0; i < Shape::kernelWidth; i++) {
+            if (i > 0) {
+                rowInput = context->EvalRotate(rowInput, Shape::inputWidth);
+            }
+            rotated_ciphertexts[i * Shape::kernelWidth] = rowInput;
+            for (int j = 1; j < Shape::kernelWidth; j++) {
+                rotated_ciphertexts[i * Shape::kernelWidth + j] = context->EvalRotate(rowInput, j);
+            }
+        }
+        for (int p = 0; p < Shape::passes; p++) {
+            conv_sums[p] = multiply_taps(rotated_ciphertexts, kernelData[p]);
+        }
+    }
+
+    vector<Ctext> final_vec;
+    final_vec.reserve(Shape::outputChannels);
+    for (int p = 0; p < Shape::passes; p++) {
+        Ctext conv_sum = std::move(conv_sums[p]);
+        if (Shape::inputChannels > 1) {
+            vector<Ctext> channel_sums(Shape::inputChannels);
+            channel_sums[0] = conv_sum;
+            for (int ch = 1; ch < Shape::inputChannels; ch++) {
+                conv_sum = context->EvalRotate(conv_sum, Shape::inputSize);
+                channel_sums[ch] = conv_sum;
+            }
+            conv_sum = context->EvalAddMany(channel_sums);
+        }
+
+        vector<Ctext> strided_vec(Shape::outputWidth);
+        strided_vec[0] = context->EvalMult(conv_sum, cleaning_mask_out);
+        for (int l = 1; l < Shape::outputWidth; l++) {
+            conv_sum = context->EvalRotate(conv_sum, Shape::inputWidth);
+            strided_vec[l] = context->EvalRotate(context->EvalMult(conv_sum, cleaning_mask_out), -(Shape::outputWidth * l));
+        }
+        Ctext strided_cipher = context->EvalAddMany(strided_vec);
+
+        for (int r = 0; r < Shape::replicas && p * Shape::replicas + r < Shape::outputChannels; r++) {
+            Ctext channel_cipher = context->EvalMult(strided_cipher, split_masks[r]);
+            if (Shape::split_shift(p, r) != 0) {
+                channel_cipher = context->EvalRotate(channel_cipher, Shape::split_shift(p, r));
+            }
+            final_vec.push_back(channel_cipher);
+        }
+    }
+    return context->EvalAdd(context->EvalAddMany(final_vec), biasInput);
+}
+
+/**
+ * @brief he_avgpool_optimzed() for an AvgPoolShape. The row-below tap reuses the
+ * hoisted inputWidth rotation instead of computing it twice.
+ *
+ * @param encryptedInput   Input feature maps, Shape::inputChannels back to back.
+ *
+ * @return Ctext           Pooled channels packed back to back.
+ */
+template <typename Shape>
+Ctext FHEONANNController::he_avgpool_optimzed(Ctext& encryptedInput) {
+
+    int encode_level = encryptedInput->GetLevel();
+    Ctext right = hoisted_rotation(encryptedInput, 1);
+    Ctext below = hoisted_rotation(encryptedInput, Shape::inputWidth);
+    Ctext sum_cipher = context->EvalAddMany({encryptedInput, right, below, context->EvalRotate(below, 1)});
+
+    sum_cipher = context->EvalMult(sum_cipher,
+        generate_scale_plaintext(Shape::kernelWidth * Shape::kernelWidth,
+                                 Shape::inputChannels * Shape::inputSize, encode_level));
+
+    vector<Ctext> channel_ciphers(Shape::inputChannels);
+    channel_ciphers[0] = downsample<Shape>(sum_cipher);
+    for (int ch = 1; ch < Shape::inputChannels; ch++) {
+        sum_cipher = context->EvalRotate(sum_cipher, Shape::inputSize);
+        channel_ciphers[ch] = context->EvalRotate(downsample<Shape>(sum_cipher), -ch * Shape::outputSize);
+    }
+    return context->EvalAddMany(channel_ciphers);
+}
+
+/**
+ * @brief downsample() for an AvgPoolShape; the output rows are summed once at the end
+ * instead of into a zero-masked accumulator.
+ */
+template <typename Shape>
+Ctext FHEONANNController::downsample(const Ctext& input) {
+
+    int level = input->GetLevel();
+    Ctext result = context->EvalMult(input, first_mask(Shape::inputWidth, Shape::inputSize, Shape::stride, level));
+    for (int s = 1; s < Shape::juxtaposeSteps; s++) {
+        result = context->EvalMult(context->EvalAdd(result, context->EvalRotate(result, 1 << (s - 1))),
+                                   generate_binary_mask(1 << s, Shape::inputSize, Shape::stride, level));
+    }
+    result = context->EvalAdd(result, context->EvalRotate(result, Shape::outputWidth / 2));
+
+    vector<Ctext> rows(Shape::outputWidth);
+    for (int row = 0; row < Shape::outputWidth; row++) {
+        rows[row] = context->EvalMult(result, generate_row_mask(row, Shape::outputWidth, Shape::inputSize, Shape::stride, level));
+        if (row < Shape::outputWidth - 1) {
+            result = context->EvalRotate(result, Shape::rowShift);
+        }
+    }
+    return context->EvalAddMany(rows);
+}
+
+/**
+ * @brief he_linear() for a LinearShape.
+ *
+ * @param encryptedInput   Input vector of Shape::inputSize values.
+ * @param weightMatrix     One row per output neuron.
+ * @param biasInput        Packed bias of all outputs.
+ *
+ * @return Ctext           Shape::outputSize outputs in the first slots.
+ */
+template <typename Shape, typename T>
+Ctext FHEONANNController::he_linear(Ctext& encryptedInput, vector<T>& weightMatrix, T& biasInput) {
+
+    if ((int)weightMatrix.size() < Shape::outputSize) {
+        throw std::runtime_error("he_linear: expected " + std::to_string(Shape::outputSize) +
+                                 " weight rows, got " + std::to_string(weightMatrix.size()));
+    }
+    vector<Ctext> result_matrix(Shape::groups);
+    for (int g = 0; g < Shape::groups; g++) {
+        int first = g * Shape::rotatePositions;
+        int last = std::min(first + Shape::rotatePositions, Shape::outputSize);
+        vector<Ctext> inner_matrix(last - first);
+        for (int i = first; i < last; i++) {
+            inner_matrix[i - first] = context->EvalSum(context->EvalMult(encryptedInput, weightMatrix[i]), Shape::inputSize);
+        }
+        result_matrix[g] = context->EvalMerge(inner_matrix);
+        if (g > 0) {
+            result_matrix[g] = context->EvalRotate(result_matrix[g], -first);
+        }
+    }
+    return context->EvalAdd(context->EvalAddMany(result_matrix), biasInput);
+}
+
+/**
+ * @brief Convolution of a polyphase input (PolyphaseConvShape).
+ *
+ * The (k+1)^2 distinct phase offsets of the input are rotated once with a shared
+ * (hoisted) decomposition; with Shape::streamTaps each offset is folded into the
+ * accumulators as soon as it is rotated and never stored. Each output phase sums its k^2 taps at the phase origin and is
+ * moved to its block with one rotation, so no row compaction is needed. The four phases
+ * share the tap plaintexts, which are zero outside the valid output positions so a phase
+ * does not spill into the next block.
+ *
+ * @param encryptedInput   Polyphase input, Shape::replicas copies Shape::region apart.
+ * @param kernelData       Shape::passes passes of Shape::taps plaintexts, ordered
+ *                         [row][column] (polyphase_kernel_encode_jobs).
+ * @param biasInput        Bias of every output channel over its Shape::channelStride slots.
+ *
+ * @return Ctext           Output channels in polyphase layout, Shape::channelStride apart.
+ */
+template <typename Shape, typename T>
+Ctext FHEONANNController::he_convolution_polyphase(Ctext& encryptedInput, vector<vector<T>>& kernelData, T& biasInput) {
+
+    if ((int)kernelData.size() != Shape::passes) {
+        throw std::runtime_error("he_convolution_polyphase: expected " + std::to_string(Shape::passes) +
+                                 " kernel passes, got " + std::to_string(kernelData.size()));
+    }
+    constexpr int k = Shape::kernelWidth;
+    int encode_level = encryptedInput->GetLevel();
+
+    vector<Ptext> split_masks(Shape::replicas);
+    for (int r = 0; r < Shape::replicas; r++) {
+        split_masks[r] = cached_mask(mask_key("polyphase_split_mask", {Shape::maskSize, Shape::region, Shape::channelStride, r, encode_level}), [&]() {
+            vector<double> split_mask(Shape::maskSize, 0.0);
+            fill_n(split_mask.begin() + r * Shape::region, Shape::channelStride, 1.0);
+            return context->MakeCKKSPackedPlaintext(split_mask, 1, encode_level);
+        });
+    }
+
+    auto digits = context->EvalFastRotationPrecompute(encryptedInput);
+    uint32_t cyclotomicOrder = context->GetCyclotomicOrder();
+    auto phase_input = [&](int s, int t) {
+        int offset = Shape::phase_offset(s, t);
+        return offset == 0 ? encryptedInput : context->EvalFastRotation(encryptedInput, offset, cyclotomicOrder, digits);
+    };
+
+    // phase_sums[p][q]: taps of output phase q in pass p, at the phase origin.
+    vector<vector<Ctext>> phase_sums(Shape::passes, vector<Ctext>(4));
+    if constexpr (Shape::streamTaps) {
+        // Offset-major: offset (s, t) is tap (s - a, t - b) of every output phase (a, b)
+        // that reaches it, so it is used up and dropped before the next one is rotated.
+        for (int s = 0; s <= k; s++) {
+            for (int t = 0; t <= k; t++) {
+                Ctext tap = phase_input(s, t);
+                for (int q = 0; q < 4; q++) {
+                    int u = s - q / 2, v = t - q % 2;
+                    if (u < 0 || u >= k || v < 0 || v >= k) {
+                        continue;
+                    }
+                    for (int p = 0; p < Shape::passes; p++) {
+                        accumulate_tap(phase_sums[p][q], tap, kernelData[p][u * k + v]);
+                    }
+                }
+            }
+        }
+        for (int p = 0; p < Shape::passes; p++) {
+            for (int q = 0; q < 4; q++) {
+                phase_sums[p][q] = finish_taps(phase_sums[p][q], kernelData[p]);
+            }
+        }
+    } else {
+        vector<Ctext> phase_inputs((k + 1) * (k + 1));
+        for (int s = 0; s <= k; s++) {
+            for (int t = 0; t <= k; t++) {
+                phase_inputs[s * (k + 1) + t] = phase_input(s, t);
+            }
+        }
+        for (int p = 0; p < Shape::passes; p++) {
+            for (int q = 0; q < 4; q++) {
+                int a = q / 2, b = q % 2;
+                vector<Ctext> rotated(k * k);
+                for (int u = 0; u < k; u++) {
+                    for (int v = 0; v < k; v++) {
+                        rotated[u * k + v] = phase_inputs[(a + u) * (k + 1) + (b + v)];
+                    }
+                }
+                phase_sums[p][q] = multiply_taps(rotated, kernelData[p]);
+            }
+        }
+    }
+
+    vector<Ctext> final_vec;
+    final_vec.reserve(Shape::outputChannels);
+    for (int p = 0; p < Shape::passes; p++) {
+        vector<Ctext> phases = std::move(phase_sums[p]);
+        for (int q = 1; q < 4; q++) {
+            phases[q] = context->EvalRotate(phases[q], -q * Shape::outputPhaseSize);
+        }
+        Ctext conv_sum = context->EvalAddMany(phases);
+
+        for (int r = 0; r < Shape::replicas && p * Shape::replicas + r < Shape::outputChannels; r++) {
+            Ctext channel_cipher = context->EvalMult(conv_sum, split_masks[r]);
+            if (Shape::split_shift(p, r) != 0) {
+                channel_cipher = context->EvalRotate(channel_cipher, Shape::split_shift(p, r));
+            }
+            final_vec.push_back(channel_cipher);
+        }
+    }
+    return context->EvalAdd(context->EvalAddMany(final_vec), biasInput);
+}
+
+/**
+ * @brief 2x2 average pooling of a polyphase feature map (PolyphaseAvgPoolShape).
+ *
+ * Adding the four phase blocks yields the window sums in place. One masked rotation per
+ * row then drops the row padding, and one per channel packs the channels densely.
+ * Depth 2, against 3 + log2(width) for he_avgpool_optimzed.
+ *
+ * @param encryptedInput   Output of he_convolution_polyphase (after the activation).
+ *
+ * @return Ctext           Pooled channels, Shape::outputSize slots each, back to back.
+ */
+template <typename Shape>
+Ctext FHEONANNController::he_avgpool_polyphase(Ctext& encryptedInput) {
+
+    int encode_level = encryptedInput->GetLevel();
+    int maskSize = Shape::inputChannels * Shape::channelStride;
+    Ctext sum_cipher = context->EvalAdd(encryptedInput, context->EvalRotate(encryptedInput, Shape::phaseSize));
+    sum_cipher = context->EvalAdd(sum_cipher, context->EvalRotate(sum_cipher, 2 * Shape::phaseSize));
+
+    // Rows: keep row i of the first phase block of every channel (scaled by 1/4) and close
+    // the gap left by the row stride.
+    vector<Ctext> rows(Shape::phaseWidth);
+    for (int i = 0; i < Shape::phaseWidth; i++) {
+        Ptext row_mask = cached_mask(mask_key("polyphase_pool_row_mask", {maskSize, Shape::channelStride, Shape::rowStride, Shape::phaseWidth, i, encode_level}), [&]() {
+            vector<double> values(maskSize, 0.0);
+            for (int c = 0; c < Shape::inputChannels; c++) {
+                fill_n(values.begin() + c * Shape::channelStride + i * Shape::rowStride, Shape::phaseWidth, 0.25);
+            }
+            return context->MakeCKKSPackedPlaintext(values, 1, encode_level);
+        });
+        rows[i] = context->EvalMult(sum_cipher, row_mask);
+        if (i > 0) {
+            rows[i] = context->EvalRotate(rows[i], i * (Shape::rowStride - Shape::phaseWidth));
+        }
+    }
+    Ctext pooled = context->EvalAddMany(rows);
+
+    vector<Ctext> channels(Shape::inputChannels);
+    for (int c = 0; c < Shape::inputChannels; c++) {
+        Ptext channel_mask = cached_mask(mask_key("polyphase_pool_channel_mask", {maskSize, Shape::channelStride, Shape::outputSize, c, encode_level}), [&]() {
+            vector<double> values(maskSize, 0.0);
+            fill_n(values.begin() + c * Shape::channelStride, Shape::outputSize, 1.0);
+            return context->MakeCKKSPackedPlaintext(values, 1, encode_level);
+        });
+        channels[c] = context->EvalMult(pooled, channel_mask);
+        if (c > 0) {
+            channels[c] = context->EvalRotate(channels[c], c * (Shape::channelStride - Shape::outputSize));
+        }
+    }
+    return context->EvalAddMany(channels);
+}
+
 #endif // FHEON_ANNCONCROLLER_H
\ No newline at end of file
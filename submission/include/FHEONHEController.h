@@ -44,6 +44,7 @@
 #include "Utils.h"
 #include "UtilsData.h"
 #include "UtilsImage.h"
+#include "FHEONMaskCache.h"
 
 using namespace lbcrypto;
 using namespace std;
@@ -56,10 +57,23 @@ using namespace utilsimages;
 using Ptext = Plaintext;
 using Ctext = Ciphertext<DCRTPoly>;
 
+/*
+ * One plaintext to be produced by FHEONHEController::encode_batch. Every entry of values
+ * is written repeat times back to back (e.g. one kernel tap per channel, repeated over the
+ * channel's width^2 slots). slots = 0 keeps the context default. */
+struct EncodeJob {
+    vector<double> values;
+    int repeat = 1;
+    int level = 1;
+    int slots = 0;
+};
+
 class FHEONHEController {
 
 protected:
     CryptoContext<DCRTPoly> context;
+    // Masks encoded under context; cleared whenever the context is replaced.
+    FHEONMaskCache maskCache;
 
 public:
 
@@ -81,6 +95,9 @@ public:
     CryptoContext<DCRTPoly> getContext() const {
         return context;
     }
+    FHEONMaskCache& masks() {
+        return maskCache;
+    }
 
      /*
      * Generating context, bootstrapping keys, rotation keys and loading them */
@@ -100,6 +117,7 @@ public:
     void clear_context(int bootstrapping_key_slots);
     void clear_bootstrapping_and_rotation_keys(int bootstrap_num_slots);
     Ctext bootstrap_function(Ctext& encryptedInput, int level = 2);
+    Ctext reduce_to_depth(Ctext& encryptedInput, int depth);
     
     /*** Encrypt and decrypt packed ciphertext. used to encrypt image and decrpt the results ****/
     Ctext encrypt_input(vector<double>& inputData);
@@ -114,6 +132,21 @@ public:
     vector<Ptext> encode_kernel_optimized(vector<vector<vector<double>>>& kernelData, int colsSquare, int encode_levels = 1);
     Ptext encode_shortcut_kernel(vector<double>& inputData, int colsSquare);
     Ptext encode_bais_input(vector<double>& inputData, int colsSquare, int encode_levels=1);
+    vector<Ptext> encode_batch(const vector<EncodeJob>& jobs);
+    vector<EncodeJob> kernel_encode_jobs(vector<vector<vector<double>>>& kernelData, int colsSquare, int encode_level = 1);
+    vector<EncodeJob> replicated_kernel_encode_jobs(vector<vector<vector<vector<double>>>>& kernelData, int colsSquare,
+                        int region, int replicas, int encode_level = 1);
+    vector<EncodeJob> polyphase_kernel_encode_jobs(vector<vector<vector<vector<double>>>>& kernelData, int inputWidth,
+                        int region, int replicas, int encode_level = 1);
+    vector<vector<Ptext>> encode_kernel_replicated(vector<vector<vector<vector<double>>>>& kernelData, int colsSquare,
+                        int region, int replicas, int encode_level = 1);
+
+    /*** Encrypted weights (model-private deployments), same layouts as the encode_* functions */
+    vector<Ctext> encrypt_batch(const vector<EncodeJob>& jobs, PublicKey<DCRTPoly>& publicKey);
+    vector<Ctext> encrypt_kernel_packed(vector<vector<vector<double>>>& kernelData, int colsSquare,
+                        PublicKey<DCRTPoly>& publicKey, int encode_level = 1);
+    vector<vector<Ctext>> encrypt_kernel_replicated(vector<vector<vector<vector<double>>>>& kernelData, int colsSquare,
+                        int region, int replicas, PublicKey<DCRTPoly>& publicKey, int encode_level = 1);
 
     Ctext change_num_slots(Ctext& encryptedInput, uint32_t numSlots);
 
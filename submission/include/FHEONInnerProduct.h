@@ -0,0 +1,52 @@
+/***********************************************************************************************************************
+*
+* @author: Nges Brian, Njungle
+*
+* MIT License
+* Copyright (c) 2025 Secure, Trusted and Assured Microelectronics, Arizona State University
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+********************************************************************************************************************/
+
+/********************************************************************
+ * Fused plaintext inner products. sum_k ct_k * pt_k is computed tower by tower
+ * and coefficient block by block with wide accumulators, and each result
+ * coefficient is reduced once. No intermediate product ciphertext is allocated.
+ ********************************************************************/
+
+#ifndef FHEON_FHEONInnerProduct_H
+#define FHEON_FHEONInnerProduct_H
+
+#include "./FHEONHEController.h"
+
+/*
+ * sum_k ciphertexts[k] * plaintexts[k], with the same result (towers, scaling factor, noise
+ * degree) as EvalMult followed by EvalAddMany. The fused kernel needs operands that EvalMult
+ * would not adjust first: rescaled ciphertexts (noise degree 1) at one level and scale, and
+ * plaintexts with at least as many towers. Anything else, or a build without 64-bit native
+ * integers and __int128, takes the EvalMult path. */
+Ctext fused_inner_product(CryptoContext<DCRTPoly>& context, const vector<Ctext>& ciphertexts,
+                          const vector<Ptext>& plaintexts);
+
+/*
+ * accumulator += ciphertext * plaintext without a product ciphertext; an empty accumulator
+ * starts with EvalMult. Falls back to EvalMult + EvalAddInPlace under the same conditions. */
+void fused_multiply_accumulate(CryptoContext<DCRTPoly>& context, Ctext& accumulator,
+                               const Ctext& ciphertext, const Ptext& plaintext);
+
+#endif //FHEON_FHEONInnerProduct_H
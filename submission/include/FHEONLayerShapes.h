@@ -0,0 +1,287 @@
+/***********************************************************************************************************************
+*
+* @author: Nges Brian, Njungle
+*
+* MIT License
+* Copyright (c) 2025 Secure, Trusted and Assured Microelectronics, Arizona State University
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+********************************************************************************************************************/
+
+/********************************************************************
+ * Compile-time layer shapes. Each shape fixes the dimensions of one layer and derives its
+ * loop bounds, slot offsets and rotation schedule with constexpr, so the shaped kernels of
+ * FHEONANNController do no planning per call and a network can static_assert that its
+ * rotation keys cover every layer.
+ ********************************************************************/
+
+#ifndef FHEON_FHEONLayerShapes_H
+#define FHEON_FHEONLayerShapes_H
+
+#include <array>
+#include <cstddef>
+
+/*
+ * Set of distinct non-zero rotation steps, usable in constant expressions. N is the
+ * capacity; count is the number of steps actually held. */
+template <size_t N>
+struct RotationSet {
+    std::array<int, N> steps{};
+    size_t count = 0;
+
+    constexpr bool contains(int step) const {
+        for (size_t i = 0; i < count; i++) {
+            if (steps[i] == step) {
+                return true;
+            }
+        }
+        return false;
+    }
+    constexpr void add(int step) {
+        if (step != 0 && !contains(step)) {
+            steps[count++] = step;
+        }
+    }
+    template <size_t M>
+    constexpr void add(const RotationSet<M>& other) {
+        for (size_t i = 0; i < other.count; i++) {
+            add(other.steps[i]);
+        }
+    }
+    template <size_t M>
+    constexpr bool covered_by(const RotationSet<M>& keys) const {
+        for (size_t i = 0; i < count; i++) {
+            if (!keys.contains(steps[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+constexpr int ceil_log2(int value) {
+    int bits = 0;
+    while ((1 << bits) < value) {
+        bits++;
+    }
+    return bits;
+}
+
+/*
+ * Replicated convolution (he_convolution_replicated): valid padding, stride 1, Replicas
+ * cyclic copies of the input Region slots apart. */
+template <int InputWidth, int InputChannels, int OutputChannels, int KernelWidth,
+          int Region, int Replicas, bool ReplicateInput>
+struct ReplicatedConvShape {
+    static constexpr int inputWidth = InputWidth;
+    static constexpr int inputChannels = InputChannels;
+    static constexpr int outputChannels = OutputChannels;
+    static constexpr int kernelWidth = KernelWidth;
+    static constexpr int region = Region;
+    static constexpr int replicas = Replicas;
+    static constexpr int inputSize = InputWidth * InputWidth;
+    static constexpr int outputWidth = InputWidth - KernelWidth + 1;
+    static constexpr int outputSize = outputWidth * outputWidth;
+    static constexpr int taps = KernelWidth * KernelWidth;
+    static constexpr int passes = (OutputChannels + Replicas - 1) / Replicas;
+    static constexpr int maskSize = Replicas * Region;
+    // Peak ciphertexts while the taps are applied. Materialized: every rotated copy, plus
+    // the products multiply_taps sums. Streamed (tap-major): one copy and one accumulator
+    // per pass. The kernel streams whenever that holds fewer.
+    static constexpr int materializedCiphertexts = 2 * taps;
+    static constexpr int streamedCiphertexts = passes + 1;
+    static constexpr bool streamTaps = streamedCiphertexts < materializedCiphertexts;
+    static_assert(outputWidth > 0, "kernel wider than the input");
+    static_assert(outputSize <= Region, "a channel must fit in its replica region");
+    static_assert((Replicas & (Replicas - 1)) == 0, "replicas must be a power of two");
+
+    // Rotation that moves copy r of pass p to its output channel.
+    static constexpr int split_shift(int pass, int r) {
+        return r * Region - (pass * Replicas + r) * outputSize;
+    }
+
+    // Upper bound on distinct steps: taps and row moves, row compaction, splits, replication.
+    static constexpr size_t rotationCapacity = KernelWidth + InputWidth + OutputChannels + Replicas;
+
+    static constexpr RotationSet<rotationCapacity> rotations() {
+        RotationSet<rotationCapacity> set;
+        set.add(InputWidth);
+        for (int j = 1; j < KernelWidth; j++) {
+            set.add(j);
+        }
+        if (InputChannels > 1) {
+            set.add(inputSize);
+        }
+        for (int l = 1; l < outputWidth; l++) {
+            set.add(-(l * outputWidth));
+        }
+        for (int oc = 0; oc < OutputChannels; oc++) {
+            set.add(split_shift(oc / Replicas, oc % Replicas));
+        }
+        if (ReplicateInput) {
+            for (int s = 1; s < Replicas; s *= 2) {
+                set.add(-(s * Region));
+            }
+        }
+        return set;
+    }
+};
+
+/*
+ * Optimized average pooling (he_avgpool_optimzed): 2x2 window, all channels strided at once. */
+template <int InputWidth, int InputChannels, int Stride>
+struct AvgPoolShape {
+    static constexpr int inputWidth = InputWidth;
+    static constexpr int inputChannels = InputChannels;
+    static constexpr int kernelWidth = 2;
+    static constexpr int stride = Stride;
+    static constexpr int inputSize = InputWidth * InputWidth;
+    static constexpr int outputWidth = InputWidth / Stride;
+    static constexpr int outputSize = outputWidth * outputWidth;
+    // Doubling steps of the row juxtaposition in downsample().
+    static constexpr int juxtaposeSteps = ceil_log2(outputWidth);
+    static constexpr int rowShift = Stride * InputWidth - outputWidth;
+    static_assert(outputWidth > 2, "the shaped pooling needs at least 3 output columns");
+
+    static constexpr RotationSet<InputChannels + 32> rotations() {
+        RotationSet<InputChannels + 32> set;
+        set.add(1);
+        set.add(InputWidth);
+        for (int s = 1; s < juxtaposeSteps; s++) {
+            set.add(1 << (s - 1));
+        }
+        set.add(outputWidth / 2);
+        set.add(rowShift);
+        set.add(inputSize);
+        for (int ch = 1; ch < InputChannels; ch++) {
+            set.add(-ch * outputSize);
+        }
+        return set;
+    }
+};
+
+/*
+ * Fully connected layer (he_linear): outputs merged RotatePositions at a time. */
+template <int InputSize, int OutputSize, int RotatePositions>
+struct LinearShape {
+    static constexpr int inputSize = InputSize;
+    static constexpr int outputSize = OutputSize;
+    static constexpr int rotatePositions = RotatePositions;
+    static constexpr int groups = (OutputSize + RotatePositions - 1) / RotatePositions;
+
+    static constexpr RotationSet<groups> rotations() {
+        RotationSet<groups> set;
+        for (int g = 1; g < groups; g++) {
+            set.add(-g * RotatePositions);
+        }
+        return set;
+    }
+};
+
+/*
+ * Polyphase convolution (he_convolution_polyphase). The single input channel is uploaded as its
+ * four stride-2 phases: pixel (y, x) sits in phase block (y%2)*2 + x%2, at row y/2 and column x/2
+ * of a (InputWidth/2)^2 block. Each output phase is then a stride-1 convolution over the input
+ * phases, kept at the input's row stride, so a following 2x2 average pool only adds the phases
+ * (PolyphaseAvgPoolShape) and never downsamples. */
+template <int InputWidth, int OutputChannels, int KernelWidth, int Region, int Replicas>
+struct PolyphaseConvShape {
+    static constexpr int inputWidth = InputWidth;
+    static constexpr int inputChannels = 1;
+    static constexpr int outputChannels = OutputChannels;
+    static constexpr int kernelWidth = KernelWidth;
+    static constexpr int region = Region;
+    static constexpr int replicas = Replicas;
+    static constexpr int rowStride = InputWidth / 2;
+    static constexpr int inputPhaseSize = rowStride * rowStride;
+    static constexpr int outputWidth = InputWidth - KernelWidth + 1;
+    static constexpr int phaseWidth = outputWidth / 2;
+    static constexpr int outputPhaseSize = phaseWidth * rowStride;
+    static constexpr int channelStride = 4 * outputPhaseSize;
+    // Tap plaintexts per pass; the four output phases reuse them.
+    static constexpr int taps = KernelWidth * KernelWidth;
+    static constexpr int passes = (OutputChannels + Replicas - 1) / Replicas;
+    static constexpr int maskSize = Replicas * Region;
+    // Peak ciphertexts while the taps are applied: the (k+1)^2 phase offsets plus one
+    // phase's products, or streamed, one offset and an accumulator per pass and phase.
+    static constexpr int materializedCiphertexts = (KernelWidth + 1) * (KernelWidth + 1) + taps;
+    static constexpr int streamedCiphertexts = 4 * passes + 1;
+    static constexpr bool streamTaps = streamedCiphertexts < materializedCiphertexts;
+    static_assert(InputWidth % 2 == 0 && outputWidth % 2 == 0, "polyphase needs even widths");
+    static_assert(4 * inputPhaseSize <= Region && channelStride <= Region, "phases must fit in a replica region");
+    static_assert((Replicas & (Replicas - 1)) == 0, "replicas must be a power of two");
+
+    // Slot of pixel (y, x) in the uploaded layout.
+    static constexpr int input_slot(int y, int x) {
+        return ((y % 2) * 2 + x % 2) * inputPhaseSize + (y / 2) * rowStride + x / 2;
+    }
+    // Rotation that lines input pixel (s, t) up with output pixel (0, 0); output phase (a, b)
+    // reads tap (u, v) from phase_offset(a + u, b + v).
+    static constexpr int phase_offset(int s, int t) {
+        return input_slot(s, t);
+    }
+    static constexpr int split_shift(int pass, int r) {
+        return r * Region - (pass * Replicas + r) * channelStride;
+    }
+
+    static constexpr size_t rotationCapacity = (KernelWidth + 1) * (KernelWidth + 1) + 3 + OutputChannels;
+
+    static constexpr RotationSet<rotationCapacity> rotations() {
+        RotationSet<rotationCapacity> set;
+        for (int s = 0; s <= KernelWidth; s++) {
+            for (int t = 0; t <= KernelWidth; t++) {
+                set.add(phase_offset(s, t));
+            }
+        }
+        for (int q = 1; q < 4; q++) {
+            set.add(-q * outputPhaseSize);
+        }
+        for (int oc = 0; oc < OutputChannels; oc++) {
+            set.add(split_shift(oc / Replicas, oc % Replicas));
+        }
+        return set;
+    }
+};
+
+/*
+ * 2x2 average pooling of a PolyphaseConvShape output: add the four phase blocks, then compact the
+ * rows and channels to the dense layout the other layers use. */
+template <int PhaseWidth, int RowStride, int Channels>
+struct PolyphaseAvgPoolShape {
+    static constexpr int phaseWidth = PhaseWidth;
+    static constexpr int rowStride = RowStride;
+    static constexpr int inputChannels = Channels;
+    static constexpr int phaseSize = PhaseWidth * RowStride;
+    static constexpr int channelStride = 4 * phaseSize;
+    static constexpr int outputSize = PhaseWidth * PhaseWidth;
+
+    static constexpr RotationSet<PhaseWidth + Channels + 2> rotations() {
+        RotationSet<PhaseWidth + Channels + 2> set;
+        set.add(phaseSize);
+        set.add(2 * phaseSize);
+        for (int i = 1; i < PhaseWidth; i++) {
+            set.add(i * (RowStride - PhaseWidth));
+        }
+        for (int c = 1; c < Channels; c++) {
+            set.add(c * (channelStride - outputSize));
+        }
+        return set;
+    }
+};
+
+#endif //FHEON_FHEONLayerShapes_H
@@ -0,0 +1,92 @@
+/***********************************************************************************************************************
+*
+* @author: Nges Brian, Njungle
+*
+* MIT License
+* Copyright (c) 2025 Secure, Trusted and Assured Microelectronics, Arizona State University
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+********************************************************************************************************************/
+
+/********************************************************************
+ * Mask plaintexts of one context, encoded once and shared by the
+ * ANN controllers of every inference under a byte budget
+ ********************************************************************/
+
+#ifndef FHEON_FHEONMaskCache_H
+#define FHEON_FHEONMaskCache_H
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <openfhe.h>
+
+using namespace lbcrypto;
+using namespace std;
+
+using Ptext = Plaintext;
+
+// RNS towers x ring dimension x 8 bytes held by an encoded plaintext.
+size_t plaintext_bytes(const Ptext& plaintext);
+
+class FHEONMaskCache {
+
+public:
+    static constexpr size_t kDefaultBudget = size_t(256) << 20;
+
+    explicit FHEONMaskCache(size_t byteBudget = kDefaultBudget) : budget(byteBudget) {}
+    FHEONMaskCache(const FHEONMaskCache&) = delete;
+    FHEONMaskCache& operator=(const FHEONMaskCache&) = delete;
+
+    /*
+     * The plaintext stored under key, or build()'s result, stored for the next caller. hit
+     * tells which. build() runs unlocked; if two callers race, the first insertion wins. */
+    template <typename Build>
+    Ptext get(const string& key, Build build, bool& hit) {
+        Ptext mask = find(key);
+        hit = mask != nullptr;
+        return hit ? mask : insert(key, build());
+    }
+
+    // Drops every mask; their context is going away.
+    void clear();
+    void set_budget(size_t byteBudget);
+    size_t resident_bytes();
+
+private:
+    struct Entry {
+        Ptext mask;
+        size_t bytes = 0;
+        list<string>::iterator lru;
+    };
+
+    mutex entriesMutex;
+    map<string, Entry> entries;
+    // Most recently used key first.
+    list<string> lru;
+    size_t residentBytes = 0;
+    size_t budget;
+
+    Ptext find(const string& key);
+    Ptext insert(const string& key, Ptext mask);
+    void evict_to_budget();
+};
+
+#endif //FHEON_FHEONMaskCache_H
@@ -0,0 +1,189 @@
+/***********************************************************************************************************************
+*
+* @author: Nges Brian, Njungle
+*
+* MIT License
+* Copyright (c) 2025 Secure, Trusted and Assured Microelectronics, Arizona State University
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+********************************************************************************************************************/
+
+/********************************************************************
+ * Operation traces. While a FHEONTraceRecorder::Scope is alive, every CryptoContext
+ * operation the controllers issue on that thread is logged with its wall time and the
+ * shape of its operands (towers, noise degree, slots, rotation indices), so that
+ * trace_replay can run the same sequence on synthetic ciphertexts under other parameters.
+ ********************************************************************/
+
+#ifndef FHEON_FHEONTrace_H
+#define FHEON_FHEONTrace_H
+
+#include <chrono>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "./FHEONHEController.h"
+
+/*
+ * One recorded operation. result and args are operand descriptors:
+ *   c:<id>:<towers>:<noiseDeg>:<elements>:<slots>   ciphertext (id tells operands apart)
+ *   p:<towers>:<noiseDeg>:<slots>                    plaintext
+ *   k:<id>                                           fast-rotation digits
+ *   V:<n> / W:<n>                                    vector of n ciphertexts / plaintexts,
+ *                                                    followed by the n descriptors
+ *   x:<n>  i:<value>  d:<value>  n                   doubles, integer, double, anything else
+ * An in-place operation records its first argument, after the call, as the result. */
+struct FHEONTraceOp {
+    string name;
+    double seconds = 0;
+    string result;
+    vector<string> args;
+};
+
+class FHEONTraceRecorder {
+
+public:
+    /* Records the operations of the calling thread while alive; scopes nest. */
+    class Scope {
+    public:
+        explicit Scope(FHEONTraceRecorder& recorder);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        FHEONTraceRecorder* previous;
+    };
+
+    // Recorder of the calling thread, or nullptr when nothing is being traced.
+    static FHEONTraceRecorder* active();
+
+    void record(FHEONTraceOp op) { ops.push_back(std::move(op)); }
+    const vector<FHEONTraceOp>& operations() const { return ops; }
+
+    // One line per operation: name, seconds, result, arguments.
+    void save(const string& path) const;
+    static vector<FHEONTraceOp> load(const string& path);
+
+private:
+    vector<FHEONTraceOp> ops;
+};
+
+string trace_describe(const Ctext& ciphertext);
+string trace_describe(const ConstCiphertext<DCRTPoly>& ciphertext);
+string trace_describe(const Ptext& plaintext);
+string trace_describe(const shared_ptr<vector<DCRTPoly>>& digits);
+string trace_describe(const vector<Ctext>& ciphertexts);
+string trace_describe(const vector<Ptext>& plaintexts);
+string trace_describe(const vector<double>& values);
+string trace_describe_number(double value);
+
+template <typename T>
+string trace_describe(const T& value) {
+    if constexpr (is_integral_v<T> || is_enum_v<T>) {
+        return "i:" + to_string(static_cast<long long>(value));
+    } else if constexpr (is_floating_point_v<T>) {
+        return trace_describe_number(value);
+    } else {
+        return "n";
+    }
+}
+
+/*
+ * Run fn() and, if the calling thread is being traced, record it under name with the
+ * descriptors of args, which must be the operands fn() uses. Untraced, this costs one
+ * thread-local load. */
+template <typename Fn, typename... Args>
+auto trace_op(const char* name, Fn&& fn, const Args&... args) {
+    FHEONTraceRecorder* recorder = FHEONTraceRecorder::active();
+    if (recorder == nullptr) {
+        return fn();
+    }
+    FHEONTraceOp op;
+    op.name = name;
+    op.args = {trace_describe(args)...};
+    auto start = chrono::steady_clock::now();
+    if constexpr (is_void_v<decltype(fn())>) {
+        fn();
+        op.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if constexpr (sizeof...(Args) > 0) {
+            op.result = trace_describe(std::get<0>(std::forward_as_tuple(args...)));
+        } else {
+            op.result = "n";
+        }
+        recorder->record(std::move(op));
+    } else {
+        auto result = fn();
+        op.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        op.result = trace_describe(result);
+        recorder->record(std::move(op));
+        return result;
+    }
+}
+
+/*
+ * CryptoContext stand-in for the controllers: context->Op(...) forwards to OpenFHE through
+ * trace_op. Only the operations the controllers use are exposed. */
+class TracedContext {
+
+public:
+    TracedContext() = default;
+    TracedContext(const CryptoContext<DCRTPoly>& ctx) : context(ctx) {}
+
+    TracedContext* operator->() { return this; }
+    operator CryptoContext<DCRTPoly>&() { return context; }
+
+#define FHEON_TRACED_OP(Op)                                                               \
+    template <typename... Args>                                                           \
+    auto Op(Args&&... args) {                                                             \
+        return trace_op(#Op, [&]() { return context->Op(std::forward<Args>(args)...); }, \
+                        args...);                                                         \
+    }
+    FHEON_TRACED_OP(EvalRotate)
+    FHEON_TRACED_OP(EvalFastRotationPrecompute)
+    FHEON_TRACED_OP(EvalFastRotation)
+    FHEON_TRACED_OP(EvalMult)
+    FHEON_TRACED_OP(EvalMultNoRelin)
+    FHEON_TRACED_OP(Relinearize)
+    FHEON_TRACED_OP(EvalAdd)
+    FHEON_TRACED_OP(EvalAddInPlace)
+    FHEON_TRACED_OP(EvalSum)
+    FHEON_TRACED_OP(EvalChebyshevFunction)
+    FHEON_TRACED_OP(MakeCKKSPackedPlaintext)
+    FHEON_TRACED_OP(EvalBootstrap)
+    FHEON_TRACED_OP(Compress)
+#undef FHEON_TRACED_OP
+
+    // Spelled out so that braced lists still convert to the vector.
+    Ctext EvalAddMany(const vector<Ctext>& ciphertexts) {
+        return trace_op("EvalAddMany", [&]() { return context->EvalAddMany(ciphertexts); }, ciphertexts);
+    }
+    Ctext EvalMerge(const vector<Ctext>& ciphertexts) {
+        return trace_op("EvalMerge", [&]() { return context->EvalMerge(ciphertexts); }, ciphertexts);
+    }
+
+    uint32_t GetCyclotomicOrder() const { return context->GetCyclotomicOrder(); }
+    uint32_t GetRingDimension() const { return context->GetRingDimension(); }
+
+private:
+    CryptoContext<DCRTPoly> context;
+};
+
+#endif //FHEON_FHEONTrace_H
@@ -0,0 +1,94 @@
+/***********************************************************************************************************************
+*
+* @author: Nges Brian, Njungle
+*
+* MIT License
+* Copyright (c) 2025 Secure, Trusted and Assured Microelectronics, Arizona State University
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+********************************************************************************************************************/
+
+/********************************************************************
+ * The weight provider hands the controllers their plaintext weights layer by layer,
+ * either all encoded up front or encoded just in time from the raw values
+ ********************************************************************/
+
+#ifndef FHEON_FHEONWeightProvider_H
+#define FHEON_FHEONWeightProvider_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "FHEONHEController.h"
+
+class FHEONWeightProvider {
+
+public:
+    /*
+     * PreEncoded keeps every plaintext resident (fastest, largest). JustInTime keeps only
+     * the raw doubles (about 1/ringDim of the encoded size per tower) and encodes a layer
+     * when it is first needed, while a prefetch thread encodes the next one. */
+    enum class Mode { PreEncoded, JustInTime };
+    // Readers hold the shared_ptr while the layer is in use; eviction never frees a pinned layer.
+    using Layer = shared_ptr<const vector<Ptext>>;
+
+    // byteBudget caps the encoded bytes kept resident in JustInTime mode; 0 means no cap.
+    FHEONWeightProvider(FHEONHEController& controller, Mode mode, size_t byteBudget = 0);
+    ~FHEONWeightProvider();
+    FHEONWeightProvider(const FHEONWeightProvider&) = delete;
+    FHEONWeightProvider& operator=(const FHEONWeightProvider&) = delete;
+
+    int add_layer(vector<EncodeJob> jobs);
+    void prepare();
+    Layer layer(int index);
+
+    Mode mode() const { return providerMode; }
+    size_t resident_bytes();
+
+private:
+    struct Entry {
+        vector<EncodeJob> jobs;
+        Layer plaintexts;
+        size_t bytes = 0;
+        bool encoding = false;
+        uint64_t lastUse = 0;
+    };
+
+    FHEONHEController& controller;
+    Mode providerMode;
+    size_t budget;
+
+    mutex entriesMutex;
+    condition_variable encoded;
+    vector<Entry> entries;
+    uint64_t useClock = 0;
+    size_t residentBytes = 0;
+
+    condition_variable prefetchReady;
+    deque<int> prefetchQueue;
+    bool stopping = false;
+    thread prefetchThread;
+
+    Layer encode_layer(unique_lock<mutex>& lock, int index);
+    void evict_to_budget(int keep);
+    void prefetch_loop();
+};
+
+#endif //FHEON_FHEONWeightProvider_H
@@ -0,0 +1,130 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef EVAL_KEY_CACHE_H_
+#define EVAL_KEY_CACHE_H_
+// eval_key_cache.h - keeps several clients' evaluation keys resident under a
+// byte budget.
+//
+// OpenFHE stores relinearization and rotation keys in process-wide maps keyed
+// by the key tag of the secret key that produced them, so keys of different
+// clients can coexist in one process. This cache decides which tenants stay
+// loaded: a tenant's mk.bin and rk.bin are deserialized on first use, charged
+// against the budget by their serialized size, and evicted least recently used
+// once no inference holds a lease on them.
+//
+// Loading and evicting mutate OpenFHE's global key maps, which are not
+// synchronized, while every inference reads them. The cache therefore treats
+// a lease as a reader of the maps and a load or eviction as the only writer:
+// a miss waits until no lease is held, new acquires wait behind a pending
+// miss, and then it evicts and loads alone. Hits of resident tenants only
+// take the bookkeeping mutex. A thread must release its lease before it
+// acquires another, or a miss could wait on it forever.
+
+#include <condition_variable>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "openfhe.h"
+#include "params.h"
+
+using namespace lbcrypto;
+
+// Raised when a tenant's keys cannot be admitted: they are larger than the
+// whole budget, or everything else resident is pinned by in-flight leases.
+class KeyCacheAdmissionError : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+class EvalKeyCache {
+ public:
+  static constexpr size_t kUnlimited = static_cast<size_t>(-1);
+
+  // Pins one tenant's keys for the duration of an inference.
+  class Lease {
+   public:
+    Lease() = default;
+    Lease(Lease&& other) noexcept;
+    Lease& operator=(Lease&& other) noexcept;
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+    ~Lease();
+
+    // Key tag the tenant's ciphertexts carry; evaluation keys live under it.
+    const std::string& tag() const { return tag_; }
+    const std::string& tenant() const { return tenant_; }
+    explicit operator bool() const { return cache_ != nullptr; }
+    void release();
+
+   private:
+    friend class EvalKeyCache;
+    Lease(EvalKeyCache* cache, std::string tenant, std::string tag)
+        : cache_(cache), tenant_(std::move(tenant)), tag_(std::move(tag)) {}
+
+    EvalKeyCache* cache_ = nullptr;
+    std::string tenant_;
+    std::string tag_;
+  };
+
+  explicit EvalKeyCache(size_t budgetBytes = kUnlimited) : budget_(budgetBytes) {}
+  ~EvalKeyCache();
+
+  // Returns a lease on the tenant's keys, loading them from keyDir (pk.bin,
+  // mk.bin, rk.bin) if they are not resident. Evicts idle tenants as needed;
+  // throws KeyCacheAdmissionError if the keys still would not fit.
+  Lease acquire(const std::string& tenant, const fs::path& keyDir,
+                CryptoContext<DCRTPoly> cc);
+
+  // Drops every idle tenant, waiting for in-flight leases to be released.
+  // Returns the number of bytes freed.
+  size_t evict_idle();
+
+  size_t budget() const { return budget_; }
+  size_t resident_bytes() const;
+  size_t resident_tenants() const;
+
+ private:
+  struct Entry {
+    std::string tag;
+    size_t bytes = 0;
+    int refs = 0;
+    std::list<std::string>::iterator lru;
+  };
+
+  Lease pin(std::unordered_map<std::string, Entry>::iterator it);
+  void release(const std::string& tenant);
+  // Waits until this thread may mutate the key maps; see the file comment.
+  void begin_write(std::unique_lock<std::mutex>& lock);
+  void end_write();
+  bool make_room(size_t bytes);
+  void evict(std::unordered_map<std::string, Entry>::iterator it);
+
+  const size_t budget_;
+  size_t used_ = 0;
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  // Leases alive (readers of the key maps), and the writer state.
+  int readers_ = 0;
+  int writersWaiting_ = 0;
+  bool writing_ = false;
+  std::unordered_map<std::string, Entry> entries_;
+  // Most recently used tenant first.
+  std::list<std::string> lru_;
+};
+
+#endif  // ifndef EVAL_KEY_CACHE_H_
@@ -0,0 +1,53 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef INFERENCE_WIRE_H_
+#define INFERENCE_WIRE_H_
+// inference_wire.h - framing between the resident inference server and its
+// clients (load_generator) over a Unix domain socket.
+//
+// Every message is a WireHeader followed by `length` bytes of a serialized
+// ciphertext. A request names the tenant whose evaluation keys its ciphertext
+// was encrypted under (0 is the server's default key directory). Requests
+// leave the timing fields at zero; responses carry the
+// request id back with the time the request waited in the server's queue and
+// the time its inference took. Both ends run on the same host, so the header
+// is sent in host byte order.
+
+#include <cstdint>
+#include <string>
+
+struct WireHeader {
+  uint64_t id = 0;
+  uint64_t tenant = 0;
+  uint64_t length = 0;
+  uint64_t queue_us = 0;
+  uint64_t compute_us = 0;
+};
+
+// Default socket path, relative to the working directory of both ends.
+#define INFERENCE_SOCKET "io/inference.sock"
+
+// Upper bound on one payload; a LeNet-5 ciphertext is a few MB.
+constexpr uint64_t kMaxWirePayload = uint64_t(1) << 30;
+
+int listen_unix_socket(const std::string& path);
+int connect_unix_socket(const std::string& path);
+
+// Both return false on a clean end of stream before the header and throw
+// std::runtime_error on any other failure.
+bool read_message(int fd, WireHeader& header, std::string& payload);
+void write_message(int fd, const WireHeader& header,
+                   const std::string& payload);
+
+#endif  // ifndef INFERENCE_WIRE_H_
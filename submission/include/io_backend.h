@@ -0,0 +1,85 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef IO_BACKEND_H_
+#define IO_BACKEND_H_
+// io_backend.h - batched file I/O for the stage executables.
+//
+// Stages serialize ciphertexts into memory and hand whole windows of files to
+// an IoBackend, instead of running one blocking ofstream/ifstream chain per
+// file. The io_uring backend (built when liburing is found, see
+// CMakeLists.txt) submits the whole window at once from registered buffers;
+// the POSIX backend issues pread/pwrite per request and is the fallback when
+// io_uring is not compiled in or the kernel refuses it.
+
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "params.h"
+#include "utils.h"
+
+// One read or write of a file range. Reads with length 0 read from offset to
+// the end of the file. Writes at offset 0 create or truncate the file; writes
+// at other offsets update an existing container file in place.
+struct IoRequest {
+  fs::path path;
+  uint64_t offset = 0;
+  size_t length = 0;
+  std::string data;
+};
+
+class IoBackend {
+ public:
+  virtual ~IoBackend() = default;
+  virtual const char* name() const = 0;
+  // Fills data of every request. Throws std::runtime_error on failure.
+  virtual void read_batch(std::vector<IoRequest>& requests) = 0;
+  // Writes data of every request. Throws std::runtime_error on failure.
+  virtual void write_batch(const std::vector<IoRequest>& requests) = 0;
+};
+
+// Number of ciphertext files the stages keep in flight per batch. Bounds the
+// memory held in serialized buffers (a few MB per ciphertext).
+constexpr size_t kIoBatchSize = 32;
+
+// Returns the io_uring backend when available, the POSIX one otherwise. The
+// FHEON_IO_BACKEND environment variable ("posix" or "io_uring") overrides.
+std::unique_ptr<IoBackend> make_io_backend();
+
+template <typename T>
+std::string serialize_binary(const T& obj) {
+  std::ostringstream os(std::ios::out | std::ios::binary);
+  Serial::Serialize(obj, os, SerType::BINARY);
+  return os.str();
+}
+
+// `source` names the buffer's origin (usually its file) in the error thrown
+// when the buffer is truncated or not a serialized T.
+template <typename T>
+void deserialize_binary(const std::string& buffer, T& obj, const std::string& source) {
+  std::istringstream is(buffer, std::ios::in | std::ios::binary);
+  try {
+    Serial::Deserialize(obj, is, SerType::BINARY);
+  } catch (const std::exception& e) {
+    throw std::runtime_error("Cannot deserialize " + source + ": " + e.what());
+  }
+  if (is.fail()) {
+    throw std::runtime_error("Cannot deserialize " + source);
+  }
+}
+
+#endif  // ifndef IO_BACKEND_H_
@@ -0,0 +1,77 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef KEY_STORE_H_
+#define KEY_STORE_H_
+// key_store.h - manifests and delta updates for evaluation-key files.
+//
+// Every key directory carries keys.manifest next to mk.bin/rk.bin. It records
+// the context fingerprint the keys belong to, the key groups present (mult,
+// bootstrap, sum) and every rotation index in rk.bin. When the model plan
+// changes, the client diffs the plan against the server's manifest, generates
+// only the missing rotation keys into rk_delta.bin + delta.manifest, and the
+// server appends them to its store with merge_key_delta().
+//
+// Manifest format, one entry per line:
+//   context <16 hex digits>
+//   group <mult|bootstrap|sum>
+//   rotation <index>
+
+#include <iosfwd>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "mlp_encryption_utils.h"
+#include "params.h"
+
+#define KEY_MANIFEST_FILE "keys.manifest"
+#define KEY_DELTA_FILE "rk_delta.bin"
+#define KEY_DELTA_MANIFEST_FILE "delta.manifest"
+
+struct KeyManifest {
+  std::string context;
+  std::set<std::string> groups;
+  std::set<int> rotations;
+};
+
+struct KeyManifestDiff {
+  bool same_context = false;
+  std::vector<std::string> missing_groups;
+  // In `want` but not in `have`.
+  std::vector<int> missing_rotations;
+  // In `have` but no longer needed by `want`.
+  std::vector<int> unused_rotations;
+};
+
+// FNV-1a over the serialized context and the key tag: keys are only
+// interchangeable if both the parameters and the secret key match.
+std::string context_fingerprint(const fs::path& ccFile,
+                                const std::string& keyTag);
+
+KeyManifest read_key_manifest(const fs::path& file);
+void write_key_manifest(const fs::path& file, const KeyManifest& manifest);
+KeyManifestDiff diff_key_manifests(const KeyManifest& have,
+                                   const KeyManifest& want);
+
+// Generates one rotation key at a time and appends it to `out` as its own
+// serialized key map, dropping it from the context before the next one.
+void write_rotation_keys(CryptoContextT cc, PrivateKeyT sk,
+                         const std::vector<int>& rotations, std::ostream& out);
+
+// Appends keyDir/rk_delta.bin to keyDir/rk.bin, merges delta.manifest into
+// keys.manifest and removes the delta files. Throws if the delta was made for
+// a different context.
+void merge_key_delta(const fs::path& keyDir);
+
+#endif  // ifndef KEY_STORE_H_
@@ -14,8 +14,14 @@
 #ifndef LENET5_FHEON_H_
 #define LENET5_FHEON_H_
 
+#include <functional>
+#include <string>
+#include <vector>
+
 #include "FHEONANNController.h"
 #include "FHEONHEController.h"
+#include "FHEONWeightProvider.h"
+#include "lenet5_plan.h"
 #include "openfhe.h"
 
 using namespace std;
@@ -24,6 +30,108 @@ using namespace lbcrypto;
 
 // Ctext lenet5(FHEONHEController &fheonHEController, CryptoContext<DCRTPoly> &v0,
 //              Ctext v1, PrivateKey<DCRTPoly> &sk);
+
+// Both convolutions run on LENET5_REPLICAS cyclic copies of their input, one
+// every LENET5_REPLICA_REGION slots. conv1 uses the copies mlp_encrypt packs
+// (NORMALIZED_DIM apart); conv2 rebuilds them after pooling. Key generation
+// derives the matching rotation keys from the same values.
+constexpr int LENET5_REPLICA_REGION = 1024;
+// LENET5_PACKING (CMake cache variable, 1, 2 or 4) sets the number of copies;
+// it is fixed at build time because the rotation keys depend on it.
+#ifndef LENET5_PACKING
+#define LENET5_PACKING 4
+#endif
+constexpr int LENET5_REPLICAS = LENET5_PACKING;
+
+// Compile-time shapes of the LeNet-5 layers (FHEONLayerShapes.h). The network
+// runs the shaped kernels, and lenet5_keys.cpp checks statically that the
+// rotation keys cover each shape's schedule.
+#if LENET5_POLYPHASE
+// conv1 reads the polyphase upload; its output keeps the four phases of each
+// channel apart, so pool1 only adds them before compacting.
+using Lenet5Conv1 = PolyphaseConvShape<28, 6, 5, LENET5_REPLICA_REGION, LENET5_REPLICAS>;
+using Lenet5Pool1 = PolyphaseAvgPoolShape<12, 14, 6>;
+#else
+using Lenet5Conv1 = ReplicatedConvShape<28, 1, 6, 5, LENET5_REPLICA_REGION, LENET5_REPLICAS, false>;
+using Lenet5Pool1 = AvgPoolShape<24, 6, 2>;
+#endif
+using Lenet5Conv2 = ReplicatedConvShape<12, 6, 16, 5, LENET5_REPLICA_REGION, LENET5_REPLICAS, true>;
+using Lenet5Pool2 = AvgPoolShape<8, 16, 2>;
+using Lenet5Fc1 = LinearShape<256, 120, 16>;
+using Lenet5Fc2 = LinearShape<120, 84, 16>;
+using Lenet5Fc3 = LinearShape<84, 10, 16>;
+
+// LeNet-5 parameters. Built once per server process and shared by every
+// inference of the batch. T is Ptext for encoded weights, or Ctext when the
+// model owner keeps the weights encrypted.
+template <typename T>
+struct Lenet5Parameters {
+  vector<vector<T>> conv1_kernel;
+  T conv1_bias;
+  vector<vector<T>> conv2_kernel;
+  T conv2_bias;
+  vector<T> fc1_kernel;
+  T fc1_bias;
+  vector<T> fc2_kernel;
+  T fc2_bias;
+  vector<T> fc3_kernel;
+  T fc3_bias;
+};
+using Lenet5Weights = Lenet5Parameters<Ptext>;
+using Lenet5EncryptedWeights = Lenet5Parameters<Ctext>;
+
+// Rotation indices used by the network (src/lenet5_keys.cpp).
+vector<int> lenet5_rotation_positions(CryptoContext<DCRTPoly> context);
+
+Lenet5Weights lenet5_load_weights(FHEONHEController &fheonHEController);
+Lenet5EncryptedWeights lenet5_encrypt_weights(FHEONHEController &fheonHEController,
+                                              PublicKey<DCRTPoly> &publicKey);
+// Model-owner side of encrypted weights: encrypt them and write them to path.
+void lenet5_write_encrypted_weights(FHEONHEController &fheonHEController,
+                                    PublicKey<DCRTPoly> &publicKey, const string &path);
+// Server side: the ciphertexts written by lenet5_write_encrypted_weights.
+Lenet5EncryptedWeights lenet5_read_encrypted_weights(const string &path);
+Ctext lenet5(FHEONHEController &fheonHEController, CryptoContext<DCRTPoly> &v0,
+             Lenet5Weights &weights, Ctext v1, const Lenet5Plan &plan = Lenet5Plan());
+Ctext lenet5(FHEONHEController &fheonHEController, CryptoContext<DCRTPoly> &v0,
+             Lenet5EncryptedWeights &weights, Ctext v1, const Lenet5Plan &plan = Lenet5Plan());
 Ctext lenet5(FHEONHEController &fheonHEController, CryptoContext<DCRTPoly> &v0, Ctext v1);
 
+// Weights served layer by layer by a provider (pre-encoded or just in time).
+void lenet5_register_weights(FHEONWeightProvider &provider, FHEONHEController &fheonHEController);
+Ctext lenet5(FHEONHEController &fheonHEController, CryptoContext<DCRTPoly> &v0,
+             FHEONWeightProvider &provider, Ctext v1, const Lenet5Plan &plan = Lenet5Plan());
+
+// What one stage of lenet5() took. cpuSeconds covers every thread of the
+// process, so it belongs to the stage only while a single inference runs.
+// savedKeySwitches and reusedMasks count rotations and mask encodes the
+// controller's memos answered without recomputing them.
+struct Lenet5LayerSample {
+  double seconds = 0;
+  double cpuSeconds = 0;
+  size_t savedKeySwitches = 0;
+  size_t reusedMasks = 0;
+};
+
+// Called after each stage of lenet5() (conv1, relu1, ..., "bootstrap" for
+// each bootstrap). Set it once before any inference runs; the servers use it
+// for per-layer metrics.
+using Lenet5LayerObserver = std::function<void(const char *layer, const Lenet5LayerSample &sample)>;
+void lenet5_set_layer_observer(Lenet5LayerObserver observer);
+// Every stage name the observer can be called with, so that per-stage
+// instruments can be created before the first inference.
+const std::vector<std::string> &lenet5_stage_names();
+
+// Tap buffers of each convolution for one inference: ciphertexts held at the
+// peak with every rotated tap materialized, and with the kernel's actual loop
+// order (streamed when the shape's streamTaps holds), at the layer's level.
+// A static estimate: the hoisted-rotation digit buffers are not counted.
+struct Lenet5ConvMemory {
+  const char *layer;
+  int materialized;
+  int held;
+  size_t ciphertextBytes;
+};
+vector<Lenet5ConvMemory> lenet5_conv_memory(CryptoContext<DCRTPoly> &context, const Lenet5Plan &plan = Lenet5Plan());
+
 #endif // ifndef LENET5_FHEON_H_
\ No newline at end of file
@@ -0,0 +1,125 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef LENET5_PLAN_H_
+#define LENET5_PLAN_H_
+// lenet5_plan.h - multiplicative depth of every LeNet-5 layer.
+//
+// The network runs as four segments separated by bootstraps:
+//   0: conv1 -> relu -> pool -> conv2 -> relu
+//   1: pool -> fc1
+//   2: relu -> fc2
+//   3: relu -> fc3
+// Each segment only needs segment_budget() levels. The server drops the towers
+// above that right after bootstrapping, and the client encrypts the upload with
+// just the levels of segment 0.
+//
+// Lenet5Plan::fast() is the bulk path. Its lower-degree ReLU frees levels, and
+// the client flags every sample whose top-1/top-2 logit margin falls below
+// logit_error_bound(). Only those samples are re-run under the default
+// (high-precision) plan.
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// LENET5_POLYPHASE (CMake option) uploads the image in polyphase layout and
+// runs conv1 and pool1 as he_convolution_polyphase / he_avgpool_polyphase.
+// The client and the server must agree on it.
+#ifndef LENET5_POLYPHASE
+#define LENET5_POLYPHASE 1
+#endif
+
+struct Lenet5Plan {
+  int reluScale = 10;
+  int polyDegree = 119;
+  // Extra level kept per segment: FLEXIBLEAUTO rescales lazily, so the last
+  // multiplication of a segment still needs a tower to land on.
+  int levelMargin = 1;
+  // Amplification of one ReLU's approximation error into a logit through the
+  // FC layers. Taking the full relu_error() on every unit of the last two
+  // ReLUs and propagating it as RMS through the shipped FC2/FC3 weights gives
+  // about 28. That over-counts (the full error is only reached near x = 0),
+  // but no fast-vs-slow logit deltas have been measured yet, so the bound
+  // stays at the conservative value until they are.
+  double errorGain = 28.0;
+
+  static Lenet5Plan fast() {
+    Lenet5Plan plan;
+    plan.polyDegree = 59;
+    return plan;
+  }
+
+  // Depth of OpenFHE's Paterson-Stockmeyer Chebyshev evaluation on [-1, 1].
+  static int chebyshev_depth(int degree) {
+    static const int bounds[] = {5, 13, 27, 59, 119, 247, 495, 1007, 2031};
+    int depth = 3;
+    for (int bound : bounds) {
+      if (degree <= bound) return depth;
+      depth++;
+    }
+    return depth;
+  }
+
+  // he_convolution_replicated: kernel taps, row mask, split mask.
+  static int conv_depth() { return 3; }
+  // he_linear: weights, then EvalMerge's selection masks.
+  static int linear_depth() { return 2; }
+  // he_avgpool_optimzed: scale mask, then downsample's first mask, binary
+  // juxtaposition masks and row masks.
+  static int avgpool_depth(int inputWidth, int stride = 2) {
+    int outputWidth = inputWidth / stride;
+    int binaryMasks = 0;
+    for (int s = 1; s < std::log2(outputWidth); s++) binaryMasks++;
+    return 3 + binaryMasks;
+  }
+  // conv1 and pool1 in the configured layout. The polyphase kernels need no
+  // row compaction and no downsampling: taps plus split mask, and the row
+  // plus channel masks.
+  static int conv1_depth() { return LENET5_POLYPHASE ? 2 : conv_depth(); }
+  static int pool1_depth() { return LENET5_POLYPHASE ? 2 : avgpool_depth(24); }
+  // he_relu: input scaling mask, then the Chebyshev approximation.
+  int relu_depth() const {
+    return (reluScale > 1 ? 1 : 0) + chebyshev_depth(polyDegree);
+  }
+
+  std::vector<int> segment_depths() const {
+    return {conv1_depth() + relu_depth() + pool1_depth() + conv_depth() +
+                relu_depth(),
+            avgpool_depth(8) + linear_depth(),
+            relu_depth() + linear_depth(),
+            relu_depth() + linear_depth()};
+  }
+  int segment_budget(int segment) const {
+    return segment_depths()[segment] + levelMargin;
+  }
+
+  // Approximating |x|, and so ReLU, to degree d on [-1, 1] costs about
+  // 1 / (pi * d). relu() evaluates on x / reluScale and scales back up.
+  double relu_error() const {
+    return reluScale / (3.14159265358979 * polyDegree);
+  }
+  // Two logits can swap when each one is off by the per-logit error, so a
+  // margin below twice that error is not trusted.
+  double logit_error_bound() const { return 2 * errorGain * relu_error(); }
+
+  // Encoding level for an upload: the ciphertext keeps only the towers segment
+  // 0 consumes before the first bootstrap refreshes it. `chainTowers` is the
+  // tower count of a fresh ciphertext (multiplicative depth + 1).
+  uint32_t input_level(uint32_t chainTowers) const {
+    int drop = static_cast<int>(chainTowers) - 1 - segment_budget(0);
+    return drop > 0 ? drop : 0;
+  }
+};
+
+#endif  // ifndef LENET5_PLAN_H_
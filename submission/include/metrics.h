@@ -0,0 +1,147 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef METRICS_H_
+#define METRICS_H_
+// metrics.h - counters, gauges and latency histograms for the resident server.
+//
+// Instruments are created once through a MetricsRegistry and then updated
+// with relaxed atomics, so hot paths never take a lock. Values that are cheap
+// to read on demand (RSS, queue depth, key cache occupancy) are set by
+// collectors that run only when the registry is rendered. render() produces
+// the Prometheus text exposition format; MetricsHttpServer serves it on a
+// loopback port and write_file() dumps it for hosts without a scraper.
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "params.h"
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+class Counter {
+ public:
+  void inc(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+};
+
+class Gauge {
+ public:
+  void set(double v) { value_.store(v, std::memory_order_relaxed); }
+  void add(double d);
+  double value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<double> value_{0};
+};
+
+// Cumulative histogram over fixed upper bounds (seconds, for latencies).
+class Histogram {
+ public:
+  explicit Histogram(std::vector<double> bounds);
+  void observe(double v);
+
+  const std::vector<double>& bounds() const { return bounds_; }
+  // Observations <= bounds()[i]; index bounds().size() is +Inf.
+  uint64_t cumulative(size_t i) const;
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  double sum() const { return sum_.load(std::memory_order_relaxed); }
+
+ private:
+  std::vector<double> bounds_;
+  std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+  std::atomic<uint64_t> count_{0};
+  std::atomic<double> sum_{0};
+};
+
+// Latency buckets from 1 ms to 5 min.
+std::vector<double> latency_buckets();
+
+class MetricsRegistry {
+ public:
+  // Return the instrument of that name and labels, creating it on first use.
+  // References stay valid for the registry's lifetime. A name keeps the type
+  // and help text of its first registration.
+  Counter& counter(const std::string& name, const std::string& help,
+                   const MetricLabels& labels = {});
+  Gauge& gauge(const std::string& name, const std::string& help,
+               const MetricLabels& labels = {});
+  Histogram& histogram(const std::string& name, const std::string& help,
+                       const std::vector<double>& bounds,
+                       const MetricLabels& labels = {});
+
+  // Runs before every render, e.g. to refresh gauges from /proc.
+  void add_collector(std::function<void()> collect);
+
+  std::string render();
+  // Writes render() to path atomically (temporary file, then rename).
+  void write_file(const fs::path& path);
+
+ private:
+  enum class Type { kCounter, kGauge, kHistogram };
+  struct Series {
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+  };
+  struct Family {
+    Type type;
+    std::string help;
+    std::map<std::string, Series> series;  // by rendered label set
+  };
+
+  // Called with mutex_ held.
+  Series& series(const std::string& name, const std::string& help, Type type,
+                 const MetricLabels& labels);
+
+  std::mutex mutex_;
+  std::map<std::string, Family> families_;
+  std::vector<std::function<void()>> collectors_;
+};
+
+// Process gauges refreshed at render time: resident and peak RSS.
+void register_process_metrics(MetricsRegistry& registry);
+
+// Serves GET requests on 127.0.0.1:port with the registry's text format, from
+// one background thread. Port 0 picks a free port (see port()).
+class MetricsHttpServer {
+ public:
+  MetricsHttpServer(MetricsRegistry& registry, int port);
+  ~MetricsHttpServer();
+  MetricsHttpServer(const MetricsHttpServer&) = delete;
+  MetricsHttpServer& operator=(const MetricsHttpServer&) = delete;
+
+  int port() const { return port_; }
+
+ private:
+  void serve();
+
+  MetricsRegistry& registry_;
+  int listenFd_ = -1;
+  int port_ = 0;
+  std::atomic<bool> stopping_{false};
+  std::thread thread_;
+};
+
+#endif  // ifndef METRICS_H_
@@ -29,17 +29,47 @@ using PublicKeyT = PublicKey<DCRTPoly>;
 #define MNIST_DIM 784
 #define NORMALIZED_DIM 1024
 
+// Bootstrapping configuration. The servers' EvalBootstrapSetup must match the
+// one client_key_generation made the bootstrapping keys for.
+#define BOOTSTRAP_SLOTS (1 << 12)
+const std::vector<uint32_t> BOOTSTRAP_LEVEL_BUDGET = {4, 4};
+const std::vector<uint32_t> BOOTSTRAP_BSGS_DIM = {0, 0};
+
 struct Sample {
   float image[NORMALIZED_DIM];
 };
 
-ConstCiphertext<DCRTPoly> mlp_encrypt(CryptoContext<DCRTPoly> cc, std::vector<float> input, PublicKey<DCRTPoly> pk);
+// `level` drops that many towers from the fresh ciphertext; see
+// Lenet5Plan::input_level.
+ConstCiphertext<DCRTPoly> mlp_encrypt(CryptoContext<DCRTPoly> cc, std::vector<float> input, PublicKey<DCRTPoly> pk, uint32_t level = 0);
+// Encrypts like mlp_encrypt, from a precomputed encryption of zero at
+// the same level (see zero_pool.h): only the encoding is done here. `zero`
+// must not be used again.
+ConstCiphertext<DCRTPoly> mlp_encrypt_with_zero(CryptoContext<DCRTPoly> cc, const std::vector<float>& input,
+                                                ConstCiphertext<DCRTPoly> zero, uint32_t level = 0);
+// Reorders the first width*width values (one square image) into its four
+// stride-2 phases: pixel (y, x) moves to phase (y%2)*2 + x%2, row y/2,
+// column x/2, each phase (width/2)^2 slots. See PolyphaseConvShape.
+void polyphase_layout(std::vector<float>& image, int width);
 std::vector<float> mlp_decrypt(CryptoContextT v11343, CiphertextT v11344, PrivateKeyT v11345);
 PublicKey<DCRTPoly> read_public_key(const InstanceParams& prms);
 PrivateKey<DCRTPoly> read_secret_key(const InstanceParams& prms);
 CryptoContext<DCRTPoly> read_crypto_context(const InstanceParams& prms);
 void read_eval_keys(const InstanceParams& prms, CryptoContextT cc);
+bool deserialize_eval_automorphism_keys(std::istream& in, CryptoContextT cc);
 void load_dataset(std::vector<Sample> &dataset, const char *filename);
 int argmax(float *A, int N);
+// Top-1 minus top-2 of A[0..N).
+float top2_margin(float *A, int N);
+// Cascade mode: an MLP result whose top-1/top-2 margin over the ten classes
+// is below this is sent on to LeNet-5 (client_decrypt_decode --cascade).
+#define MLP_CASCADE_MARGIN 4.0f
+#define MNIST_CLASSES 10
+// Rotation steps of the prebuilt mlp(): 1..1023, the diagonals of its two
+// 1024x1024 matrix products.
+std::vector<int> mlp_rotation_positions();
+// One sample index per line.
+std::vector<size_t> read_sample_list(const fs::path& file);
+void write_sample_list(const fs::path& file, const std::vector<size_t>& samples);
 
 #endif  // ifndef MLP_ENCRYPTION_UTILS_H_
\ No newline at end of file
@@ -0,0 +1,73 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef NUMA_KEYS_H_
+#define NUMA_KEYS_H_
+// numa_keys.h - one copy of the evaluation keys per NUMA node.
+//
+// Key switching streams the whole rotation or relinearization key through
+// memory. On a multi-socket host, a worker on one socket reading keys
+// allocated on another is limited by the inter-socket link. NumaKeyReplicas
+// loads an extra copy of mk.bin and rk.bin for every node but the first. Each
+// copy is deserialized by a thread pinned to its node, with its memory policy
+// bound there, so the pages are first touched locally.
+//
+// OpenFHE finds evaluation keys by the key tag of the ciphertext. Each replica
+// is therefore registered under its own tag. A worker pins itself with
+// pin_thread_to_node() and retags its input ciphertext with tag(node); the
+// result must be retagged with the original tag before it is returned.
+// Node 0 uses the keys already loaded under the original tag, so the caller
+// should load those from a thread pinned to node 0.
+
+#include <string>
+#include <vector>
+
+#include "openfhe.h"
+#include "params.h"
+
+using namespace lbcrypto;
+
+struct NumaNode {
+  int id = 0;
+  std::vector<int> cpus;
+};
+
+// Online nodes that have CPUs, from /sys/devices/system/node. A host without
+// NUMA information is reported as a single node holding every CPU.
+std::vector<NumaNode> numa_nodes();
+
+// Restricts the calling thread (and the OpenMP threads it creates later) to
+// the node's CPUs.
+void pin_thread_to_node(const NumaNode& node);
+
+class NumaKeyReplicas {
+ public:
+  // Must not run concurrently with encrypted evaluation: it inserts into
+  // OpenFHE's global key maps.
+  NumaKeyReplicas(const fs::path& keyDir, CryptoContext<DCRTPoly> cc,
+                  const std::string& baseTag);
+  ~NumaKeyReplicas();
+  NumaKeyReplicas(const NumaKeyReplicas&) = delete;
+  NumaKeyReplicas& operator=(const NumaKeyReplicas&) = delete;
+
+  size_t nodes() const { return nodes_.size(); }
+  const NumaNode& node(size_t i) const { return nodes_[i]; }
+  // Key tag of node i's replica; tag(0) is the original tag.
+  const std::string& tag(size_t i) const { return tags_[i]; }
+
+ private:
+  std::vector<NumaNode> nodes_;
+  std::vector<std::string> tags_;
+};
+
+#endif  // ifndef NUMA_KEYS_H_
@@ -76,6 +76,10 @@ public:
     fs::path dataintermdir() const { return datadir() / "intermediate"; }
     fs::path test_input_file() const { return dataintermdir()/"test_pixels.txt"; }
     fs::path encrypted_model_predictions_file() const { return iodir()/"encrypted_model_predictions.txt"; }
+    // Samples whose fast-path result is too close to call; see lenet5_plan.h.
+    fs::path rerun_samples_file() const { return iodir()/"rerun_samples.txt"; }
+    // Model weights encrypted by the model owner (model_encrypt_weights).
+    fs::path encrypted_weights_file() const { return iodir()/"encrypted_weights.bin"; }
 };
 
 #endif  // ifndef PARAMS_H_
\ No newline at end of file
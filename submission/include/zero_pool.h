@@ -0,0 +1,67 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ZERO_POOL_H_
+#define ZERO_POOL_H_
+// zero_pool.h - precomputed public-key encryptions of zero.
+//
+// A public-key CKKS encryption is (v*pk0 + e0 + m, v*pk1 + e1). Everything
+// except the encoded message m is independent of the input, and it costs
+// most of the encryption time: sampling v, e0, e1 and multiplying per tower.
+// client_precompute_zeros produces Enc(0) ciphertexts ahead of time. The
+// online step then only encodes the image and adds it to one of them (see
+// mlp_encrypt_with_zero).
+//
+// Each encryption of zero must be used at most once. Two ciphertexts sharing
+// one would differ by exactly the difference of their images. The pool is
+// kept in the client-private key directory, with owner-only permissions.
+// Entries are claimed by renaming them, so two clients drawing from the same
+// pool never get the same entry, and they are deleted after use. An
+// interrupted client leaves claimed entries behind, and those are never
+// handed out again. The pool directory is named after the public key, so a
+// new key never picks up encryptions made under the old one.
+
+#include <string>
+#include <vector>
+
+#include "io_backend.h"
+#include "openfhe.h"
+#include "params.h"
+
+using namespace lbcrypto;
+
+class ZeroEncryptionPool {
+ public:
+  // Pool of encryptions under the key in publicKeyFile, `level` towers
+  // dropped (see Lenet5Plan::input_level), under root.
+  ZeroEncryptionPool(const fs::path& root, const fs::path& publicKeyFile,
+                     uint32_t level);
+
+  // Adds `count` encryptions of zero; returns the resulting pool size.
+  size_t fill(CryptoContext<DCRTPoly> cc, const PublicKey<DCRTPoly>& pk,
+              size_t count, IoBackend& io);
+  // Entries available to claim.
+  size_t size() const;
+  // Claims up to `count` entries for this process and returns their files.
+  // The caller reads them and must remove them with release().
+  std::vector<fs::path> claim(size_t count);
+  void release(const std::vector<fs::path>& claimed);
+
+  const fs::path& dir() const { return dir_; }
+
+ private:
+  fs::path dir_;
+  uint32_t level_;
+};
+
+#endif  // ifndef ZERO_POOL_H_
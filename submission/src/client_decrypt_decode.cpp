@@ -15,6 +15,8 @@
 #include "iomanip"
 #include "limits"
 
+#include "io_backend.h"
+#include "lenet5_plan.h"
 #include "mlp_encryption_utils.h"
 
 using namespace lbcrypto;
@@ -22,12 +24,27 @@ using namespace lbcrypto;
 
 int main(int argc, char* argv[]) {
     if (argc < 2 || !std::isdigit(argv[1][0])) {
-        std::cout << "Usage: " << argv[0] << " instance-size [--count_only]\n";
+        std::cout << "Usage: " << argv[0] << " instance-size [--count_only] [--rerun | --cascade [--cascade-margin M]]\n";
         std::cout << "  Instance-size: 0-SINGLE, 1-SMALL, 2-MEDIUM, 3-LARGE\n";
+        std::cout << "  --rerun: replace the flagged predictions with the high-precision results\n";
+        std::cout << "  --cascade: decode MLP results and flag those below margin M (default "
+                  << MLP_CASCADE_MARGIN << ") for LeNet-5\n";
         return 0;
     }
     auto size = static_cast<InstanceSize>(std::stoi(argv[1]));
     InstanceParams prms(size);
+    bool rerun = false;
+    bool cascade = false;
+    float cascadeMargin = MLP_CASCADE_MARGIN;
+    for (int a = 2; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg == "--count_only") continue;
+        if (arg == "--rerun") rerun = true;
+        else if (arg == "--cascade") cascade = true;
+        else if (arg != "--cascade-margin") throw std::runtime_error("Unknown option " + arg);
+        else if (a + 1 == argc) throw std::runtime_error(arg + " needs a value");
+        else cascadeMargin = std::stof(argv[++a]);
+    }
 
     CryptoContext<DCRTPoly> cc;
     if (!Serial::DeserializeFromFile(prms.pubkeydir()/"cc.bin", cc,
@@ -42,15 +59,54 @@ int main(int argc, char* argv[]) {
     Ciphertext<DCRTPoly> ctxt;     
     std::vector<float> output;
     auto result_path = prms.encrypted_model_predictions_file();
-    std::ofstream out(result_path);
-    for (size_t i = 0; i < prms.getBatchSize(); ++i) {
-        auto ctxt_path = prms.ctxtdowndir()/("cipher_result_" + std::to_string(i) + ".bin");
-        if (!Serial::DeserializeFromFile(ctxt_path, ctxt, SerType::BINARY)) {
-            throw std::runtime_error("Failed to get ciphertext from " + ctxt_path.string());
+
+    std::vector<size_t> samples;
+    std::vector<int> predictions(prms.getBatchSize(), 0);
+    if (rerun) {
+        samples = read_sample_list(prms.rerun_samples_file());
+        std::ifstream in(result_path);
+        for (auto& p : predictions) in >> p;
+    } else {
+        for (size_t i = 0; i < prms.getBatchSize(); ++i) samples.push_back(i);
+    }
+
+    // Fast-path results whose top-1/top-2 margin is within the plan's error
+    // bound may have been flipped by CKKS error; they are re-run. In a
+    // cascade the bound is the MLP's confidence margin instead. The margin
+    // is taken over the ten classes only: padded slots hold near-zero
+    // values that would cap it.
+    const float bound = cascade ? cascadeMargin : Lenet5Plan::fast().logit_error_bound();
+    std::vector<size_t> flagged;
+    auto io = make_io_backend();
+    for (size_t first = 0; first < samples.size(); first += kIoBatchSize) {
+        size_t last = std::min(first + kIoBatchSize, samples.size());
+        std::vector<IoRequest> reads(last - first);
+        for (size_t n = first; n < last; ++n) {
+            reads[n - first].path = prms.ctxtdowndir()/("cipher_result_" + std::to_string(samples[n]) + ".bin");
         }
-        output = mlp_decrypt(cc, ctxt, sk);
-        auto max_id = argmax(output.data(), 1024);
-        out << max_id << '\n';
+        io->read_batch(reads);
+        for (size_t n = first; n < last; ++n) {
+            deserialize_binary(reads[n - first].data, ctxt, reads[n - first].path.string());
+            output = mlp_decrypt(cc, ctxt, sk);
+            predictions[samples[n]] = argmax(output.data(), MNIST_CLASSES);
+            if (!rerun && top2_margin(output.data(), MNIST_CLASSES) < bound) {
+                flagged.push_back(samples[n]);
+            }
+        }
+    }
+
+    std::ofstream out(result_path);
+    for (int p : predictions) {
+        out << p << '\n';
+    }
+    if (rerun) {
+        std::cout << "         [client] Replaced " << samples.size()
+                  << " predictions with high-precision results" << std::endl;
+    } else {
+        write_sample_list(prms.rerun_samples_file(), flagged);
+        std::cout << "         [client] " << flagged.size() << " of " << samples.size()
+                  << (cascade ? " MLP" : "") << " results below margin " << bound
+                  << ", flagged for " << (cascade ? "LeNet-5" : "re-run") << std::endl;
     }
 
     return 0;
@@ -11,20 +11,33 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include "io_backend.h"
+#include "lenet5_plan.h"
 #include "mlp_encryption_utils.h"
 #include "utils.h"
+#include "zero_pool.h"
+#include <chrono>
 
 using namespace lbcrypto;
 
 int main(int argc, char *argv[]) {
 
   if (argc < 2 || !std::isdigit(argv[1][0])) {
-    std::cout << "Usage: " << argv[0] << " instance-size [--count_only]\n";
+    std::cout << "Usage: " << argv[0] << " instance-size [--count_only] [--rerun | --cascade]\n";
     std::cout << "  Instance-size: 0-SINGLE, 1-SMALL, 2-MEDIUM, 3-LARGE\n";
+    std::cout << "  --rerun: re-encrypt the flagged samples for the high-precision plan\n";
+    std::cout << "  --cascade: encrypt the batch for the MLP stage of the cascade\n";
+    std::cout << "  Uses encryptions of zero from client_precompute_zeros while any are left\n";
     return 0;
   }
   auto size = static_cast<InstanceSize>(std::stoi(argv[1]));
   InstanceParams prms(size);
+  bool rerun = false;
+  bool cascade = false;
+  for (int a = 2; a < argc; ++a) {
+    if (std::string(argv[a]) == "--rerun") rerun = true;
+    if (std::string(argv[a]) == "--cascade") cascade = true;
+  }
 
   CryptoContext<DCRTPoly> cc = read_crypto_context(prms);
 
@@ -42,19 +55,74 @@ int main(int argc, char *argv[]) {
     throw std::runtime_error("Dataset size does not match instance size");
   }
 
+  // Encrypt only the levels lenet5 consumes before its first bootstrap, under
+  // the plan the server will run. The MLP takes a fresh ciphertext in the
+  // plain row-major layout.
+  Lenet5Plan plan = rerun ? Lenet5Plan() : Lenet5Plan::fast();
+  uint32_t chainTowers =
+      cc->GetCryptoParameters()->GetElementParams()->GetParams().size();
+  uint32_t level = cascade ? 0 : plan.input_level(chainTowers);
+
+  std::vector<size_t> samples;
+  if (rerun) {
+    samples = read_sample_list(prms.rerun_samples_file());
+  } else {
+    for (size_t i = 0; i < dataset.size(); ++i) samples.push_back(i);
+  }
+
   std::shared_ptr<const CiphertextImpl<DCRTPoly>> ctxt;
   fs::create_directories(prms.ctxtupdir());
-  for (size_t i = 0; i < dataset.size(); ++i) {
-    auto *input = dataset[i].image;
-    std::vector<float> input_vector(input, input + NORMALIZED_DIM);
-    // Apply Normalization: (x - 0.1307) / 0.3081
-    for (auto &val : input_vector) {
-      val = (val - 0.1307f) / 0.3081f;
+  auto io = make_io_backend();
+  // Online phase: samples that get a precomputed encryption of zero are only
+  // encoded and added to it; the rest are encrypted inline.
+  ZeroEncryptionPool zeros(prms.seckeydir() / "zero_pool",
+                           prms.pubkeydir() / "pk.bin", level);
+  size_t pooled = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t first = 0; first < samples.size(); first += kIoBatchSize) {
+    size_t last = std::min(first + kIoBatchSize, samples.size());
+    std::vector<fs::path> claimed = zeros.claim(last - first);
+    std::vector<IoRequest> zeroReads(claimed.size());
+    for (size_t z = 0; z < claimed.size(); ++z) zeroReads[z].path = claimed[z];
+    if (!zeroReads.empty()) io->read_batch(zeroReads);
+    zeros.release(claimed);
+    pooled += claimed.size();
+
+    std::vector<IoRequest> writes;
+    for (size_t n = first; n < last; ++n) {
+      size_t i = samples[n];
+      auto *input = dataset[i].image;
+      std::vector<float> input_vector(input, input + NORMALIZED_DIM);
+      // Apply Normalization: (x - 0.1307) / 0.3081
+      for (auto &val : input_vector) {
+        val = (val - 0.1307f) / 0.3081f;
+      }
+      if (LENET5_POLYPHASE && !cascade) {
+        polyphase_layout(input_vector, 28);
+      }
+      if (n - first < zeroReads.size()) {
+        Ciphertext<DCRTPoly> zero;
+        deserialize_binary(zeroReads[n - first].data, zero, zeroReads[n - first].path.string());
+        zeroReads[n - first].data.clear();
+        ctxt = mlp_encrypt_with_zero(cc, input_vector, zero, level);
+      } else {
+        ctxt = mlp_encrypt(cc, input_vector, pk, level);
+      }
+      IoRequest req;
+      req.path =
+          prms.ctxtupdir() / ("cipher_input_" + std::to_string(i) + ".bin");
+      req.data = serialize_binary(ctxt);
+      writes.push_back(std::move(req));
     }
-    ctxt = mlp_encrypt(cc, input_vector, pk);
-    auto ctxt_path =
-        prms.ctxtupdir() / ("cipher_input_" + std::to_string(i) + ".bin");
-    Serial::SerializeToFile(ctxt_path, ctxt, SerType::BINARY);
+    io->write_batch(writes);
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  if (pooled > 0) {
+    std::cout << "         [client] " << pooled << " of " << samples.size()
+              << " inputs used precomputed encryptions of zero ("
+              << zeros.size() << " left); "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+              << " ms in total" << std::endl;
   }
 
   return 0;
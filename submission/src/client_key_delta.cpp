@@ -0,0 +1,90 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Generates only the rotation keys the current model plan needs and the
+// server's key store (keys.manifest) does not have yet. The result,
+// rk_delta.bin + delta.manifest, is merged on the server by server_merge_keys.
+
+#include "key_store.h"
+#include "lenet5_fheon.h"
+#include "mlp_encryption_utils.h"
+#include "utils.h"
+
+using namespace lbcrypto;
+
+int main(int argc, char *argv[]) {
+
+  if (argc < 2 || !std::isdigit(argv[1][0])) {
+    std::cout << "Usage: " << argv[0] << " instance-size [server-manifest] [--cascade]\n";
+    std::cout << "  Instance-size: 0-SINGLE, 1-SMALL, 2-MEDIUM, 3-LARGE\n";
+    std::cout << "  --cascade: the plan includes the MLP stage\n";
+    return 0;
+  }
+  auto size = static_cast<InstanceSize>(std::stoi(argv[1]));
+  InstanceParams prms(size);
+  fs::path keyDir = prms.pubkeydir();
+  fs::path serverManifest = keyDir / KEY_MANIFEST_FILE;
+  bool cascade = false;
+  for (int a = 2; a < argc; ++a) {
+    std::string arg = argv[a];
+    if (arg == "--cascade") {
+      cascade = true;
+    } else {
+      serverManifest = arg;
+    }
+  }
+
+  CryptoContext<DCRTPoly> cc = read_crypto_context(prms);
+  PrivateKey<DCRTPoly> sk = read_secret_key(prms);
+
+  KeyManifest want;
+  want.context = context_fingerprint(keyDir / "cc.bin", sk->GetKeyTag());
+  want.groups = {"mult", "bootstrap", "sum"};
+  auto rotPositions = lenet5_rotation_positions(cc);
+  want.rotations.insert(rotPositions.begin(), rotPositions.end());
+  if (cascade) {
+    auto mlpPositions = mlp_rotation_positions();
+    want.rotations.insert(mlpPositions.begin(), mlpPositions.end());
+  }
+
+  KeyManifest have = read_key_manifest(serverManifest);
+  KeyManifestDiff diff = diff_key_manifests(have, want);
+  if (!diff.same_context || !diff.missing_groups.empty()) {
+    std::cerr << "[client] server keys belong to another context or lack "
+                 "base key groups; run client_key_generation instead"
+              << std::endl;
+    return 1;
+  }
+  std::cout << "         [client] " << diff.missing_rotations.size()
+            << " rotation keys missing, " << diff.unused_rotations.size()
+            << " unused on the server" << std::endl;
+  if (diff.missing_rotations.empty()) {
+    return 0;
+  }
+
+  std::ofstream delta_file(keyDir / KEY_DELTA_FILE,
+                           std::ios::out | std::ios::binary);
+  if (!delta_file.is_open()) {
+    throw std::runtime_error("Failed to write key delta to " +
+                             keyDir.string());
+  }
+  write_rotation_keys(cc, sk, diff.missing_rotations, delta_file);
+
+  KeyManifest delta;
+  delta.context = want.context;
+  delta.rotations.insert(diff.missing_rotations.begin(),
+                         diff.missing_rotations.end());
+  write_key_manifest(keyDir / KEY_DELTA_MANIFEST_FILE, delta);
+  return 0;
+}
@@ -12,13 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "FHEONHEController.h"
+#include "key_store.h"
+#include "lenet5_fheon.h"
 #include "mlp_encryption_utils.h"
 #include "utils.h"
 
-vector<uint32_t> levelBudget = {4, 4};
-vector<uint32_t> bsgsDim = {0, 0};
-int numSlots = 1 << 12;
-
 CryptoContextT generate_crypto_context() {
 
     int ringDim = 1 << 13;
@@ -28,14 +26,14 @@ CryptoContextT generate_crypto_context() {
     int digitSize = 4;
     lbcrypto::SecretKeyDist secretKeyDist = lbcrypto::SPARSE_TERNARY;
     int circuitDepth = modelDepth + lbcrypto::FHECKKSRNS::GetBootstrapDepth(
-                                        levelBudget, secretKeyDist);
+                                        BOOTSTRAP_LEVEL_BUDGET, secretKeyDist);
 
     CCParamsT parameters;
     parameters.SetMultiplicativeDepth(circuitDepth);
     parameters.SetSecurityLevel(HEStd_NotSet);
     // parameters.SetSecurityLevel(HEstd_128_classic);
     parameters.SetRingDim(ringDim);
-    parameters.SetBatchSize(numSlots);
+    parameters.SetBatchSize(BOOTSTRAP_SLOTS);
     parameters.SetScalingModSize(dcrtBits);
     parameters.SetFirstModSize(firstMod);
     parameters.SetNumLargeDigits(digitSize);
@@ -51,34 +49,76 @@ CryptoContextT generate_crypto_context() {
     return context;
 }
 
-CryptoContextT generate_mult_rot_key(CryptoContextT context,
-                                     PrivateKeyT secretKey) {
+/*
+ * Generate the evaluation keys one group at a time and write every group out
+ * before generating the next, so the client never holds the whole key set:
+ * relinearization key, bootstrapping keys, EvalSum keys, then one rotation key
+ * per index, and record them in keys.manifest. rk.bin becomes a sequence of serialized key maps that
+ * deserialize_eval_automorphism_keys merges back together on the server.
+ * The bootstrapping keys are produced by a single OpenFHE call and form the
+ * largest group; peak memory is bounded by that group, not by the rotations.
+ * With `cascade` the rotations of the prebuilt MLP are added as well. */
+void write_eval_keys(CryptoContextT context, PrivateKeyT secretKey,
+                     const fs::path& keyDir, bool cascade) {
+
+    const string tag = secretKey->GetKeyTag();
+    ofstream emult_file(keyDir / "mk.bin", ios::out | ios::binary);
+    ofstream erot_file(keyDir / "rk.bin", ios::out | ios::binary);
+    if (!emult_file.is_open() || !erot_file.is_open()) {
+        throw runtime_error("Failed to write eval keys to " + keyDir.string());
+    }
 
     context->EvalMultKeyGen(secretKey);
-    vector<int> rotPositions = {
-        -2880, -2304, -1728, -1152, -960, -896, -864, -832, -768, -720, -704,
-        -640,  -576,  -552,  -528,  -512,  -504,  -480,  -456,  -448,  -432,
-        -408,  -384,  -360,  -336,  -320,  -312,  -288,  -264,  -256,  -240,
-        -224,  -216,  -208,  -192,  -176,  -168,  -160,  -144,  -128,  -120,
-        -112,  -104,  -96,   -88,   -80,   -72,   -64,   -56,   -48,   -40,
-        -32,   -24,   -16,   -15,   -14,   -13,   -12,   -11,   -10,   -9,
-        -8,     -1,     1,     2,     3,     4,     5,     6,     7,    8,  
-        9,      10,    11,    12,    13,    14,    15,    16,    24,    28,
-        36,    48,     64,    144,   432,   576,   784
+    if (!context->SerializeEvalMultKey(emult_file, SerType::BINARY, tag)) {
+        throw runtime_error("Failed to write eval keys to " + keyDir.string());
+    }
+    context->ClearEvalMultKeys(tag);
+
+    auto flush_automorphism_keys = [&]() {
+        if (!context->SerializeEvalAutomorphismKey(erot_file, SerType::BINARY, tag)) {
+            throw runtime_error("Failed to write eval keys to " + keyDir.string());
+        }
+        context->ClearEvalAutomorphismKeys(tag);
     };
-    context->EvalRotateKeyGen(secretKey, rotPositions);
-    return context;
+
+    context->EvalBootstrapSetup(BOOTSTRAP_LEVEL_BUDGET, BOOTSTRAP_BSGS_DIM, BOOTSTRAP_SLOTS);
+    context->EvalBootstrapKeyGen(secretKey, BOOTSTRAP_SLOTS);
+    flush_automorphism_keys();
+
+    context->EvalSumKeyGen(secretKey);
+    flush_automorphism_keys();
+
+    vector<int> rotPositions = lenet5_rotation_positions(context);
+    if (cascade) {
+        for (int rot : mlp_rotation_positions()) {
+            rotPositions.push_back(rot);
+        }
+        sort(rotPositions.begin(), rotPositions.end());
+        rotPositions.erase(unique(rotPositions.begin(), rotPositions.end()), rotPositions.end());
+    }
+    write_rotation_keys(context, secretKey, rotPositions, erot_file);
+
+    KeyManifest manifest;
+    manifest.context = context_fingerprint(keyDir / "cc.bin", tag);
+    manifest.groups = {"mult", "bootstrap", "sum"};
+    manifest.rotations.insert(rotPositions.begin(), rotPositions.end());
+    write_key_manifest(keyDir / KEY_MANIFEST_FILE, manifest);
 }
 
 int main(int argc, char *argv[]) {
 
     if (argc < 2 || !isdigit(argv[1][0])) {
-        cout << "Usage: " << argv[0] << " instance-size [--count_only]\n";
+        cout << "Usage: " << argv[0] << " instance-size [--count_only] [--cascade]\n";
         cout << "  Instance-size: 0-SINGLE, 1-SMALL, 2-MEDIUM, 3-LARGE\n";
+        cout << "  --cascade: also generate the rotation keys of the MLP stage\n";
         return 0;
     }
     auto size = static_cast<InstanceSize>(stoi(argv[1]));
     InstanceParams prms(size);
+    bool cascade = false;
+    for (int a = 2; a < argc; ++a) {
+        if (string(argv[a]) == "--cascade") cascade = true;
+    }
 
     // Step 1: Setup CryptoContext
     auto cryptoContext = generate_crypto_context();
@@ -86,18 +126,8 @@ int main(int argc, char *argv[]) {
     // Step 2: Key Generation
     // cout << "Starting KeyGen..." << endl;
     auto keyPair = cryptoContext->KeyGen();
-    // cout << "KeyGen done. Starting EvalMultKeyGen..." << endl;
-    cryptoContext = generate_mult_rot_key(cryptoContext, keyPair.secretKey);
-    // cout << "EvalMultKeyGen done." << endl;
-
-    // Step 4: Bootstrap key generation
-    cryptoContext->EvalBootstrapSetup(levelBudget, bsgsDim, numSlots);
-    cryptoContext->EvalBootstrapKeyGen(keyPair.secretKey, numSlots);
-    // cout << "Bootstrap KeyGen done." << endl;
 
-    cryptoContext->EvalSumKeyGen(keyPair.secretKey);
-
-    // Step 3: Serialize cryptocontext and keys
+    // Step 3: Serialize cryptocontext and public key
     fs::create_directories(prms.pubkeydir());
     // cout << "Serializing CC and PK..." << endl;
 
@@ -108,18 +138,9 @@ int main(int argc, char *argv[]) {
         throw runtime_error("Failed to write keys to " +
                                 prms.pubkeydir().string());
     }
-    // cout << "CC and PK serialized. Serializing Eval Keys..." << endl;
-    ofstream emult_file(prms.pubkeydir() / "mk.bin",
-                            ios::out | ios::binary);
-    ofstream erot_file(prms.pubkeydir() / "rk.bin",
-                            ios::out | ios::binary);
-    if (!emult_file.is_open() || !erot_file.is_open() ||
-        !cryptoContext->SerializeEvalMultKey(emult_file, SerType::BINARY) ||
-        !cryptoContext->SerializeEvalAutomorphismKey(erot_file,
-                                                    SerType::BINARY)) {
-        throw runtime_error("Failed to write eval keys to " +
-                                prms.pubkeydir().string());
-    }
+
+    // Step 4: Generate and stream out the evaluation keys
+    write_eval_keys(cryptoContext, keyPair.secretKey, prms.pubkeydir(), cascade);
     // cout << "Eval Keys serialized. Serializing Secret Key..." << endl;
 
     fs::create_directories(prms.seckeydir());
@@ -0,0 +1,75 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Offline half of input encryption: fills the client's pool of encryptions of
+// zero (zero_pool.h) at the level client_encode_encrypt_input will use. Run
+// while the client is idle; the online step then only encodes and adds.
+
+#include "io_backend.h"
+#include "lenet5_plan.h"
+#include "mlp_encryption_utils.h"
+#include "utils.h"
+#include "zero_pool.h"
+#include <chrono>
+
+using namespace lbcrypto;
+
+int main(int argc, char *argv[]) {
+
+  if (argc < 2 || !std::isdigit(argv[1][0])) {
+    std::cout << "Usage: " << argv[0] << " instance-size [--count N] [--rerun]\n";
+    std::cout << "  Instance-size: 0-SINGLE, 1-SMALL, 2-MEDIUM, 3-LARGE\n";
+    std::cout << "  --count N: encryptions to add (default: the batch size)\n";
+    std::cout << "  --rerun: fill the pool for the high-precision plan instead\n";
+    return 0;
+  }
+  auto size = static_cast<InstanceSize>(std::stoi(argv[1]));
+  InstanceParams prms(size);
+  bool rerun = false;
+  size_t count = prms.getBatchSize();
+  for (int a = 2; a < argc; ++a) {
+    std::string arg = argv[a];
+    if (arg == "--rerun") {
+      rerun = true;
+    } else if (arg != "--count") {
+      throw std::runtime_error("Unknown option " + arg);
+    } else if (a + 1 == argc) {
+      throw std::runtime_error(arg + " needs a value");
+    } else {
+      count = std::stoul(argv[++a]);
+    }
+  }
+
+  CryptoContext<DCRTPoly> cc = read_crypto_context(prms);
+  PublicKey<DCRTPoly> pk = read_public_key(prms);
+
+  // Same level as client_encode_encrypt_input under the same plan.
+  Lenet5Plan plan = rerun ? Lenet5Plan() : Lenet5Plan::fast();
+  uint32_t chainTowers =
+      cc->GetCryptoParameters()->GetElementParams()->GetParams().size();
+  uint32_t level = plan.input_level(chainTowers);
+
+  ZeroEncryptionPool zeros(prms.seckeydir() / "zero_pool",
+                           prms.pubkeydir() / "pk.bin", level);
+  auto io = make_io_backend();
+  auto start = std::chrono::high_resolution_clock::now();
+  size_t total = zeros.fill(cc, pk, count, *io);
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << "         [client] Precomputed " << count
+            << " encryptions of zero in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+            << " ms; pool " << zeros.dir().string() << " holds " << total
+            << std::endl;
+  return 0;
+}
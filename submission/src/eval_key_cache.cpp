@@ -0,0 +1,209 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "utils.h"
+#include "eval_key_cache.h"
+#include "mlp_encryption_utils.h"
+#include <fstream>
+
+EvalKeyCache::Lease::Lease(Lease&& other) noexcept
+    : cache_(other.cache_),
+      tenant_(std::move(other.tenant_)),
+      tag_(std::move(other.tag_)) {
+  other.cache_ = nullptr;
+}
+
+EvalKeyCache::Lease& EvalKeyCache::Lease::operator=(Lease&& other) noexcept {
+  if (this != &other) {
+    release();
+    cache_ = other.cache_;
+    tenant_ = std::move(other.tenant_);
+    tag_ = std::move(other.tag_);
+    other.cache_ = nullptr;
+  }
+  return *this;
+}
+
+EvalKeyCache::Lease::~Lease() { release(); }
+
+void EvalKeyCache::Lease::release() {
+  if (cache_ != nullptr) {
+    cache_->release(tenant_);
+    cache_ = nullptr;
+  }
+}
+
+EvalKeyCache::~EvalKeyCache() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (!entries_.empty()) {
+    evict(entries_.begin());
+  }
+}
+
+EvalKeyCache::Lease EvalKeyCache::acquire(const std::string& tenant,
+                                          const fs::path& keyDir,
+                                          CryptoContext<DCRTPoly> cc) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this] { return !writing_ && writersWaiting_ == 0; });
+  auto it = entries_.find(tenant);
+  if (it != entries_.end()) {
+    return pin(it);
+  }
+
+  begin_write(lock);
+  // Another miss for the same tenant may have loaded it while this one waited.
+  it = entries_.find(tenant);
+  if (it != entries_.end()) {
+    end_write();
+    return pin(it);
+  }
+
+  try {
+    // Keys are charged by their serialized size, which tracks the resident
+    // DCRTPoly size closely (both are towers of 64-bit words).
+    size_t bytes = fs::file_size(keyDir / "mk.bin") + fs::file_size(keyDir / "rk.bin");
+    if (bytes > budget_) {
+      throw KeyCacheAdmissionError("Evaluation keys of " + tenant + " (" +
+                                   std::to_string(bytes) +
+                                   " bytes) exceed the key cache budget");
+    }
+    // No lease is held while writing, so every resident tenant is idle.
+    if (!make_room(bytes)) {
+      throw KeyCacheAdmissionError("Key cache cannot admit " + tenant);
+    }
+
+    PublicKey<DCRTPoly> pk;
+    if (!Serial::DeserializeFromFile(keyDir / "pk.bin", pk, SerType::BINARY)) {
+      throw std::runtime_error("Failed to get public key from " + keyDir.string());
+    }
+
+    // Hits and other misses wait on writing_, so the bookkeeping mutex can
+    // be dropped for the slow part.
+    lock.unlock();
+    bool ok = false;
+    {
+      std::ifstream emult_file(keyDir / "mk.bin", std::ios::in | std::ios::binary);
+      std::ifstream erot_file(keyDir / "rk.bin", std::ios::in | std::ios::binary);
+      try {
+        ok = emult_file.is_open() && erot_file.is_open() &&
+             cc->DeserializeEvalMultKey(emult_file, SerType::BINARY) &&
+             deserialize_eval_automorphism_keys(erot_file, cc);
+      } catch (const std::exception&) {
+        ok = false;
+      }
+    }
+    lock.lock();
+    if (!ok) {
+      // Drop whatever part of the keys did load.
+      CryptoContextImpl<DCRTPoly>::ClearEvalMultKeys(pk->GetKeyTag());
+      CryptoContextImpl<DCRTPoly>::ClearEvalAutomorphismKeys(pk->GetKeyTag());
+      throw std::runtime_error("Failed to get evaluation keys from " + keyDir.string());
+    }
+
+    lru_.push_front(tenant);
+    Entry& entry = entries_[tenant];
+    entry.tag = pk->GetKeyTag();
+    entry.bytes = bytes;
+    entry.lru = lru_.begin();
+    used_ += bytes;
+    end_write();
+    return pin(entries_.find(tenant));
+  } catch (...) {
+    if (!lock.owns_lock()) lock.lock();
+    end_write();
+    throw;
+  }
+}
+
+size_t EvalKeyCache::evict_idle() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  begin_write(lock);
+  size_t freed = used_;
+  while (!entries_.empty()) {
+    evict(entries_.begin());
+  }
+  end_write();
+  return freed;
+}
+
+size_t EvalKeyCache::resident_bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return used_;
+}
+
+size_t EvalKeyCache::resident_tenants() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+void EvalKeyCache::release(const std::string& tenant) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(tenant);
+    if (it != entries_.end() && it->second.refs > 0) {
+      it->second.refs--;
+    }
+    readers_--;
+  }
+  changed_.notify_all();
+}
+
+// Called with mutex_ held.
+EvalKeyCache::Lease EvalKeyCache::pin(std::unordered_map<std::string, Entry>::iterator it) {
+  it->second.refs++;
+  readers_++;
+  lru_.splice(lru_.begin(), lru_, it->second.lru);
+  return Lease(this, it->first, it->second.tag);
+}
+
+// Called with mutex_ held. New acquires stop at writersWaiting_, so the
+// in-flight leases drain instead of being replaced forever.
+void EvalKeyCache::begin_write(std::unique_lock<std::mutex>& lock) {
+  writersWaiting_++;
+  changed_.wait(lock, [this] { return !writing_ && readers_ == 0; });
+  writersWaiting_--;
+  writing_ = true;
+}
+
+// Called with mutex_ held.
+void EvalKeyCache::end_write() {
+  writing_ = false;
+  changed_.notify_all();
+}
+
+// Evicts idle tenants from the cold end of the LRU list until `bytes` fit.
+// Called by the writer with mutex_ held.
+bool EvalKeyCache::make_room(size_t bytes) {
+  auto victim = lru_.end();
+  while (budget_ - used_ < bytes && victim != lru_.begin()) {
+    --victim;
+    auto it = entries_.find(*victim);
+    if (it->second.refs > 0) {
+      continue;
+    }
+    // evict() erases the list node, so step forward first.
+    ++victim;
+    evict(it);
+  }
+  return budget_ - used_ >= bytes;
+}
+
+// Called by the writer (or the destructor) with mutex_ held.
+void EvalKeyCache::evict(std::unordered_map<std::string, Entry>::iterator it) {
+  const std::string& tag = it->second.tag;
+  CryptoContextImpl<DCRTPoly>::ClearEvalMultKeys(tag);
+  CryptoContextImpl<DCRTPoly>::ClearEvalAutomorphismKeys(tag);
+  used_ -= it->second.bytes;
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
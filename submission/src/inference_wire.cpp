@@ -0,0 +1,136 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "inference_wire.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+std::runtime_error socket_error(const std::string& what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+sockaddr_un unix_address(const std::string& path) {
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("Socket path too long: " + path);
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return addr;
+}
+
+// Reads exactly n bytes. Returns false if the stream ends before the first
+// byte; throws if it ends in the middle.
+bool read_full(int fd, char* buf, size_t n) {
+  size_t done = 0;
+  while (done < n) {
+    ssize_t r = read(fd, buf + done, n - done);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0) throw socket_error("read");
+    if (r == 0) {
+      if (done == 0) return false;
+      throw std::runtime_error("Connection closed mid-message");
+    }
+    done += r;
+  }
+  return true;
+}
+
+}  // namespace
+
+int listen_unix_socket(const std::string& path) {
+  sockaddr_un addr = unix_address(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) throw socket_error("socket");
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, 64) != 0) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    throw socket_error("Failed to listen on " + path);
+  }
+  return fd;
+}
+
+int connect_unix_socket(const std::string& path) {
+  sockaddr_un addr = unix_address(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) throw socket_error("socket");
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    throw socket_error("Failed to connect to " + path);
+  }
+  return fd;
+}
+
+bool read_message(int fd, WireHeader& header, std::string& payload) {
+  if (!read_full(fd, reinterpret_cast<char*>(&header), sizeof(header))) {
+    return false;
+  }
+  if (header.length > kMaxWirePayload) {
+    throw std::runtime_error("Oversized message of " +
+                             std::to_string(header.length) + " bytes");
+  }
+  payload.resize(header.length);
+  if (header.length > 0 && !read_full(fd, &payload[0], header.length)) {
+    throw std::runtime_error("Connection closed mid-message");
+  }
+  return true;
+}
+
+void write_message(int fd, const WireHeader& header,
+                   const std::string& payload) {
+  WireHeader out = header;
+  out.length = payload.size();
+  iovec parts[2] = {{&out, sizeof(out)},
+                    {const_cast<char*>(payload.data()), payload.size()}};
+  size_t total = sizeof(out) + payload.size();
+  size_t done = 0;
+  while (done < total) {
+    // Skip the parts already sent.
+    iovec iov[2];
+    int count = 0;
+    size_t skip = done;
+    for (auto& part : parts) {
+      if (skip >= part.iov_len) {
+        skip -= part.iov_len;
+        continue;
+      }
+      iov[count].iov_base = static_cast<char*>(part.iov_base) + skip;
+      iov[count].iov_len = part.iov_len - skip;
+      skip = 0;
+      count++;
+    }
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    ssize_t w = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR) continue;
+    if (w < 0) throw socket_error("write");
+    done += w;
+  }
+}
@@ -0,0 +1,291 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "io_backend.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+
+#ifdef FHEON_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace {
+
+std::runtime_error io_error(const std::string& what, const fs::path& path,
+                            int err) {
+  return std::runtime_error(what + " " + path.string() + ": " +
+                            std::strerror(err));
+}
+
+// Owns the file descriptors of one batch.
+class FileSet {
+ public:
+  ~FileSet() {
+    for (int fd : fds_) {
+      close(fd);
+    }
+  }
+  int open_for_read(const fs::path& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw io_error("Failed to open", path, errno);
+    fds_.push_back(fd);
+    return fd;
+  }
+  int open_for_write(const fs::path& path, bool truncate) {
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+    int fd = open(path.c_str(), flags, 0644);
+    if (fd < 0) throw io_error("Failed to open", path, errno);
+    fds_.push_back(fd);
+    return fd;
+  }
+
+ private:
+  std::vector<int> fds_;
+};
+
+// Opens every file of a read batch and sizes the destination buffers.
+std::vector<int> prepare_reads(FileSet& files,
+                               std::vector<IoRequest>& requests) {
+  std::vector<int> fds;
+  for (auto& req : requests) {
+    int fd = files.open_for_read(req.path);
+    if (req.length == 0) {
+      struct stat st;
+      if (fstat(fd, &st) != 0) throw io_error("Failed to stat", req.path, errno);
+      if (static_cast<uint64_t>(st.st_size) < req.offset) {
+        throw std::runtime_error("Read offset past the end of " +
+                                 req.path.string());
+      }
+      req.length = st.st_size - req.offset;
+    }
+    req.data.resize(req.length);
+    fds.push_back(fd);
+  }
+  return fds;
+}
+
+class PosixIoBackend : public IoBackend {
+ public:
+  const char* name() const override { return "posix"; }
+
+  void read_batch(std::vector<IoRequest>& requests) override {
+    FileSet files;
+    auto fds = prepare_reads(files, requests);
+    for (size_t i = 0; i < requests.size(); ++i) {
+      auto& req = requests[i];
+      size_t done = 0;
+      while (done < req.length) {
+        ssize_t n = pread(fds[i], &req.data[done], req.length - done,
+                          req.offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throw io_error("Failed to read", req.path, errno);
+        if (n == 0) {
+          throw std::runtime_error("Unexpected end of " + req.path.string());
+        }
+        done += n;
+      }
+    }
+  }
+
+  void write_batch(const std::vector<IoRequest>& requests) override {
+    FileSet files;
+    for (const auto& req : requests) {
+      int fd = files.open_for_write(req.path, req.offset == 0);
+      size_t done = 0;
+      while (done < req.data.size()) {
+        ssize_t n = pwrite(fd, req.data.data() + done, req.data.size() - done,
+                           req.offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throw io_error("Failed to write", req.path, errno);
+        done += n;
+      }
+    }
+  }
+};
+
+#ifdef FHEON_HAVE_LIBURING
+class UringIoBackend : public IoBackend {
+ public:
+  static constexpr unsigned kQueueDepth = 64;
+  // Kernel limit on the number of registered buffers (UIO_MAXIOV).
+  static constexpr size_t kMaxRegistered = 1024;
+  // Largest single transfer; longer ranges are split.
+  static constexpr size_t kMaxTransfer = size_t(1) << 30;
+
+  UringIoBackend() {
+    int ret = io_uring_queue_init(kQueueDepth, &ring_, 0);
+    if (ret < 0) {
+      throw std::runtime_error(std::string("io_uring_queue_init: ") +
+                               std::strerror(-ret));
+    }
+  }
+  ~UringIoBackend() override { io_uring_queue_exit(&ring_); }
+
+  const char* name() const override { return "io_uring"; }
+
+  void read_batch(std::vector<IoRequest>& requests) override {
+    FileSet files;
+    auto fds = prepare_reads(files, requests);
+    std::vector<Op> ops;
+    for (size_t i = 0; i < requests.size(); ++i) {
+      auto& req = requests[i];
+      ops.push_back({fds[i], &req.data[0], req.length, req.offset, &req.path});
+    }
+    run(ops, false);
+  }
+
+  void write_batch(const std::vector<IoRequest>& requests) override {
+    FileSet files;
+    std::vector<Op> ops;
+    for (const auto& req : requests) {
+      int fd = files.open_for_write(req.path, req.offset == 0);
+      ops.push_back({fd, const_cast<char*>(req.data.data()), req.data.size(),
+                     req.offset, &req.path});
+    }
+    run(ops, true);
+  }
+
+ private:
+  struct Op {
+    int fd;
+    char* buf;
+    size_t length;
+    uint64_t offset;
+    const fs::path* path;
+    size_t done = 0;
+  };
+
+  // Registers the batch's buffers so the kernel pins them once instead of
+  // mapping them on every request. Falls back to plain reads/writes when the
+  // batch is too large or RLIMIT_MEMLOCK refuses the registration.
+  bool register_buffers(const std::vector<Op>& ops) {
+    if (ops.empty() || ops.size() > kMaxRegistered) return false;
+    std::vector<struct iovec> iovecs;
+    for (const auto& op : ops) {
+      if (op.length == 0 || op.length > kMaxTransfer) return false;
+      iovecs.push_back({op.buf, op.length});
+    }
+    return io_uring_register_buffers(&ring_, iovecs.data(), iovecs.size()) ==
+           0;
+  }
+
+  void run(std::vector<Op>& ops, bool write) {
+    bool fixed = register_buffers(ops);
+    std::deque<size_t> pending;
+    for (size_t i = 0; i < ops.size(); ++i) {
+      if (ops[i].length > 0) pending.push_back(i);
+    }
+    size_t in_flight = 0;
+    int first_error = 0;
+    const fs::path* error_path = nullptr;
+
+    while (!pending.empty() || in_flight > 0) {
+      // Queue as many transfers as the ring takes; stop issuing new ones
+      // after an error but still reap the ones in flight.
+      while (!pending.empty() && first_error == 0) {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+        if (sqe == nullptr) break;
+        size_t i = pending.front();
+        pending.pop_front();
+        Op& op = ops[i];
+        char* buf = op.buf + op.done;
+        unsigned len =
+            static_cast<unsigned>(std::min(op.length - op.done, kMaxTransfer));
+        uint64_t off = op.offset + op.done;
+        if (write && fixed) {
+          io_uring_prep_write_fixed(sqe, op.fd, buf, len, off, i);
+        } else if (write) {
+          io_uring_prep_write(sqe, op.fd, buf, len, off);
+        } else if (fixed) {
+          io_uring_prep_read_fixed(sqe, op.fd, buf, len, off, i);
+        } else {
+          io_uring_prep_read(sqe, op.fd, buf, len, off);
+        }
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(i));
+        in_flight++;
+      }
+      if (in_flight == 0) break;
+      io_uring_submit(&ring_);
+
+      // The kernel owns the buffers of every transfer in flight, so a failed
+      // wait still reaps them all before the buffers are unregistered or the
+      // caller sees the error.
+      struct io_uring_cqe* cqe;
+      int ret = io_uring_wait_cqe(&ring_, &cqe);
+      if (ret == -EINTR) continue;
+      if (ret < 0) {
+        if (first_error == 0) first_error = -ret;
+        continue;
+      }
+      size_t i = reinterpret_cast<size_t>(io_uring_cqe_get_data(cqe));
+      int res = cqe->res;
+      io_uring_cqe_seen(&ring_, cqe);
+      in_flight--;
+
+      Op& op = ops[i];
+      if (res == -EINTR || res == -EAGAIN) {
+        pending.push_back(i);
+      } else if (res <= 0) {
+        // A zero-byte transfer made no progress (EOF on a read); queueing
+        // the remainder again would never finish.
+        if (first_error == 0) {
+          first_error = res < 0 ? -res : EIO;
+          error_path = op.path;
+        }
+      } else {
+        op.done += res;
+        // Short transfer: queue the remainder.
+        if (op.done < op.length) pending.push_back(i);
+      }
+    }
+    if (fixed) io_uring_unregister_buffers(&ring_);
+    if (first_error != 0) {
+      throw io_error(write ? "Failed to write" : "Failed to read",
+                     error_path ? *error_path : fs::path("<io_uring>"),
+                     first_error);
+    }
+  }
+
+  struct io_uring ring_;
+};
+#endif  // FHEON_HAVE_LIBURING
+
+}  // namespace
+
+std::unique_ptr<IoBackend> make_io_backend() {
+  const char* choice = std::getenv("FHEON_IO_BACKEND");
+  bool want_posix = choice != nullptr && std::string(choice) == "posix";
+#ifdef FHEON_HAVE_LIBURING
+  if (!want_posix) {
+    try {
+      return std::make_unique<UringIoBackend>();
+    } catch (const std::exception& e) {
+      // Kernels without io_uring, or with it disabled by seccomp/sysctl.
+      std::cerr << "io_uring unavailable (" << e.what()
+                << "), using POSIX I/O" << std::endl;
+    }
+  }
+#else
+  (void)want_posix;
+#endif
+  return std::make_unique<PosixIoBackend>();
+}
@@ -0,0 +1,42 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares two key manifests. Exits 0 when `have` covers `want`, 1 otherwise.
+
+#include "key_store.h"
+
+int main(int argc, char *argv[]) {
+
+  if (argc < 3) {
+    std::cout << "Usage: " << argv[0] << " have.manifest want.manifest\n";
+    return 2;
+  }
+  KeyManifest have = read_key_manifest(argv[1]);
+  KeyManifest want = read_key_manifest(argv[2]);
+  KeyManifestDiff diff = diff_key_manifests(have, want);
+
+  std::cout << "context: " << (diff.same_context ? "same" : "different")
+            << "\n";
+  std::cout << "missing groups:";
+  for (const auto &group : diff.missing_groups) std::cout << " " << group;
+  std::cout << "\nmissing rotations:";
+  for (int index : diff.missing_rotations) std::cout << " " << index;
+  std::cout << "\nunused rotations:";
+  for (int index : diff.unused_rotations) std::cout << " " << index;
+  std::cout << std::endl;
+
+  bool covered = diff.same_context && diff.missing_groups.empty() &&
+                 diff.missing_rotations.empty();
+  return covered ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "utils.h"
+#include "key_store.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+std::string context_fingerprint(const fs::path& ccFile,
+                                const std::string& keyTag) {
+  std::ifstream in(ccFile, std::ios::in | std::ios::binary);
+  if (!in.is_open()) {
+    throw std::runtime_error("Failed to read " + ccFile.string());
+  }
+  uint64_t hash = 14695981039346656037ULL;
+  auto mix = [&hash](unsigned char byte) {
+    hash ^= byte;
+    hash *= 1099511628211ULL;
+  };
+  char buffer[1 << 16];
+  while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+    for (std::streamsize i = 0; i < in.gcount(); ++i) {
+      mix(static_cast<unsigned char>(buffer[i]));
+    }
+  }
+  for (char c : keyTag) {
+    mix(static_cast<unsigned char>(c));
+  }
+  std::ostringstream os;
+  os << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return os.str();
+}
+
+KeyManifest read_key_manifest(const fs::path& file) {
+  std::ifstream in(file);
+  if (!in.is_open()) {
+    throw std::runtime_error("Failed to read key manifest " + file.string());
+  }
+  KeyManifest manifest;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream iss(line);
+    std::string kind;
+    if (!(iss >> kind)) continue;
+    if (kind == "context") {
+      iss >> manifest.context;
+    } else if (kind == "group") {
+      std::string group;
+      iss >> group;
+      manifest.groups.insert(group);
+    } else if (kind == "rotation") {
+      int index;
+      if (!(iss >> index)) {
+        throw std::runtime_error("Bad rotation entry in " + file.string());
+      }
+      manifest.rotations.insert(index);
+    } else {
+      throw std::runtime_error("Unknown entry '" + kind + "' in " +
+                               file.string());
+    }
+  }
+  return manifest;
+}
+
+void write_key_manifest(const fs::path& file, const KeyManifest& manifest) {
+  // Write next to the target and rename, so a reader never sees half a file.
+  fs::path tmp = file;
+  tmp += ".tmp";
+  {
+    std::ofstream out(tmp);
+    out << "context " << manifest.context << '\n';
+    for (const auto& group : manifest.groups) {
+      out << "group " << group << '\n';
+    }
+    for (int index : manifest.rotations) {
+      out << "rotation " << index << '\n';
+    }
+    if (!out) {
+      throw std::runtime_error("Failed to write key manifest " + file.string());
+    }
+  }
+  fs::rename(tmp, file);
+}
+
+KeyManifestDiff diff_key_manifests(const KeyManifest& have,
+                                   const KeyManifest& want) {
+  KeyManifestDiff diff;
+  diff.same_context = have.context == want.context;
+  std::set_difference(want.groups.begin(), want.groups.end(),
+                      have.groups.begin(), have.groups.end(),
+                      std::back_inserter(diff.missing_groups));
+  std::set_difference(want.rotations.begin(), want.rotations.end(),
+                      have.rotations.begin(), have.rotations.end(),
+                      std::back_inserter(diff.missing_rotations));
+  std::set_difference(have.rotations.begin(), have.rotations.end(),
+                      want.rotations.begin(), want.rotations.end(),
+                      std::back_inserter(diff.unused_rotations));
+  return diff;
+}
+
+void write_rotation_keys(CryptoContextT cc, PrivateKeyT sk,
+                         const std::vector<int>& rotations, std::ostream& out) {
+  const std::string tag = sk->GetKeyTag();
+  for (int rot : rotations) {
+    cc->EvalRotateKeyGen(sk, {rot});
+    if (!cc->SerializeEvalAutomorphismKey(out, SerType::BINARY, tag)) {
+      throw std::runtime_error("Failed to write rotation key " +
+                               std::to_string(rot));
+    }
+    cc->ClearEvalAutomorphismKeys(tag);
+  }
+}
+
+void merge_key_delta(const fs::path& keyDir) {
+  fs::path deltaKeys = keyDir / KEY_DELTA_FILE;
+  fs::path deltaManifestFile = keyDir / KEY_DELTA_MANIFEST_FILE;
+  KeyManifest store = read_key_manifest(keyDir / KEY_MANIFEST_FILE);
+  KeyManifest delta = read_key_manifest(deltaManifestFile);
+  if (store.context != delta.context) {
+    throw std::runtime_error("Key delta in " + keyDir.string() +
+                             " was generated for another context");
+  }
+
+  if (fs::file_size(deltaKeys) > 0) {
+    // Build the merged file next to rk.bin and rename it over, so a reader
+    // or a crash never leaves rk.bin half appended. The manifest follows;
+    // if that write is lost, the delta files are still there and a second
+    // merge only re-adds keys rk.bin already holds.
+    fs::path rotationKeys = keyDir / "rk.bin";
+    fs::path tmp = rotationKeys;
+    tmp += ".tmp";
+    {
+      std::ifstream base(rotationKeys, std::ios::in | std::ios::binary);
+      std::ifstream in(deltaKeys, std::ios::in | std::ios::binary);
+      std::ofstream out(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+      if (!base.is_open() || !in.is_open() || !out.is_open() ||
+          !(out << base.rdbuf()) || !(out << in.rdbuf()) || !out.flush()) {
+        throw std::runtime_error("Failed to merge " + deltaKeys.string());
+      }
+    }
+    fs::rename(tmp, rotationKeys);
+  }
+  store.groups.insert(delta.groups.begin(), delta.groups.end());
+  store.rotations.insert(delta.rotations.begin(), delta.rotations.end());
+  write_key_manifest(keyDir / KEY_MANIFEST_FILE, store);
+  fs::remove(deltaKeys);
+  fs::remove(deltaManifestFile);
+}
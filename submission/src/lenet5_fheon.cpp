@@ -27,7 +27,9 @@ SOFTWARE.
 ********************************************************************************************************************/
 
 #include <iostream>
+#include <stdexcept>
 #include <sys/stat.h>
+#include <time.h>
 #include "lenet5_fheon.h"
 
 using namespace std;
@@ -37,114 +39,358 @@ using namespace lbcrypto;
 #define WEIGHTS_DIR "./../weights/lenet5/"
 #endif
 
-Ctext lenet5(FHEONHEController &fheonHEController, CryptoContext<DCRTPoly>& context, Ctext encryptedInput) {
+static const int kernelWidth = 5;
+static const vector<int> imgWidth = {28, 24, 12, 8, 4};
+static const vector<int> channels = {1, 6, 16, 256, 120, 84, 10};
 
-    FHEONANNController fheonANNController(context);
+static const int weightLayers = 5;
 
-    int kernelWidth = 5;
-    int poolSize = 2;
-    int rotPositions = 16;
-    vector<int> imgWidth = {28, 24, 12, 8, 4};
-    vector<int> channels = {1, 6, 16, 256, 120, 84, 10};
+/*
+ * Read the CSV weights and build the encoding jobs of each weighted layer
+ * (conv1, conv2, fc1, fc2, fc3), in the order assign_layer expects. */
+static vector<vector<EncodeJob>> lenet5_weight_jobs(FHEONHEController &fheonHEController) {
 
-    /******************************************************************* 
-     * Prepare Weights for the network 
-     * ******************************************************************/
     string dataPath = WEIGHTS_DIR;
-    
+    vector<vector<EncodeJob>> layers(weightLayers);
+    auto add_job = [](vector<EncodeJob>& jobs, vector<double> values, int repeat, int level) {
+        EncodeJob job;
+        job.values = std::move(values);
+        job.repeat = repeat;
+        job.level = level;
+        jobs.push_back(std::move(job));
+    };
+
     /*** 1st Convolution */
-    auto conv1_biasVec = load_bias(dataPath + "Conv1_bias.csv");
     auto conv1_rawKernel = load_weights(dataPath + "Conv1_weight.csv", channels[1], channels[0],
                     kernelWidth, kernelWidth);
-    int conv1WidthSq = pow(imgWidth[0], 2);
-    vector<vector<Ptext>> conv1_kernelData;
-    for (int i = 0; i < channels[1]; i++) {
-        auto encodeKernel =
-            fheonHEController.encode_kernel(conv1_rawKernel[i], conv1WidthSq);
-        conv1_kernelData.push_back(encodeKernel);
-    }
-    auto conv1biasEncoded = fheonHEController.encode_bais_input(
-        conv1_biasVec, (imgWidth[1] * imgWidth[1]));
-    
+#if LENET5_POLYPHASE
+    layers[0] = fheonHEController.polyphase_kernel_encode_jobs(conv1_rawKernel, imgWidth[0],
+                    LENET5_REPLICA_REGION, LENET5_REPLICAS);
+    add_job(layers[0], load_bias(dataPath + "Conv1_bias.csv"), Lenet5Conv1::channelStride, 1);
+#else
+    layers[0] = fheonHEController.replicated_kernel_encode_jobs(conv1_rawKernel, pow(imgWidth[0], 2),
+                    LENET5_REPLICA_REGION, LENET5_REPLICAS);
+    add_job(layers[0], load_bias(dataPath + "Conv1_bias.csv"), imgWidth[1] * imgWidth[1], 1);
+#endif
+
     /*** 2nd Convolution */
     auto conv2_rawKernel = load_weights(dataPath + "Conv2_weight.csv", channels[2], channels[1],
                     kernelWidth, kernelWidth);
-    auto conv2_biasVec= load_bias(dataPath + "Conv2_bias.csv");
-    int conv2WidthSq = pow(imgWidth[2], 2);
-    vector<vector<Ptext>> conv2_kernelData;
-    for (int i = 0; i < channels[2]; i++) {
-        auto encodeKernel =
-            fheonHEController.encode_kernel(conv2_rawKernel[i], conv2WidthSq);
-        conv2_kernelData.push_back(encodeKernel);
+    layers[1] = fheonHEController.replicated_kernel_encode_jobs(conv2_rawKernel, pow(imgWidth[2], 2),
+                    LENET5_REPLICA_REGION, LENET5_REPLICAS);
+    add_job(layers[1], load_bias(dataPath + "Conv2_bias.csv"), imgWidth[3] * imgWidth[3], 1);
+
+    /*** fc weights (level 1) and biases (level 0) */
+    vector<string> fcNames = {"FC1", "FC2", "FC3"};
+    for (int f = 0; f < 3; f++) {
+        auto fc_rawKernel = load_fc_weights(dataPath + fcNames[f] + "_weight.csv", channels[f + 4], channels[f + 3]);
+        for (auto& row : fc_rawKernel) {
+            add_job(layers[f + 2], std::move(row), 1, 1);
+        }
+        add_job(layers[f + 2], load_bias(dataPath + fcNames[f] + "_bias.csv"), 1, 0);
+    }
+
+    return layers;
+}
+
+/*
+ * Fill the fields of one weighted layer from its plaintexts (or ciphertexts),
+ * in the order lenet5_weight_jobs added them. Returns the position after the layer. */
+template <typename T, typename Iter>
+static Iter assign_layer(Lenet5Parameters<T> &weights, int layer, Iter next) {
+    if (layer < 2) {
+        int taps = layer == 0 ? Lenet5Conv1::taps : Lenet5Conv2::taps;
+        int passes = layer == 0 ? Lenet5Conv1::passes : Lenet5Conv2::passes;
+        auto& kernel = layer == 0 ? weights.conv1_kernel : weights.conv2_kernel;
+        kernel.clear();
+        for (int p = 0; p < passes; p++, next += taps) {
+            kernel.emplace_back(next, next + taps);
+        }
+        (layer == 0 ? weights.conv1_bias : weights.conv2_bias) = *next++;
+        return next;
+    }
+    vector<T>* fcKernels[] = {&weights.fc1_kernel, &weights.fc2_kernel, &weights.fc3_kernel};
+    T* fcBiases[] = {&weights.fc1_bias, &weights.fc2_bias, &weights.fc3_bias};
+    int f = layer - 2;
+    fcKernels[f]->assign(next, next + channels[f + 4]);
+    next += channels[f + 4];
+    *fcBiases[f] = *next++;
+    return next;
+}
+
+/*
+ * Flatten the per-layer jobs into one batch, so all layers encode in a single
+ * parallel pass */
+static vector<EncodeJob> flatten_jobs(vector<vector<EncodeJob>> layers) {
+    vector<EncodeJob> jobs;
+    for (auto& layer : layers) {
+        jobs.insert(jobs.end(), make_move_iterator(layer.begin()), make_move_iterator(layer.end()));
+    }
+    return jobs;
+}
+
+/*
+ * Split the flat batch back into layers, in the order the jobs were added */
+template <typename T>
+static Lenet5Parameters<T> split_weights(vector<T> &encoded) {
+    Lenet5Parameters<T> weights;
+    auto next = encoded.begin();
+    for (int layer = 0; layer < weightLayers; layer++) {
+        next = assign_layer(weights, layer, next);
+    }
+    return weights;
+}
+
+/*
+ * Encode every plaintext of the network in a single batched (multi-threaded)
+ * encoding pass. */
+Lenet5Weights lenet5_load_weights(FHEONHEController &fheonHEController) {
+    auto encoded = fheonHEController.encode_batch(flatten_jobs(lenet5_weight_jobs(fheonHEController)));
+    return split_weights(encoded);
+}
+
+/*
+ * Same layout as lenet5_load_weights, encrypted under publicKey. Reads the
+ * weights in the clear, so it belongs to the model owner, not the server. */
+Lenet5EncryptedWeights lenet5_encrypt_weights(FHEONHEController &fheonHEController,
+                                              PublicKey<DCRTPoly> &publicKey) {
+    auto encrypted = fheonHEController.encrypt_batch(flatten_jobs(lenet5_weight_jobs(fheonHEController)), publicKey);
+    return split_weights(encrypted);
+}
+
+// Ciphertexts (or plaintexts) of the whole model, in lenet5_weight_jobs order.
+static size_t lenet5_weight_count() {
+    size_t count = Lenet5Conv1::passes * Lenet5Conv1::taps + 1 + Lenet5Conv2::passes * Lenet5Conv2::taps + 1;
+    for (int f = 0; f < 3; f++) {
+        count += channels[f + 4] + 1;
+    }
+    return count;
+}
+
+void lenet5_write_encrypted_weights(FHEONHEController &fheonHEController,
+                                    PublicKey<DCRTPoly> &publicKey, const string &path) {
+    auto encrypted = fheonHEController.encrypt_batch(flatten_jobs(lenet5_weight_jobs(fheonHEController)), publicKey);
+    if (!Serial::SerializeToFile(path, encrypted, SerType::BINARY)) {
+        throw std::runtime_error("Failed to write encrypted weights to " + path);
+    }
+}
+
+Lenet5EncryptedWeights lenet5_read_encrypted_weights(const string &path) {
+    vector<Ctext> encrypted;
+    if (!Serial::DeserializeFromFile(path, encrypted, SerType::BINARY)) {
+        throw std::runtime_error("Failed to read encrypted weights from " + path +
+                                 " (run model_encrypt_weights first)");
     }
-    auto conv2biasEncoded = fheonHEController.encode_bais_input(
-        conv2_biasVec, (imgWidth[3] * imgWidth[3]));
-    
-    /*** 1st fc kernel and bias */
-    auto fc1_biasVec = load_bias(dataPath + "FC1_bias.csv");
-    auto fc1_rawKernel = load_fc_weights(dataPath + "FC1_weight.csv", channels[4], channels[3]);
-    vector<Ptext> fc1_kernelData;
-    for (int i = 0; i < channels[4]; i++) {
-        auto encodeWeights = fheonHEController.encode_input(fc1_rawKernel[i]);
-        fc1_kernelData.push_back(encodeWeights);
+    if (encrypted.size() != lenet5_weight_count()) {
+        throw std::runtime_error(path + " holds " + std::to_string(encrypted.size()) +
+                                 " ciphertexts, LeNet-5 needs " + std::to_string(lenet5_weight_count()));
     }
-    Ptext fc1baisVec = context->MakeCKKSPackedPlaintext(fc1_biasVec, 1);
-    
-    /*** 2nd fc weights and bias */
-    auto fc2_biasVec = load_bias(dataPath + "FC2_bias.csv");
-    auto fc2_rawKernel = load_fc_weights(dataPath + "FC2_weight.csv", channels[5], channels[4]);
-    vector<Ptext> fc2_kernelData;
-    for (int i = 0; i < channels[5]; i++) {
-        auto encodeWeights = fheonHEController.encode_input(fc2_rawKernel[i]);
-        fc2_kernelData.push_back(encodeWeights);
+    return split_weights(encrypted);
+}
+
+Ctext lenet5(FHEONHEController &fheonHEController, CryptoContext<DCRTPoly>& context, Ctext encryptedInput) {
+    Lenet5Weights weights = lenet5_load_weights(fheonHEController);
+    return lenet5(fheonHEController, context, weights, encryptedInput);
+}
+
+/*
+ * Register every weighted layer with a provider and prepare it (in JustInTime
+ * mode this starts prefetching conv1). */
+void lenet5_register_weights(FHEONWeightProvider &provider, FHEONHEController &fheonHEController) {
+    for (auto& jobs : lenet5_weight_jobs(fheonHEController)) {
+        provider.add_layer(std::move(jobs));
+    }
+    provider.prepare();
+}
+
+static Lenet5LayerObserver layerObserver;
+
+void lenet5_set_layer_observer(Lenet5LayerObserver observer) {
+    layerObserver = std::move(observer);
+}
+
+const std::vector<std::string> &lenet5_stage_names() {
+    static const std::vector<std::string> names = {"conv1", "relu1", "pool1", "conv2", "relu2", "pool2",
+                                                   "fc1", "relu3", "fc2", "relu4", "fc3", "bootstrap"};
+    return names;
+}
+
+// User plus system CPU seconds of every thread in the process; the layers run
+// on OpenMP threads, so the calling thread's own clock would miss most of it.
+static double process_cpu_seconds() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Times consecutive stages for the layer observer, with the work the controller's
+ * memos saved in each; free when none is set. */
+class LayerClock {
+public:
+    explicit LayerClock(FHEONANNController &controller) : controller(controller) {
+        if (layerObserver) {
+            last = chrono::steady_clock::now();
+            lastCpu = process_cpu_seconds();
+        }
     }
-    Ptext fc2baisVec = context->MakeCKKSPackedPlaintext(fc2_biasVec, 1);
-
-    /*** 3rd fc weights and bias */
-    auto fc3_biasVec = load_bias(dataPath + "FC3_bias.csv");
-    auto fc3_rawKernel = load_fc_weights(dataPath + "FC3_weight.csv", channels[6], channels[5]);
-    vector<Ptext> fc3_kernelData;
-    for (int i = 0; i < channels[6]; i++) {
-        auto encodeWeights = fheonHEController.encode_input(fc3_rawKernel[i]);
-        fc3_kernelData.push_back(encodeWeights);
+    void lap(const char *layer) {
+        if (!layerObserver) {
+            return;
+        }
+        auto now = chrono::steady_clock::now();
+        double cpu = process_cpu_seconds();
+        FHEONReuseStats reuse = controller.take_reuse_stats();
+        Lenet5LayerSample sample;
+        sample.seconds = chrono::duration<double>(now - last).count();
+        sample.cpuSeconds = cpu - lastCpu;
+        sample.savedKeySwitches = reuse.keySwitches;
+        sample.reusedMasks = reuse.maskEncodes;
+        layerObserver(layer, sample);
+        last = now;
+        lastCpu = cpu;
     }
-    Ptext fc3baisVec = context->MakeCKKSPackedPlaintext(fc3_biasVec, 1);
+private:
+    FHEONANNController &controller;
+    chrono::steady_clock::time_point last;
+    double lastCpu = 0;
+};
+
+/*
+ * The network itself; T = Ptext for encoded weights, Ctext for encrypted ones.
+ * The layer calls resolve to the matching FHEONANNController overloads.
+ * fetch(layer) runs before each weighted layer reads its fields. */
+template <typename T, typename Fetch>
+static Ctext lenet5_layers(FHEONHEController &fheonHEController, CryptoContext<DCRTPoly>& context,
+                           Lenet5Parameters<T> &weights, Ctext encryptedInput, const Lenet5Plan &plan,
+                           Fetch fetch) {
+
+    // Masks are shared through fheonHEController's cache when it owns this context.
+    FHEONANNController fheonANNController(context, fheonHEController.getContext() == context
+                                                       ? &fheonHEController.masks() : nullptr);
 
     /*************************************************************************************************
      * Perform Encrypted Inference on the network 
      * ***********************************************************************************************/
     /*************************************************************************************************/
-    int reluScale = 10;
-    int polyDegree = 119;
+    // Uploads may arrive level-reduced; they only need the levels of segment 0.
+    int inputLevels = encryptedInput->GetElements()[0].GetNumOfElements() - 1;
+    if (inputLevels < plan.segment_depths()[0]) {
+        throw std::runtime_error("lenet5: input ciphertext has " + std::to_string(inputLevels) +
+                                 " levels, the first segment needs " + std::to_string(plan.segment_depths()[0]));
+    }
+    int reluScale = plan.reluScale;
+    int polyDegree = plan.polyDegree;
     vector<int> dataSizeVec;
+#if LENET5_POLYPHASE
+    dataSizeVec.push_back(channels[1] * Lenet5Conv1::channelStride);
+#else
     dataSizeVec.push_back((channels[1] * pow(imgWidth[1], 2)));
+#endif
     dataSizeVec.push_back((channels[2] * pow(imgWidth[3], 2)));
     /**********************************************************************************************/
 
     /***** The first Convolution Layer takes  image=(1,28,28), kernel=(6,1,5,5)
      * stride=1, pooling=0 output= (6,24,24) = 3456 vals */
-    auto convData = fheonANNController.he_convolution(encryptedInput, conv1_kernelData, conv1biasEncoded, imgWidth[0], channels[0], channels[1], kernelWidth);
+    LayerClock clock(fheonANNController);
+    fetch(0);
+#if LENET5_POLYPHASE
+    auto convData = fheonANNController.he_convolution_polyphase<Lenet5Conv1>(encryptedInput, weights.conv1_kernel, weights.conv1_bias);
+    clock.lap("conv1");
     convData = fheonANNController.he_relu(convData, reluScale, dataSizeVec[0], polyDegree);
-    convData = fheonANNController.he_avgpool_optimzed(convData, imgWidth[1], channels[1], poolSize, poolSize);
+    clock.lap("relu1");
+    convData = fheonANNController.he_avgpool_polyphase<Lenet5Pool1>(convData);
+#else
+    auto convData = fheonANNController.he_convolution_replicated<Lenet5Conv1>(encryptedInput, weights.conv1_kernel, weights.conv1_bias);
+    clock.lap("conv1");
+    convData = fheonANNController.he_relu(convData, reluScale, dataSizeVec[0], polyDegree);
+    clock.lap("relu1");
+    convData = fheonANNController.he_avgpool_optimzed<Lenet5Pool1>(convData);
+#endif
+    clock.lap("pool1");
 
     /***** Second convolution Layer input = (6,12,12), kernel=(16,6,5,5)
      * striding =1, padding = 0 output = (16,8,8) ***/
-    convData = fheonANNController.he_convolution(convData, conv2_kernelData, conv2biasEncoded, imgWidth[2], channels[1], channels[2], kernelWidth);
+    convData = fheonANNController.he_replicate_input(convData, LENET5_REPLICA_REGION, LENET5_REPLICAS);
+    fetch(1);
+    convData = fheonANNController.he_convolution_replicated<Lenet5Conv2>(convData, weights.conv2_kernel, weights.conv2_bias);
+    clock.lap("conv2");
     convData = fheonANNController.he_relu(convData, reluScale, dataSizeVec[1], polyDegree);
+    clock.lap("relu2");
     convData = fheonHEController.bootstrap_function(convData);
-    convData = fheonANNController.he_avgpool_optimzed(convData, imgWidth[3], channels[2], poolSize, poolSize);
+    convData = fheonHEController.reduce_to_depth(convData, plan.segment_budget(1));
+    clock.lap("bootstrap");
+    convData = fheonANNController.he_avgpool_optimzed<Lenet5Pool2>(convData);
+    clock.lap("pool2");
 
     /*** fully connected layers */
-    convData = fheonANNController.he_linear(convData, fc1_kernelData, fc1baisVec,channels[3], channels[4], rotPositions);
+    fetch(2);
+    convData = fheonANNController.he_linear<Lenet5Fc1>(convData, weights.fc1_kernel, weights.fc1_bias);
+    clock.lap("fc1");
     convData = fheonHEController.bootstrap_function(convData);
+    convData = fheonHEController.reduce_to_depth(convData, plan.segment_budget(2));
+    clock.lap("bootstrap");
     convData = fheonANNController.he_relu(convData, reluScale, channels[4], polyDegree);
-    convData = fheonANNController.he_linear(convData, fc2_kernelData, fc2baisVec,channels[4], channels[5], rotPositions);
+    clock.lap("relu3");
+    fetch(3);
+    convData = fheonANNController.he_linear<Lenet5Fc2>(convData, weights.fc2_kernel, weights.fc2_bias);
+    clock.lap("fc2");
     convData = fheonHEController.bootstrap_function(convData);
+    convData = fheonHEController.reduce_to_depth(convData, plan.segment_budget(3));
+    clock.lap("bootstrap");
     convData = fheonANNController.he_relu(convData, reluScale, channels[5], polyDegree);
-    convData = fheonANNController.he_linear(convData, fc3_kernelData, fc3baisVec, channels[5], channels[6], rotPositions);
+    clock.lap("relu4");
+    fetch(4);
+    convData = fheonANNController.he_linear<Lenet5Fc3>(convData, weights.fc3_kernel, weights.fc3_bias);
+    clock.lap("fc3");
 
 //     auto mask_data = context->MakeCKKSPackedPlaintext(generate_mixed_mask(10, 784), 1, 0, nullptr, nextPowerOf2(784)); 
 //   convData = context->EvalMult(convData, mask_data);
 
     return convData;
 }
+
+Ctext lenet5(FHEONHEController &fheonHEController, CryptoContext<DCRTPoly>& context,
+             Lenet5Weights &weights, Ctext encryptedInput, const Lenet5Plan &plan) {
+    return lenet5_layers(fheonHEController, context, weights, encryptedInput, plan, [](int) {});
+}
+
+Ctext lenet5(FHEONHEController &fheonHEController, CryptoContext<DCRTPoly>& context,
+             Lenet5EncryptedWeights &weights, Ctext encryptedInput, const Lenet5Plan &plan) {
+    return lenet5_layers(fheonHEController, context, weights, encryptedInput, plan, [](int) {});
+}
+
+/*
+ * Weights from a provider. Only the layer being evaluated is referenced, so in
+ * JustInTime mode the provider is free to evict the others. */
+Ctext lenet5(FHEONHEController &fheonHEController, CryptoContext<DCRTPoly>& context,
+             FHEONWeightProvider &provider, Ctext encryptedInput, const Lenet5Plan &plan) {
+    Lenet5Weights weights;
+    FHEONWeightProvider::Layer held;
+    auto fetch = [&](int layer) {
+        weights = Lenet5Weights();
+        held.reset();
+        held = provider.layer(layer);
+        assign_layer(weights, layer, held->begin());
+    };
+    return lenet5_layers(fheonHEController, context, weights, encryptedInput, plan, fetch);
+}
+
+/*
+ * Peak tap memory of conv1 and conv2. Each ciphertext has two elements of
+ * (remaining levels + 1) towers at the layer's input. */
+vector<Lenet5ConvMemory> lenet5_conv_memory(CryptoContext<DCRTPoly> &context, const Lenet5Plan &plan) {
+    size_t ringDim = context->GetRingDimension();
+    auto bytes = [ringDim](int levels) { return 2 * (levels + 1) * ringDim * sizeof(uint64_t); };
+    int conv1Levels = plan.segment_budget(0);
+    int conv2Levels = conv1Levels - Lenet5Plan::conv1_depth() - plan.relu_depth() - Lenet5Plan::pool1_depth();
+    auto held = [](int materialized, int streamed, bool stream) { return stream ? streamed : materialized; };
+    return {
+        {"conv1", Lenet5Conv1::materializedCiphertexts,
+         held(Lenet5Conv1::materializedCiphertexts, Lenet5Conv1::streamedCiphertexts, Lenet5Conv1::streamTaps),
+         bytes(conv1Levels)},
+        {"conv2", Lenet5Conv2::materializedCiphertexts,
+         held(Lenet5Conv2::materializedCiphertexts, Lenet5Conv2::streamedCiphertexts, Lenet5Conv2::streamTaps),
+         bytes(conv2Levels)},
+    };
+}
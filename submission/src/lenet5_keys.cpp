@@ -0,0 +1,68 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <iterator>
+
+#include "lenet5_fheon.h"
+
+/*
+ * Rotations the pooling and fully connected layers issue, generated with the
+ * original key plan (avgpool, downsample and linear merges). */
+static constexpr int baseRotations[] = {
+    -2880, -2304, -1728, -1152, -960, -896, -864, -832, -768, -720, -704,
+    -640,  -576,  -552,  -528,  -512,  -504,  -480,  -456,  -448,  -432,
+    -408,  -384,  -360,  -336,  -320,  -312,  -288,  -264,  -256,  -240,
+    -224,  -216,  -208,  -192,  -176,  -168,  -160,  -144,  -128,  -120,
+    -112,  -104,  -96,   -88,   -80,   -72,   -64,   -56,   -48,   -40,
+    -32,   -24,   -16,   -15,   -14,   -13,   -12,   -11,   -10,   -9,
+    -8,     -1,     1,     2,     3,     4,     5,     6,     7,    8,  
+    9,      10,    11,    12,    13,    14,    15,    16,    24,    28,
+    36,    48,     64,    144,   432,   576,   784
+};
+
+/*
+ * The full key set: the base rotations plus the schedules of both convolutions,
+ * which depend on LENET5_PACKING, and of pool1, which depends on
+ * LENET5_POLYPHASE. */
+static constexpr auto lenet5_rotation_set() {
+    RotationSet<std::size(baseRotations) + Lenet5Conv1::rotationCapacity + Lenet5Conv2::rotationCapacity +
+                Lenet5Pool1::rotations().steps.size()> keys;
+    for (int rot : baseRotations) {
+        keys.add(rot);
+    }
+    keys.add(Lenet5Conv1::rotations());
+    keys.add(Lenet5Pool1::rotations());
+    keys.add(Lenet5Conv2::rotations());
+    return keys;
+}
+static constexpr auto lenet5Keys = lenet5_rotation_set();
+
+// Every layer's rotations must have a key; a shape change that breaks this
+// fails the build instead of the first encrypted inference.
+static_assert(Lenet5Conv1::rotations().covered_by(lenet5Keys), "conv1 rotations missing from the key plan");
+static_assert(Lenet5Pool1::rotations().covered_by(lenet5Keys), "pool1 rotations missing from the key plan");
+static_assert(Lenet5Conv2::rotations().covered_by(lenet5Keys), "conv2 rotations missing from the key plan");
+static_assert(Lenet5Pool2::rotations().covered_by(lenet5Keys), "pool2 rotations missing from the key plan");
+static_assert(Lenet5Fc1::rotations().covered_by(lenet5Keys), "fc1 rotations missing from the key plan");
+static_assert(Lenet5Fc2::rotations().covered_by(lenet5Keys), "fc2 rotations missing from the key plan");
+static_assert(Lenet5Fc3::rotations().covered_by(lenet5Keys), "fc3 rotations missing from the key plan");
+
+/*
+ * Rotation indices LeNet-5 needs, shared by key generation and the delta-key
+ * tooling so both always agree on the plan. */
+vector<int> lenet5_rotation_positions(CryptoContext<DCRTPoly> context) {
+
+    vector<int> rotPositions(lenet5Keys.steps.begin(), lenet5Keys.steps.begin() + lenet5Keys.count);
+    sort(rotPositions.begin(), rotPositions.end());
+    return rotPositions;
+}
@@ -0,0 +1,228 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Open-loop load generator for server_inference_daemon.
+//
+// Pre-encrypts a pool of MNIST ciphertexts with mlp_encrypt, then submits them
+// on a fixed schedule (constant or Poisson arrivals) regardless of how fast
+// responses come back. Latency is measured from each request's scheduled send
+// time, so a sender that falls behind does not hide queueing (no coordinated
+// omission). Reports latency percentiles, the server-side queueing delay and
+// the achieved throughput.
+
+#include "inference_wire.h"
+#include "io_backend.h"
+#include "lenet5_plan.h"
+#include "mlp_encryption_utils.h"
+#include "utils.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <thread>
+
+using namespace lbcrypto;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Record {
+  Clock::time_point scheduled;
+  Clock::time_point done;
+  uint64_t queue_us = 0;
+  uint64_t compute_us = 0;
+  bool ok = false;
+};
+
+double percentile_ms(std::vector<double> values, double q) {
+  if (values.empty()) return 0.0;
+  std::sort(values.begin(), values.end());
+  size_t k = std::min(values.size() - 1,
+                      static_cast<size_t>(q / 100.0 * (values.size() - 1) + 0.5));
+  return values[k];
+}
+
+double ms(Clock::duration d) {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+
+  if (argc < 2 || !std::isdigit(argv[1][0])) {
+    std::cout << "Usage: " << argv[0] << " instance-size [--rate R] [--arrivals poisson|constant]\n"
+              << "       [--requests N] [--pool P] [--seed S] [--socket PATH] [--out FILE]\n"
+              << "       [--tenant T --tenant-dir DIR]\n";
+    std::cout << "  Instance-size: 0-SINGLE, 1-SMALL, 2-MEDIUM, 3-LARGE\n";
+    std::cout << "  --rate R: requests per second (default 0.1)\n";
+    std::cout << "  --requests N: requests to send (default 20)\n";
+    std::cout << "  --pool P: distinct ciphertexts to pre-encrypt (default 8)\n";
+    std::cout << "  --tenant T: encrypt under DIR/T/pk.bin and send as tenant T (default 0, the default keys)\n";
+    return 0;
+  }
+  auto size = static_cast<InstanceSize>(std::stoi(argv[1]));
+  InstanceParams prms(size);
+  double rate = 0.1;
+  bool poisson = true;
+  size_t requests = 20;
+  size_t poolSize = 8;
+  unsigned seed = 1;
+  std::string socketPath = INFERENCE_SOCKET;
+  fs::path outFile = prms.iodir() / "load_results.json";
+  uint64_t tenant = 0;
+  fs::path tenantDir;
+  for (int a = 2; a < argc; ++a) {
+    std::string arg = argv[a];
+    if (a + 1 == argc) throw std::runtime_error(arg + " needs a value");
+    std::string value = argv[++a];
+    if (arg == "--rate") rate = std::stod(value);
+    else if (arg == "--arrivals") poisson = value != "constant";
+    else if (arg == "--requests") requests = std::stoul(value);
+    else if (arg == "--pool") poolSize = std::max<size_t>(1, std::stoul(value));
+    else if (arg == "--seed") seed = std::stoul(value);
+    else if (arg == "--socket") socketPath = value;
+    else if (arg == "--out") outFile = value;
+    else if (arg == "--tenant") tenant = std::stoull(value);
+    else if (arg == "--tenant-dir") tenantDir = value;
+    else throw std::runtime_error("Unknown option " + arg);
+  }
+  if (rate <= 0) throw std::runtime_error("--rate must be positive");
+  if (requests == 0) throw std::runtime_error("--requests must be positive");
+  if (tenant != 0 && tenantDir.empty()) throw std::runtime_error("--tenant needs --tenant-dir");
+
+  // Pre-encrypt the pool exactly as client_encode_encrypt_input does, so the
+  // send loop only copies bytes.
+  CryptoContext<DCRTPoly> cc = read_crypto_context(prms);
+  PublicKey<DCRTPoly> pk;
+  if (tenant == 0) {
+    pk = read_public_key(prms);
+  } else if (!Serial::DeserializeFromFile(tenantDir / std::to_string(tenant) / "pk.bin", pk,
+                                          SerType::BINARY)) {
+    throw std::runtime_error("Failed to get public key of tenant " + std::to_string(tenant));
+  }
+  std::vector<Sample> dataset;
+  load_dataset(dataset, prms.test_input_file().c_str());
+  if (dataset.empty()) {
+    throw std::runtime_error("No data found in " + prms.test_input_file().string());
+  }
+  uint32_t chainTowers =
+      cc->GetCryptoParameters()->GetElementParams()->GetParams().size();
+  uint32_t level = Lenet5Plan::fast().input_level(chainTowers);
+  std::vector<std::string> pool(poolSize);
+  for (size_t p = 0; p < poolSize; ++p) {
+    auto *input = dataset[p % dataset.size()].image;
+    std::vector<float> input_vector(input, input + NORMALIZED_DIM);
+    for (auto &val : input_vector) {
+      val = (val - 0.1307f) / 0.3081f;
+    }
+    if (LENET5_POLYPHASE) {
+      polyphase_layout(input_vector, 28);
+    }
+    pool[p] = serialize_binary(mlp_encrypt(cc, input_vector, pk, level));
+  }
+  std::cout << "         [load] pre-encrypted " << poolSize << " ciphertexts" << std::endl;
+
+  // Arrival schedule, fixed before the first send.
+  std::mt19937_64 rng(seed);
+  std::exponential_distribution<double> gap(rate);
+  std::vector<Record> records(requests);
+  auto start = Clock::now() + std::chrono::milliseconds(100);
+  double offset = 0;
+  for (size_t r = 0; r < requests; ++r) {
+    records[r].scheduled =
+        start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(offset));
+    offset += poisson ? gap(rng) : 1.0 / rate;
+  }
+
+  int fd = connect_unix_socket(socketPath);
+  std::thread receiver([&]() {
+    WireHeader header;
+    std::string payload;
+    try {
+      for (size_t n = 0; n < requests && read_message(fd, header, payload); ++n) {
+        if (header.id >= requests) continue;
+        Record &rec = records[header.id];
+        rec.done = Clock::now();
+        rec.queue_us = header.queue_us;
+        rec.compute_us = header.compute_us;
+        rec.ok = !payload.empty();
+      }
+    } catch (const std::exception &e) {
+      // Unanswered requests are counted as failed below.
+      std::cerr << "         [load] " << e.what() << std::endl;
+    }
+  });
+  for (size_t r = 0; r < requests; ++r) {
+    std::this_thread::sleep_until(records[r].scheduled);
+    WireHeader header;
+    header.id = r;
+    header.tenant = tenant;
+    write_message(fd, header, pool[r % poolSize]);
+  }
+  receiver.join();
+  close(fd);
+
+  std::vector<double> latency, queueing, compute;
+  size_t failed = 0;
+  Clock::time_point last = start;
+  for (const auto &rec : records) {
+    if (!rec.ok) {
+      failed++;
+      continue;
+    }
+    latency.push_back(ms(rec.done - rec.scheduled));
+    queueing.push_back(rec.queue_us / 1000.0);
+    compute.push_back(rec.compute_us / 1000.0);
+    last = std::max(last, rec.done);
+  }
+  double elapsed = ms(last - records[0].scheduled) / 1000.0;
+  double achieved = elapsed > 0 ? latency.size() / elapsed : 0.0;
+  auto mean = [](const std::vector<double> &v) {
+    double sum = 0;
+    for (double x : v) sum += x;
+    return v.empty() ? 0.0 : sum / v.size();
+  };
+
+  std::ofstream out(outFile);
+  out << "{\n"
+      << "  \"arrivals\": \"" << (poisson ? "poisson" : "constant") << "\",\n"
+      << "  \"offered_rate_per_s\": " << rate << ",\n"
+      << "  \"achieved_rate_per_s\": " << achieved << ",\n"
+      << "  \"requests\": " << requests << ",\n"
+      << "  \"failed\": " << failed << ",\n"
+      << "  \"latency_ms\": {\"mean\": " << mean(latency)
+      << ", \"p50\": " << percentile_ms(latency, 50)
+      << ", \"p90\": " << percentile_ms(latency, 90)
+      << ", \"p99\": " << percentile_ms(latency, 99)
+      << ", \"p999\": " << percentile_ms(latency, 99.9)
+      << ", \"max\": " << percentile_ms(latency, 100) << "},\n"
+      << "  \"queueing_ms\": {\"mean\": " << mean(queueing)
+      << ", \"p50\": " << percentile_ms(queueing, 50)
+      << ", \"p99\": " << percentile_ms(queueing, 99) << "},\n"
+      << "  \"compute_ms\": {\"mean\": " << mean(compute)
+      << ", \"p50\": " << percentile_ms(compute, 50)
+      << ", \"p99\": " << percentile_ms(compute, 99) << "}\n"
+      << "}\n";
+  std::cout << "         [load] offered " << rate << "/s, achieved " << achieved
+            << "/s, p50 " << percentile_ms(latency, 50) << " ms, p99 "
+            << percentile_ms(latency, 99) << " ms, mean queueing "
+            << mean(queueing) << " ms, " << failed << " failed" << std::endl;
+  std::cout << "         [load] wrote " << outFile.string() << std::endl;
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "metrics.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+void atomic_add(std::atomic<double>& target, double d) {
+  double old = target.load(std::memory_order_relaxed);
+  while (!target.compare_exchange_weak(old, old + d, std::memory_order_relaxed)) {
+  }
+}
+
+std::string escape_label(const std::string& value) {
+  std::string out;
+  for (char c : value) {
+    if (c == '\\' || c == '"') out += '\\';
+    if (c == '\n') {
+      out += "\\n";
+      continue;
+    }
+    out += c;
+  }
+  return out;
+}
+
+// {a="1",b="2"}, or "" without labels. `extra` is appended (histogram le).
+std::string render_labels(const MetricLabels& labels,
+                          const std::string& extra = "") {
+  if (labels.empty() && extra.empty()) return "";
+  std::string out = "{";
+  for (const auto& label : labels) {
+    if (out.size() > 1) out += ',';
+    out += label.first + "=\"" + escape_label(label.second) + '"';
+  }
+  if (!extra.empty()) {
+    if (out.size() > 1) out += ',';
+    out += extra;
+  }
+  return out + '}';
+}
+
+std::string format_value(double v) {
+  if (std::isinf(v)) return v > 0 ? "+Inf" : "-Inf";
+  std::ostringstream ss;
+  ss.precision(12);
+  ss << v;
+  return ss.str();
+}
+
+}  // namespace
+
+void Gauge::add(double d) { atomic_add(value_, d); }
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)),
+      buckets_(new std::atomic<uint64_t>[bounds_.size() + 1]) {
+  std::sort(bounds_.begin(), bounds_.end());
+  for (size_t i = 0; i <= bounds_.size(); ++i) buckets_[i] = 0;
+}
+
+void Histogram::observe(double v) {
+  size_t i = std::lower_bound(bounds_.begin(), bounds_.end(), v) - bounds_.begin();
+  buckets_[i].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  atomic_add(sum_, v);
+}
+
+uint64_t Histogram::cumulative(size_t i) const {
+  uint64_t total = 0;
+  for (size_t b = 0; b <= i; ++b) total += buckets_[b].load(std::memory_order_relaxed);
+  return total;
+}
+
+std::vector<double> latency_buckets() {
+  return {0.001, 0.005, 0.01, 0.05, 0.1, 0.25, 0.5, 1,
+          2.5,   5,     10,   20,   30,  60,   120, 300};
+}
+
+MetricsRegistry::Series& MetricsRegistry::series(const std::string& name,
+                                                 const std::string& help,
+                                                 Type type,
+                                                 const MetricLabels& labels) {
+  auto family = families_.find(name);
+  if (family == families_.end()) {
+    family = families_.emplace(name, Family{type, help, {}}).first;
+  } else if (family->second.type != type) {
+    throw std::logic_error("Metric " + name + " registered with two types");
+  }
+  return family->second.series[render_labels(labels)];
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help,
+                                  const MetricLabels& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series& s = series(name, help, Type::kCounter, labels);
+  if (!s.counter) s.counter = std::make_unique<Counter>();
+  return *s.counter;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help,
+                              const MetricLabels& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series& s = series(name, help, Type::kGauge, labels);
+  if (!s.gauge) s.gauge = std::make_unique<Gauge>();
+  return *s.gauge;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name,
+                                      const std::string& help,
+                                      const std::vector<double>& bounds,
+                                      const MetricLabels& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series& s = series(name, help, Type::kHistogram, labels);
+  if (!s.histogram) s.histogram = std::make_unique<Histogram>(bounds);
+  return *s.histogram;
+}
+
+void MetricsRegistry::add_collector(std::function<void()> collect) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  collectors_.push_back(std::move(collect));
+}
+
+std::string MetricsRegistry::render() {
+  std::vector<std::function<void()>> collectors;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    collectors = collectors_;
+  }
+  for (auto& collect : collectors) collect();
+
+  static const char* kTypeNames[] = {"counter", "gauge", "histogram"};
+  std::ostringstream out;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& [name, family] : families_) {
+    out << "# HELP " << name << ' ' << family.help << '\n';
+    out << "# TYPE " << name << ' ' << kTypeNames[static_cast<int>(family.type)] << '\n';
+    for (const auto& [labels, s] : family.series) {
+      if (s.counter) {
+        out << name << labels << ' ' << s.counter->value() << '\n';
+      } else if (s.gauge) {
+        out << name << labels << ' ' << format_value(s.gauge->value()) << '\n';
+      } else if (s.histogram) {
+        // Re-insert le into the already rendered label set.
+        std::string inner = labels.empty() ? "" : labels.substr(1, labels.size() - 2);
+        auto with_le = [&inner](const std::string& le) {
+          return "{" + inner + (inner.empty() ? "" : ",") + "le=\"" + le + "\"}";
+        };
+        const Histogram& h = *s.histogram;
+        for (size_t i = 0; i < h.bounds().size(); ++i) {
+          out << name << "_bucket" << with_le(format_value(h.bounds()[i])) << ' '
+              << h.cumulative(i) << '\n';
+        }
+        out << name << "_bucket" << with_le("+Inf") << ' ' << h.cumulative(h.bounds().size())
+            << '\n';
+        out << name << "_sum" << labels << ' ' << format_value(h.sum()) << '\n';
+        out << name << "_count" << labels << ' ' << h.count() << '\n';
+      }
+    }
+  }
+  return out.str();
+}
+
+void MetricsRegistry::write_file(const fs::path& path) {
+  std::string text = render();
+  fs::path tmp = path;
+  tmp += ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::out | std::ios::trunc);
+    out << text;
+    if (!out) throw std::runtime_error("Failed to write " + tmp.string());
+  }
+  fs::rename(tmp, path);
+}
+
+void register_process_metrics(MetricsRegistry& registry) {
+  Gauge& rss = registry.gauge("process_resident_memory_bytes",
+                              "Resident set size of the server.");
+  Gauge& peak = registry.gauge("process_peak_resident_memory_bytes",
+                               "Peak resident set size since start.");
+  long page = sysconf(_SC_PAGESIZE);
+  registry.add_collector([&rss, &peak, page]() {
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0, resident = 0;
+    if (statm >> pages >> resident) rss.set(static_cast<double>(resident) * page);
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+      peak.set(static_cast<double>(usage.ru_maxrss) * 1024);  // KiB on Linux
+    }
+  });
+}
+
+MetricsHttpServer::MetricsHttpServer(MetricsRegistry& registry, int port)
+    : registry_(registry) {
+  listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd_ < 0) {
+    throw std::runtime_error(std::string("metrics socket: ") + std::strerror(errno));
+  }
+  int one = 1;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  socklen_t len = sizeof(addr);
+  if (bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(listenFd_, 16) != 0 ||
+      getsockname(listenFd_, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+    int err = errno;
+    close(listenFd_);
+    throw std::runtime_error("Failed to serve metrics on port " + std::to_string(port) +
+                             ": " + std::strerror(err));
+  }
+  port_ = ntohs(addr.sin_port);
+  thread_ = std::thread(&MetricsHttpServer::serve, this);
+}
+
+MetricsHttpServer::~MetricsHttpServer() {
+  stopping_ = true;
+  shutdown(listenFd_, SHUT_RDWR);
+  if (thread_.joinable()) thread_.join();
+  close(listenFd_);
+}
+
+// One request per connection; whatever the path, the answer is the metrics.
+void MetricsHttpServer::serve() {
+  while (!stopping_) {
+    int fd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    timeval timeout{2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+      ssize_t r = read(fd, buf, sizeof(buf));
+      if (r <= 0) break;
+      request.append(buf, r);
+    }
+    std::string body = registry_.render();
+    std::string response =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body;
+    size_t done = 0;
+    while (done < response.size()) {
+      // A scraper that hangs up early must not SIGPIPE the server.
+      ssize_t w = send(fd, response.data() + done, response.size() - done, MSG_NOSIGNAL);
+      if (w < 0 && errno == EINTR) continue;
+      if (w <= 0) break;
+      done += w;
+    }
+    close(fd);
+  }
+}
@@ -13,6 +13,7 @@
 // limitations under the License.
 #include "utils.h" 
 #include "mlp_encryption_utils.h"
+#include <limits>
 #include <sstream>
 #include <string>
 
@@ -52,14 +53,28 @@ void read_eval_keys(const InstanceParams& prms, CryptoContextT cc) {
 
     std::ifstream erot_file(prms.pubkeydir()/"rk.bin", std::ios::in | std::ios::binary);
     if (!erot_file.is_open() ||
-        !cc->DeserializeEvalAutomorphismKey(erot_file, SerType::BINARY)) {
+        !deserialize_eval_automorphism_keys(erot_file, cc)) {
       throw std::runtime_error(
         "Failed to get rotation keys from " + prms.pubkeydir().string());
     }
 }
 
+// rk.bin is written in chunks by the streaming key generator: a sequence of
+// serialized automorphism-key maps. Each one is merged into the context's
+// key map for its tag.
+bool deserialize_eval_automorphism_keys(std::istream& in, CryptoContextT cc) {
+    bool found = false;
+    while (in.peek() != std::char_traits<char>::eof()) {
+        if (!cc->DeserializeEvalAutomorphismKey(in, SerType::BINARY)) {
+            return false;
+        }
+        found = true;
+    }
+    return found;
+}
 
-ConstCiphertext<DCRTPoly> mlp_encrypt(CryptoContext<DCRTPoly> cc, std::vector<float> input, PublicKey<DCRTPoly> pk) {
+// Encodes the input repeated across every slot.
+static Plaintext mlp_encode(CryptoContext<DCRTPoly> cc, const std::vector<float>& input, uint32_t level) {
   std::vector<double> v11340(std::begin(input), std::end(input));
   uint32_t v11340_filled_n = cc->GetCryptoParameters()->GetElementParams()->GetRingDimension() / 2;
   auto v11340_filled = v11340;
@@ -68,11 +83,20 @@ ConstCiphertext<DCRTPoly> mlp_encrypt(CryptoContext<DCRTPoly> cc, std::vector<fl
   for (uint32_t i = 0; i < v11340_filled_n; ++i) {
     v11340_filled.push_back(v11340[i % v11340.size()]);
   }
-  const auto& v11341 = cc->MakeCKKSPackedPlaintext(v11340_filled);
+  return cc->MakeCKKSPackedPlaintext(v11340_filled, 1, level);
+}
+
+ConstCiphertext<DCRTPoly> mlp_encrypt(CryptoContext<DCRTPoly> cc, std::vector<float> input, PublicKey<DCRTPoly> pk, uint32_t level) {
+  const auto& v11341 = mlp_encode(cc, input, level);
   const auto& v11342 = cc->Encrypt(pk, v11341);
   return v11342;
 }
 
+ConstCiphertext<DCRTPoly> mlp_encrypt_with_zero(CryptoContext<DCRTPoly> cc, const std::vector<float>& input,
+                                                ConstCiphertext<DCRTPoly> zero, uint32_t level) {
+  return cc->EvalAdd(zero, mlp_encode(cc, input, level));
+}
+
 std::vector<float> mlp_decrypt(CryptoContextT v11343, CiphertextT v11344, PrivateKeyT v11345) {
   PlaintextT v11346;
   v11343->Decrypt(v11345, v11344, &v11346);
@@ -103,6 +127,18 @@ void load_dataset(std::vector<Sample> &dataset, const char *filename) {
   }
 }
 
+void polyphase_layout(std::vector<float>& image, int width) {
+  int half = width / 2;
+  std::vector<float> phases(image.begin(), image.begin() + width * width);
+  for (int y = 0; y < width; y++) {
+    for (int x = 0; x < width; x++) {
+      phases[((y % 2) * 2 + x % 2) * half * half + (y / 2) * half + x / 2] =
+          image[y * width + x];
+    }
+  }
+  std::copy(phases.begin(), phases.end(), image.begin());
+}
+
 int argmax(float *A, int N) {
   int max_idx = 0;
   for (int i = 1; i < N; i++) {
@@ -112,3 +148,45 @@ int argmax(float *A, int N) {
   }
   return max_idx;
 }
+
+float top2_margin(float *A, int N) {
+  float first = A[0];
+  float second = -std::numeric_limits<float>::infinity();
+  for (int i = 1; i < N; i++) {
+    if (A[i] > first) {
+      second = first;
+      first = A[i];
+    } else if (A[i] > second) {
+      second = A[i];
+    }
+  }
+  return first - second;
+}
+
+std::vector<int> mlp_rotation_positions() {
+  std::vector<int> rotations;
+  for (int step = 1; step < 1024; step++) {
+    rotations.push_back(step);
+  }
+  return rotations;
+}
+
+std::vector<size_t> read_sample_list(const fs::path& file) {
+  std::vector<size_t> samples;
+  std::ifstream in(file);
+  size_t index;
+  while (in >> index) {
+    samples.push_back(index);
+  }
+  return samples;
+}
+
+void write_sample_list(const fs::path& file, const std::vector<size_t>& samples) {
+  std::ofstream out(file);
+  for (size_t index : samples) {
+    out << index << '\n';
+  }
+  if (!out) {
+    throw std::runtime_error("Failed to write " + file.string());
+  }
+}
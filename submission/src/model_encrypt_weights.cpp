@@ -0,0 +1,50 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Model-owner tool for server_encrypted_compute --encrypted-weights: encrypts
+// the LeNet-5 weights under the client's public key and writes them where the
+// server reads them. Only this tool sees the weights in the clear; run it on
+// the model owner's side, not on the server.
+
+#include "FHEONHEController.h"
+#include "lenet5_fheon.h"
+#include "mlp_encryption_utils.h"
+#include "params.h"
+#include "utils.h"
+#include <chrono>
+
+using namespace lbcrypto;
+
+int main(int argc, char *argv[]) {
+
+  if (argc < 2 || !std::isdigit(argv[1][0])) {
+    std::cout << "Usage: " << argv[0] << " instance-size\n";
+    std::cout << "  Instance-size: 0-SINGLE, 1-SMALL, 2-MEDIUM, 3-LARGE\n";
+    return 0;
+  }
+  auto size = static_cast<InstanceSize>(std::stoi(argv[1]));
+  InstanceParams prms(size);
+
+  CryptoContext<DCRTPoly> cc = read_crypto_context(prms);
+  PublicKey<DCRTPoly> pk = read_public_key(prms);
+  FHEONHEController fheonHEController(cc);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  lenet5_write_encrypted_weights(fheonHEController, pk, prms.encrypted_weights_file().string());
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << "         [owner] Encrypted model weights to " << prms.encrypted_weights_file().string()
+            << " in " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+            << " ms" << std::endl;
+  return 0;
+}
@@ -0,0 +1,189 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "numa_keys.h"
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+using AutomorphismKeys =
+    std::map<std::string, std::shared_ptr<std::map<uint32_t, EvalKey<DCRTPoly>>>>;
+using MultKeys = std::map<std::string, std::vector<EvalKey<DCRTPoly>>>;
+
+// Parses a sysfs cpulist such as "0-3,8-11".
+std::vector<int> parse_cpulist(const std::string& text) {
+  std::vector<int> cpus;
+  std::stringstream ss(text);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || !std::isdigit(range[0])) continue;
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int c = first; c <= last; ++c) cpus.push_back(c);
+  }
+  return cpus;
+}
+
+// Binds the calling thread's future allocations to the node. Failure is not
+// fatal: first touch from a pinned thread still places most pages locally.
+void bind_memory_to_node(int node) {
+  std::vector<unsigned long> mask(node / (8 * sizeof(unsigned long)) + 1, 0);
+  mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+  if (syscall(SYS_set_mempolicy, MPOL_BIND, mask.data(),
+              mask.size() * 8 * sizeof(unsigned long) + 1) != 0) {
+    std::cerr << "         [numa] set_mempolicy for node " << node
+              << " failed; relying on first touch" << std::endl;
+  }
+}
+
+// Reads every serialized map in a key file; `merge` folds each into the result.
+template <typename Keys, typename Merge>
+Keys deserialize_all(const fs::path& file, Merge merge) {
+  std::ifstream in(file, std::ios::in | std::ios::binary);
+  if (!in.is_open()) {
+    throw std::runtime_error("Failed to open " + file.string());
+  }
+  Keys keys;
+  while (in.peek() != std::char_traits<char>::eof()) {
+    Keys chunk;
+    Serial::Deserialize(chunk, in, SerType::BINARY);
+    for (auto& entry : chunk) merge(keys[entry.first], entry.second);
+  }
+  return keys;
+}
+
+MultKeys read_mult_keys(const fs::path& file) {
+  return deserialize_all<MultKeys>(file, [](auto& into, auto& from) { into = std::move(from); });
+}
+
+// rk.bin is a sequence of chunks of the same tag (see
+// deserialize_eval_automorphism_keys); their indices are merged.
+AutomorphismKeys read_automorphism_keys(const fs::path& file) {
+  return deserialize_all<AutomorphismKeys>(file, [](auto& into, auto& from) {
+    if (!into) into = std::make_shared<std::map<uint32_t, EvalKey<DCRTPoly>>>();
+    into->insert(from->begin(), from->end());
+  });
+}
+
+}  // namespace
+
+std::vector<NumaNode> numa_nodes() {
+  std::vector<NumaNode> nodes;
+  const fs::path root = "/sys/devices/system/node";
+  std::error_code ec;
+  for (const auto& dir : fs::directory_iterator(root, ec)) {
+    std::string name = dir.path().filename().string();
+    if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::isdigit(name[4])) continue;
+    std::ifstream list(dir.path() / "cpulist");
+    std::string text;
+    std::getline(list, text);
+    NumaNode node;
+    node.id = std::stoi(name.substr(4));
+    node.cpus = parse_cpulist(text);
+    if (!node.cpus.empty()) nodes.push_back(std::move(node));
+  }
+  if (nodes.empty()) {
+    NumaNode all;
+    unsigned n = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned c = 0; c < n; ++c) all.cpus.push_back(c);
+    nodes.push_back(std::move(all));
+  }
+  std::sort(nodes.begin(), nodes.end(),
+            [](const NumaNode& a, const NumaNode& b) { return a.id < b.id; });
+  return nodes;
+}
+
+void pin_thread_to_node(const NumaNode& node) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : node.cpus) {
+    if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+  }
+  int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (rc != 0) {
+    std::cerr << "         [numa] cannot pin thread to node " << node.id << ": "
+              << std::strerror(rc) << std::endl;
+  }
+}
+
+NumaKeyReplicas::NumaKeyReplicas(const fs::path& keyDir, CryptoContext<DCRTPoly> cc,
+                                 const std::string& baseTag)
+    : nodes_(numa_nodes()) {
+  tags_.push_back(baseTag);
+  for (size_t i = 1; i < nodes_.size(); ++i) {
+    tags_.push_back(baseTag + "@numa" + std::to_string(nodes_[i].id));
+  }
+
+  // Deserialize every replica concurrently, each on its own node, then
+  // register them from this thread.
+  size_t replicas = nodes_.size() - 1;
+  std::vector<MultKeys> mult(replicas);
+  std::vector<AutomorphismKeys> rot(replicas);
+  std::vector<std::exception_ptr> failures(replicas);
+  std::vector<std::thread> loaders;
+  for (size_t r = 0; r < replicas; ++r) {
+    loaders.emplace_back([&, r]() {
+      try {
+        const NumaNode& node = nodes_[r + 1];
+        pin_thread_to_node(node);
+        bind_memory_to_node(node.id);
+        mult[r] = read_mult_keys(keyDir / "mk.bin");
+        rot[r] = read_automorphism_keys(keyDir / "rk.bin");
+      } catch (...) {
+        failures[r] = std::current_exception();
+      }
+    });
+  }
+  for (auto& t : loaders) t.join();
+  for (auto& failure : failures) {
+    if (failure) std::rethrow_exception(failure);
+  }
+
+  for (size_t r = 0; r < replicas; ++r) {
+    auto multKeys = mult[r].find(baseTag);
+    auto rotKeys = rot[r].find(baseTag);
+    if (multKeys == mult[r].end() || rotKeys == rot[r].end()) {
+      throw std::runtime_error("No evaluation keys for tag " + baseTag + " in " +
+                               keyDir.string());
+    }
+    cc->InsertEvalMultKey(multKeys->second, tags_[r + 1]);
+    cc->InsertEvalAutomorphismKey(rotKeys->second, tags_[r + 1]);
+  }
+  std::cout << "         [numa] " << nodes_.size() << " node(s), "
+            << replicas << " key replica(s)" << std::endl;
+}
+
+NumaKeyReplicas::~NumaKeyReplicas() {
+  for (size_t i = 1; i < tags_.size(); ++i) {
+    CryptoContextImpl<DCRTPoly>::ClearEvalMultKeys(tags_[i]);
+    CryptoContextImpl<DCRTPoly>::ClearEvalAutomorphismKeys(tags_[i]);
+  }
+}
@@ -13,59 +13,287 @@
 // limitations under the License.
 
 #include "FHEONHEController.h"
+#include "FHEONTrace.h"
+#include "eval_key_cache.h"
+#include "io_backend.h"
 #include "lenet5_fheon.h"
 #include "mlp_encryption_utils.h"
+#include "mlp_openfhe.h"
+#include "numa_keys.h"
 #include "params.h"
 #include "utils.h"
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 using namespace lbcrypto;
 
 int main(int argc, char *argv[]) {
 
   if (argc < 2 || !std::isdigit(argv[1][0])) {
-    std::cout << "Usage: " << argv[0] << " instance-size \n";
+    std::cout << "Usage: " << argv[0] << " instance-size [--rerun | --cascade] [--encrypted-weights] [--workers N]\n"
+              << "       [--jit-weights MB] [--numa-keys] [--trace FILE]\n";
     std::cout << "  Instance-size: 0-SINGLE, 1-SMALL, 2-MEDIUM, 3-LARGE\n";
+    std::cout << "  --rerun: run the flagged samples under the high-precision plan\n";
+    std::cout << "  --cascade: run the MLP on the whole batch; the client sends low-margin samples back with --rerun\n";
+    std::cout << "  --encrypted-weights: run with the weights model_encrypt_weights encrypted under the client key\n";
+    std::cout << "  --workers N: run N inferences concurrently (default 1)\n";
+    std::cout << "  --jit-weights MB: encode weights layer by layer, keeping at most MB resident (0 = no cap)\n";
+    std::cout << "  --numa-keys: one copy of the evaluation keys per NUMA node; workers use their node's copy\n";
+    std::cout << "  --trace FILE: record the operations of the first inference for trace_replay\n";
     return 0;
   }
   auto size = static_cast<InstanceSize>(std::stoi(argv[1]));
   InstanceParams prms(size);
+  bool rerun = false;
+  bool cascade = false;
+  bool encryptedWeights = false;
+  int workers = 1;
+  bool jitWeights = false;
+  size_t jitBudgetMB = 0;
+  bool numaKeys = false;
+  std::string traceFile;
+  for (int a = 2; a < argc; ++a) {
+    std::string arg = argv[a];
+    if (arg == "--rerun") rerun = true;
+    else if (arg == "--cascade") cascade = true;
+    else if (arg == "--encrypted-weights") encryptedWeights = true;
+    else if (arg == "--numa-keys") numaKeys = true;
+    else if (arg != "--workers" && arg != "--trace" && arg != "--jit-weights") {
+      throw std::runtime_error("Unknown option " + arg);
+    } else if (a + 1 == argc) {
+      throw std::runtime_error(arg + " needs a value");
+    } else if (arg == "--workers") {
+      workers = std::max(1, std::stoi(argv[++a]));
+    } else if (arg == "--trace") {
+      traceFile = argv[++a];
+    } else {
+      jitWeights = true;
+      jitBudgetMB = std::stoul(argv[++a]);
+    }
+  }
+  // Bulk inference runs the fast plan; the client flags results whose margin
+  // it cannot trust and sends those back for a high-precision run.
+  Lenet5Plan plan = rerun ? Lenet5Plan() : Lenet5Plan::fast();
+  std::vector<size_t> samples;
+  if (rerun) {
+    samples = read_sample_list(prms.rerun_samples_file());
+  } else {
+    for (size_t i = 0; i < prms.getBatchSize(); ++i) samples.push_back(i);
+  }
 
+  if (cascade && (rerun || encryptedWeights || jitWeights)) {
+    // The MLP carries its own weights; LeNet-5 options apply to the re-run.
+    throw std::runtime_error("--cascade cannot be combined with LeNet-5 options");
+  }
+  if (numaKeys && encryptedWeights) {
+    // Encrypted weights carry the original key tag, so every multiplication
+    // would need the original keys anyway.
+    throw std::runtime_error("--numa-keys cannot be combined with --encrypted-weights");
+  }
   CryptoContext<DCRTPoly> cc = read_crypto_context(prms);
-  read_eval_keys(prms, cc);
+  // The original keys serve node 0, so load them from there.
+  std::vector<NumaNode> nodes = numa_nodes();
+  if (numaKeys) pin_thread_to_node(nodes[0]);
+  // Evaluation keys are held through the key cache so the same code path
+  // serves one client here and many in a shared deployment.
+  EvalKeyCache keyCache;
+  auto keyLease = keyCache.acquire(prms.pubkeydir().string(), prms.pubkeydir(), cc);
+  std::unique_ptr<NumaKeyReplicas> replicas;
+  if (numaKeys) {
+    replicas = std::make_unique<NumaKeyReplicas>(prms.pubkeydir(), cc, keyLease.tag());
+  }
   PublicKey<DCRTPoly> pk = read_public_key(prms);
   PrivateKey<DCRTPoly> sk = read_secret_key(prms);
 
-  int numSlots = 1 << 12;
-  std::vector<uint32_t> levelBudget = {4, 4};
-  std::vector<uint32_t> bsgsDim = {0, 0};
-  cc->EvalBootstrapSetup(levelBudget, bsgsDim, numSlots);
+  if (!cascade) cc->EvalBootstrapSetup(BOOTSTRAP_LEVEL_BUDGET, BOOTSTRAP_BSGS_DIM, BOOTSTRAP_SLOTS);
 
   std::cout << "         [server] Loading keys" << std::endl;
 
-  Ctext ctxt;
   fs::create_directories(prms.ctxtdowndir());
   std::cout << "         [server] run encrypted MNIST inference" << std::endl;
 
   FHEONHEController fheonHEController(cc);
-  for (size_t i = 0; i < prms.getBatchSize(); ++i) {
-    auto input_ctxt_path =
-        prms.ctxtupdir() / ("cipher_input_" + std::to_string(i) + ".bin");
-    if (!Serial::DeserializeFromFile(input_ctxt_path, ctxt, SerType::BINARY)) {
-      throw std::runtime_error("Failed to get ciphertexts from " +
-                               input_ctxt_path.string());
+  auto load_start = std::chrono::high_resolution_clock::now();
+  // Model-private mode: the model owner encrypted the weights under the
+  // client's key (model_encrypt_weights); the server only reads ciphertexts.
+  Lenet5Weights weights;
+  Lenet5EncryptedWeights encWeights;
+  // Memory-bounded mode: only the raw weights stay resident; each layer is
+  // encoded when needed while the next one is prefetched.
+  FHEONWeightProvider provider(fheonHEController, FHEONWeightProvider::Mode::JustInTime,
+                               jitBudgetMB << 20);
+  // The cap covers the cached masks as well as the weights.
+  if (jitWeights && jitBudgetMB > 0) fheonHEController.masks().set_budget(jitBudgetMB << 20);
+  if (cascade) {
+    // The MLP stage needs no LeNet-5 weights.
+  } else if (encryptedWeights) {
+    encWeights = lenet5_read_encrypted_weights(prms.encrypted_weights_file().string());
+  } else if (jitWeights) {
+    lenet5_register_weights(provider, fheonHEController);
+  } else {
+    weights = lenet5_load_weights(fheonHEController);
+  }
+  auto load_end = std::chrono::high_resolution_clock::now();
+  std::cout << "         [server] "
+            << (cascade ? "Skipped" : encryptedWeights ? "Read encrypted" : jitWeights ? "Read" : "Encoded")
+            << " model weights in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   load_end - load_start)
+                   .count()
+            << " ms" << std::endl;
+
+  for (const auto &conv : cascade ? std::vector<Lenet5ConvMemory>() : lenet5_conv_memory(cc, plan)) {
+    // Modelled from ciphertext counts, not measured: the EvalFastRotationPrecompute
+    // digits of each hoisted input are not included.
+    std::cout << "         [server] " << conv.layer << " tap buffers: " << conv.held
+              << " of " << conv.materialized << " ciphertexts (estimated "
+              << ((conv.materialized - conv.held) * conv.ciphertextBytes >> 20)
+              << " MB less per worker, digit buffers excluded)" << std::endl;
+  }
+
+  // Wall and process CPU time of each LeNet-5 stage, summed over the batch,
+  // for the harness's per-layer efficiency report.
+  struct LayerTotals {
+    std::string layer;
+    size_t calls = 0;
+    double wall = 0;
+    double cpu = 0;
+    size_t savedKeySwitches = 0;
+    size_t reusedMasks = 0;
+  };
+  std::vector<LayerTotals> layerTotals;
+  std::mutex layerMutex;
+  lenet5_set_layer_observer([&](const char *layer, const Lenet5LayerSample &sample) {
+    std::lock_guard<std::mutex> lock(layerMutex);
+    auto it = std::find_if(layerTotals.begin(), layerTotals.end(),
+                           [layer](const LayerTotals &t) { return t.layer == layer; });
+    if (it == layerTotals.end()) {
+      layerTotals.push_back({layer});
+      it = layerTotals.end() - 1;
     }
-    auto start = std::chrono::high_resolution_clock::now();
-    auto ctxtResult = lenet5(fheonHEController, cc, ctxt);
-
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration =
-        std::chrono::duration_cast<std::chrono::seconds>(end - start);
-    std::cout << "         [server] Execution time for ciphertext " << i
-              << " : " << duration.count() << " seconds" << std::endl;
-    auto result_ctxt_path =
-        prms.ctxtdowndir() / ("cipher_result_" + std::to_string(i) + ".bin");
-    Serial::SerializeToFile(result_ctxt_path, ctxtResult, SerType::BINARY);
+    it->calls++;
+    it->wall += sample.seconds;
+    it->cpu += sample.cpuSeconds;
+    it->savedKeySwitches += sample.savedKeySwitches;
+    it->reusedMasks += sample.reusedMasks;
+  });
+
+  auto io = make_io_backend();
+  std::atomic<bool> traced(traceFile.empty());
+  for (size_t first = 0; first < samples.size(); first += kIoBatchSize) {
+    size_t last = std::min(first + kIoBatchSize, samples.size());
+    std::vector<IoRequest> reads(last - first);
+    for (size_t n = first; n < last; ++n) {
+      reads[n - first].path = prms.ctxtupdir() /
+          ("cipher_input_" + std::to_string(samples[n]) + ".bin");
+    }
+    io->read_batch(reads);
+
+    // Each worker takes the next sample of the window. The workers share the
+    // context, keys and weights, which are only read during evaluation; the
+    // OpenMP threads of each worker come from OMP_NUM_THREADS.
+    std::vector<IoRequest> writes(last - first);
+    std::atomic<size_t> next(first);
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+    // With --numa-keys, worker w runs on node w % nodes and evaluates under
+    // that node's key replica.
+    auto worker = [&](int w) {
+      try {
+        size_t node = replicas ? w % replicas->nodes() : 0;
+        if (replicas) pin_thread_to_node(replicas->node(node));
+        Ctext ctxt;
+        for (size_t n = next++; n < last; n = next++) {
+          size_t i = samples[n];
+          deserialize_binary(reads[n - first].data, ctxt, reads[n - first].path.string());
+          reads[n - first].data.clear();
+          if (replicas) ctxt->SetKeyTag(replicas->tag(node));
+          // The first inference of --trace is recorded on its worker's thread.
+          FHEONTraceRecorder recorder;
+          std::unique_ptr<FHEONTraceRecorder::Scope> traceScope;
+          if (!traced.exchange(true)) {
+            traceScope = std::make_unique<FHEONTraceRecorder::Scope>(recorder);
+          }
+          auto start = std::chrono::high_resolution_clock::now();
+          // mlp() returns a const ciphertext; this worker is its only owner.
+          auto ctxtResult =
+              cascade
+                  ? std::const_pointer_cast<CiphertextImpl<DCRTPoly>>(mlp(cc, ctxt))
+              : encryptedWeights
+                  ? lenet5(fheonHEController, cc, encWeights, ctxt, plan)
+              : jitWeights
+                  ? lenet5(fheonHEController, cc, provider, ctxt, plan)
+                  : lenet5(fheonHEController, cc, weights, ctxt, plan);
+          traceScope.reset();
+
+          if (replicas) ctxtResult->SetKeyTag(keyLease.tag());
+          auto end = std::chrono::high_resolution_clock::now();
+          auto duration =
+              std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+          std::ostringstream line;
+          line << "         [server] Execution time for ciphertext " << i
+               << " : " << duration.count() << " ms\n";
+          std::cout << line.str() << std::flush;
+          if (!recorder.operations().empty()) {
+            recorder.save(traceFile);
+            std::cout << "         [server] Traced " << recorder.operations().size()
+                      << " operations of ciphertext " << i << " to " << traceFile
+                      << std::endl;
+          }
+          writes[n - first].path =
+              prms.ctxtdowndir() / ("cipher_result_" + std::to_string(i) + ".bin");
+          writes[n - first].data = serialize_binary(ctxtResult);
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(failureMutex);
+        if (!failure) failure = std::current_exception();
+        next = last;
+      }
+    };
+    std::vector<std::thread> pool;
+    for (int w = 1; w < workers; ++w) pool.emplace_back(worker, w);
+    worker(0);
+    for (auto &t : pool) t.join();
+    if (failure) std::rethrow_exception(failure);
+    io->write_batch(writes);
+  }
+  if (!layerTotals.empty()) {
+    // Process CPU time is only the stage's own while one inference runs, so
+    // concurrent workers report wall time alone.
+    cpu_set_t affinity;
+    int cores = sched_getaffinity(0, sizeof(affinity), &affinity) == 0
+                    ? CPU_COUNT(&affinity)
+                    : std::max(1u, std::thread::hardware_concurrency());
+    std::ofstream report(prms.iodir() /
+                         (rerun ? "server_layers_rerun.json" : "server_layers.json"));
+    report << "{\n  \"workers\": " << workers << ",\n  \"cores\": " << cores
+           << ",\n  \"layers\": [";
+    for (size_t l = 0; l < layerTotals.size(); ++l) {
+      const LayerTotals &t = layerTotals[l];
+      report << (l ? "," : "") << "\n    {\"layer\": \"" << t.layer << "\", \"calls\": " << t.calls
+             << ", \"wall_s\": " << t.wall << ", \"saved_key_switches\": " << t.savedKeySwitches
+             << ", \"reused_masks\": " << t.reusedMasks;
+      if (workers == 1) {
+        report << ", \"cpu_s\": " << t.cpu << ", \"parallel_efficiency\": "
+               << (t.wall > 0 ? t.cpu / (t.wall * cores) : 0);
+      }
+      report << "}";
+    }
+    report << "\n  ]\n}\n";
+  }
+  if (jitWeights) {
+    std::cout << "         [server] Resident encoded weights at exit: "
+              << (provider.resident_bytes() >> 20) << " MB, masks: "
+              << (fheonHEController.masks().resident_bytes() >> 20) << " MB" << std::endl;
   }
 
   return 0;
@@ -0,0 +1,294 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Resident inference server: loads the keys and weights once, then serves
+// LeNet-5 inferences over a Unix socket until killed (see inference_wire.h).
+// Requests from all connections go through one FIFO queue drained by
+// --workers threads, so the queueing delay it reports is what an arrival
+// actually waits under load. Each request leases its tenant's evaluation
+// keys from an EvalKeyCache for the length of its inference.
+
+#include "FHEONHEController.h"
+#include "eval_key_cache.h"
+#include "inference_wire.h"
+#include "io_backend.h"
+#include "lenet5_fheon.h"
+#include "metrics.h"
+#include "mlp_encryption_utils.h"
+#include "params.h"
+#include "utils.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+using namespace lbcrypto;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// One client connection. Responses of several workers may interleave, so
+// writes are serialized.
+struct Connection {
+  explicit Connection(int fd) : fd(fd) {}
+  ~Connection() { close(fd); }
+  int fd;
+  std::mutex writeMutex;
+};
+
+struct Job {
+  std::shared_ptr<Connection> conn;
+  WireHeader header;
+  std::string payload;
+  Clock::time_point arrival;
+};
+
+class JobQueue {
+ public:
+  void push(Job job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(std::move(job));
+    }
+    ready_.notify_one();
+  }
+  Job pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.wait(lock, [this] { return !jobs_.empty(); });
+    Job job = std::move(jobs_.front());
+    jobs_.pop_front();
+    return job;
+  }
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return jobs_.size();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<Job> jobs_;
+};
+
+uint64_t micros(Clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+double to_seconds(Clock::duration d) {
+  return std::chrono::duration<double>(d).count();
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+
+  if (argc < 2 || !std::isdigit(argv[1][0])) {
+    std::cout << "Usage: " << argv[0] << " instance-size [--socket PATH] [--workers N]"
+                 " [--metrics-port P] [--metrics-file PATH]\n"
+                 "       [--tenant-dir DIR] [--key-budget MB]\n";
+    std::cout << "  Instance-size: 0-SINGLE, 1-SMALL, 2-MEDIUM, 3-LARGE\n";
+    std::cout << "  --socket PATH: Unix socket to listen on (default " INFERENCE_SOCKET ")\n";
+    std::cout << "  --workers N: inferences run concurrently (default 1)\n";
+    std::cout << "  --metrics-port P: serve Prometheus metrics on 127.0.0.1:P\n";
+    std::cout << "  --metrics-file PATH: rewrite the metrics to PATH every 15 s\n";
+    std::cout << "  --tenant-dir DIR: tenant t > 0 has its keys in DIR/t (tenant 0 uses the default keys)\n";
+    std::cout << "  --key-budget MB: evaluation keys kept resident across tenants (default no cap)\n";
+    return 0;
+  }
+  auto size = static_cast<InstanceSize>(std::stoi(argv[1]));
+  InstanceParams prms(size);
+  std::string socketPath = INFERENCE_SOCKET;
+  int workers = 1;
+  int metricsPort = -1;
+  std::string metricsFile;
+  fs::path tenantDir;
+  size_t keyBudget = EvalKeyCache::kUnlimited;
+  // Every option takes a value; a typo or a missing value must not leave a
+  // long-running daemon on its defaults.
+  for (int a = 2; a < argc; ++a) {
+    std::string arg = argv[a];
+    if (arg != "--socket" && arg != "--workers" && arg != "--metrics-port" && arg != "--metrics-file" &&
+        arg != "--tenant-dir" && arg != "--key-budget") {
+      throw std::runtime_error("Unknown option " + arg);
+    }
+    if (a + 1 == argc) throw std::runtime_error(arg + " needs a value");
+    if (arg == "--socket") socketPath = argv[++a];
+    else if (arg == "--workers") workers = std::max(1, std::stoi(argv[++a]));
+    else if (arg == "--metrics-port") metricsPort = std::stoi(argv[++a]);
+    else if (arg == "--metrics-file") metricsFile = argv[++a];
+    else if (arg == "--tenant-dir") tenantDir = argv[++a];
+    else keyBudget = std::stoul(argv[++a]) << 20;
+  }
+
+  // All tenants share this context; only their keys differ.
+  CryptoContext<DCRTPoly> cc = read_crypto_context(prms);
+  EvalKeyCache keyCache(keyBudget);
+  auto tenant_keys = [&](uint64_t tenant) {
+    if (tenant == 0) return prms.pubkeydir();
+    if (tenantDir.empty()) {
+      throw std::runtime_error("unknown tenant " + std::to_string(tenant) + " (no --tenant-dir)");
+    }
+    return tenantDir / std::to_string(tenant);
+  };
+  // Load the default tenant now so that its first request does not pay for it.
+  keyCache.acquire("0", tenant_keys(0), cc);
+
+  cc->EvalBootstrapSetup(BOOTSTRAP_LEVEL_BUDGET, BOOTSTRAP_BSGS_DIM, BOOTSTRAP_SLOTS);
+
+  FHEONHEController fheonHEController(cc);
+  Lenet5Weights weights = lenet5_load_weights(fheonHEController);
+  const Lenet5Plan plan = Lenet5Plan::fast();
+
+  JobQueue queue;
+
+  // Instruments are created up front; the request path only touches atomics.
+  MetricsRegistry metrics;
+  register_process_metrics(metrics);
+  Counter &requests = metrics.counter("fheon_requests_total",
+                                       "Inference requests handled, failed ones included.");
+  Counter &failures = metrics.counter("fheon_request_failures_total", "Inference requests that failed.");
+  Histogram &queueTime = metrics.histogram("fheon_request_queue_seconds",
+                                           "Time a request waited for a worker.", latency_buckets());
+  Histogram &computeTime = metrics.histogram("fheon_request_compute_seconds",
+                                             "Time a worker spent on a request.", latency_buckets());
+  Gauge &busy = metrics.gauge("fheon_workers_busy", "Workers running an inference.");
+  Gauge &queueDepth = metrics.gauge("fheon_queue_depth", "Requests waiting for a worker.");
+  Gauge &keyBytes = metrics.gauge("fheon_key_cache_bytes", "Serialized size of the resident evaluation keys.");
+  Gauge &keyTenants = metrics.gauge("fheon_key_cache_tenants", "Tenants whose evaluation keys are resident.");
+  Counter &bootstraps = metrics.counter("fheon_bootstraps_total", "Bootstraps run by all inferences.");
+  metrics.gauge("fheon_workers", "Configured inference workers.").set(workers);
+  metrics.add_collector([&]() {
+    queueDepth.set(queue.size());
+    keyBytes.set(keyCache.resident_bytes());
+    keyTenants.set(keyCache.resident_tenants());
+  });
+  struct LayerInstruments {
+    Histogram *seconds;
+    Counter *savedKeySwitches;
+  };
+  // Read-only once the workers start, so the observer looks it up unlocked.
+  std::map<std::string, LayerInstruments, std::less<>> layerInstruments;
+  for (const auto &layer : lenet5_stage_names()) {
+    layerInstruments[layer] = {
+        &metrics.histogram("fheon_layer_seconds", "Time spent in each LeNet-5 stage.", latency_buckets(),
+                           {{"layer", layer}}),
+        &metrics.counter("fheon_layer_saved_key_switches_total",
+                         "Key switches each LeNet-5 stage took from the rotation memo.", {{"layer", layer}})};
+  }
+  lenet5_set_layer_observer([&layerInstruments, &bootstraps](const char *layer, const Lenet5LayerSample &sample) {
+    auto it = layerInstruments.find(std::string_view(layer));
+    if (it == layerInstruments.end()) return;
+    it->second.seconds->observe(sample.seconds);
+    it->second.savedKeySwitches->inc(sample.savedKeySwitches);
+    if (std::strcmp(layer, "bootstrap") == 0) bootstraps.inc();
+  });
+  std::unique_ptr<MetricsHttpServer> metricsServer;
+  if (metricsPort >= 0) {
+    metricsServer = std::make_unique<MetricsHttpServer>(metrics, metricsPort);
+    std::cout << "         [server] metrics on http://127.0.0.1:" << metricsServer->port()
+              << "/metrics" << std::endl;
+  }
+  if (!metricsFile.empty()) {
+    std::thread([&metrics, metricsFile]() {
+      for (;;) {
+        std::this_thread::sleep_for(std::chrono::seconds(15));
+        try {
+          metrics.write_file(metricsFile);
+        } catch (const std::exception &e) {
+          std::cerr << "         [server] " << e.what() << std::endl;
+        }
+      }
+    }).detach();
+  }
+
+  std::vector<std::thread> pool;
+  for (int w = 0; w < workers; ++w) {
+    pool.emplace_back([&]() {
+      for (;;) {
+        Job job = queue.pop();
+        auto start = Clock::now();
+        busy.add(1);
+        queueTime.observe(to_seconds(start - job.arrival));
+        WireHeader reply;
+        reply.id = job.header.id;
+        reply.queue_us = micros(start - job.arrival);
+        std::string result;
+        try {
+          Ctext ctxt;
+          deserialize_binary(job.payload, ctxt, "the request payload");
+          job.payload.clear();
+          uint64_t tenant = job.header.tenant;
+          auto keyLease = keyCache.acquire(std::to_string(tenant), tenant_keys(tenant), cc);
+          if (ctxt->GetKeyTag() != keyLease.tag()) {
+            throw std::runtime_error("ciphertext is not under tenant " + std::to_string(tenant) + "'s keys");
+          }
+          result = serialize_binary(lenet5(fheonHEController, cc, weights, ctxt, plan));
+        } catch (const std::exception &e) {
+          // An empty payload tells the client this request failed.
+          std::cerr << "         [server] request " << job.header.id
+                    << " failed: " << e.what() << std::endl;
+          failures.inc();
+        }
+        auto end = Clock::now();
+        reply.compute_us = micros(end - start);
+        computeTime.observe(to_seconds(end - start));
+        requests.inc();
+        busy.add(-1);
+        try {
+          std::lock_guard<std::mutex> lock(job.conn->writeMutex);
+          write_message(job.conn->fd, reply, result);
+        } catch (const std::exception &e) {
+          std::cerr << "         [server] dropping reply " << job.header.id
+                    << ": " << e.what() << std::endl;
+        }
+      }
+    });
+  }
+
+  int listenFd = listen_unix_socket(socketPath);
+  std::cout << "         [server] serving on " << socketPath << " with "
+            << workers << " worker(s)" << std::endl;
+  for (;;) {
+    int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      throw std::runtime_error(std::string("accept: ") + std::strerror(errno));
+    }
+    auto conn = std::make_shared<Connection>(fd);
+    std::thread([conn, &queue]() {
+      try {
+        Job job;
+        while (read_message(conn->fd, job.header, job.payload)) {
+          job.conn = conn;
+          job.arrival = Clock::now();
+          queue.push(std::move(job));
+          job = Job();
+        }
+      } catch (const std::exception &e) {
+        std::cerr << "         [server] connection error: " << e.what() << std::endl;
+      }
+    }).detach();
+  }
+  return 0;
+}
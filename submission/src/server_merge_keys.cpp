@@ -0,0 +1,39 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Merges a client's rotation-key delta (see client_key_delta) into the
+// server's key store.
+
+#include "key_store.h"
+#include "utils.h"
+
+int main(int argc, char *argv[]) {
+
+  if (argc < 2 || !std::isdigit(argv[1][0])) {
+    std::cout << "Usage: " << argv[0] << " instance-size\n";
+    std::cout << "  Instance-size: 0-SINGLE, 1-SMALL, 2-MEDIUM, 3-LARGE\n";
+    return 0;
+  }
+  auto size = static_cast<InstanceSize>(std::stoi(argv[1]));
+  InstanceParams prms(size);
+
+  if (!fs::exists(prms.pubkeydir() / KEY_DELTA_MANIFEST_FILE)) {
+    std::cout << "         [server] no key delta to merge" << std::endl;
+    return 0;
+  }
+  merge_key_delta(prms.pubkeydir());
+  std::cout << "         [server] merged key delta into "
+            << prms.pubkeydir().string() << std::endl;
+  return 0;
+}
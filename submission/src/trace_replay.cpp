@@ -0,0 +1,534 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replays an operation trace (FHEONTrace.h; server_encrypted_compute --trace)
+// on synthetic ciphertexts under a chosen parameter set, and reports the time
+// of each operation kind next to the recorded time.
+//
+// Operands are encrypted random values with the recorded towers, noise degree
+// and slots. Towers are counted from the bottom of the modulus chain, so a
+// ciphertext that had k levels left still has k: a trace recorded at one
+// depth replays at another as long as the new chain is tall enough. Taller
+// operands are clamped to a fresh ciphertext and reported. A ciphertext the
+// trace produced is reused for its later arguments while its towers still
+// match the recording; otherwise a fresh one is synthesized. Synthesis, key
+// generation and operand bookkeeping are not timed.
+
+#include <iomanip>
+#include <map>
+#include <random>
+
+#include "FHEONInnerProduct.h"
+#include "FHEONTrace.h"
+
+namespace {
+
+struct Operand {
+  char kind = 'n';
+  std::string id;
+  int towers = 0;
+  int degree = 1;
+  int elements = 2;
+  int slots = 0;
+  long long integer = 0;
+  double number = 0;
+  std::vector<Operand> items;
+};
+
+int field(const std::vector<std::string> &parts, size_t i) {
+  return i < parts.size() ? std::stoi(parts[i]) : 0;
+}
+
+Operand parse_operand(const std::vector<std::string> &tokens, size_t &pos) {
+  const std::string &token = tokens.at(pos++);
+  std::vector<std::string> parts;
+  std::stringstream ss(token);
+  for (std::string part; std::getline(ss, part, ':');) parts.push_back(part);
+  Operand operand;
+  operand.kind = token[0];
+  switch (operand.kind) {
+    case 'c':
+      operand.id = parts.at(1);
+      operand.towers = field(parts, 2);
+      operand.degree = field(parts, 3);
+      operand.elements = field(parts, 4);
+      operand.slots = field(parts, 5);
+      break;
+    case 'p':
+      operand.towers = field(parts, 1);
+      operand.degree = field(parts, 2);
+      operand.slots = field(parts, 3);
+      break;
+    case 'k':
+      operand.id = parts.at(1);
+      break;
+    case 'V':
+    case 'W':
+      for (int n = field(parts, 1); n > 0; --n) {
+        operand.items.push_back(parse_operand(tokens, pos));
+      }
+      break;
+    case 'x':
+    case 'i':
+      operand.integer = std::stoll(parts.at(1));
+      break;
+    case 'd':
+      operand.number = std::stod(parts.at(1));
+      break;
+  }
+  return operand;
+}
+
+std::vector<Operand> parse_operands(const std::vector<std::string> &tokens) {
+  std::vector<Operand> operands;
+  for (size_t pos = 0; pos < tokens.size();) {
+    operands.push_back(parse_operand(tokens, pos));
+  }
+  return operands;
+}
+
+struct Step {
+  std::string name;
+  double recorded = 0;
+  Operand result;
+  std::vector<Operand> args;
+};
+
+struct Options {
+  std::string trace;
+  uint32_t ringDim = 1 << 13;
+  uint32_t depth = 12;
+  uint32_t scaleBits = 46;
+  uint32_t firstMod = 50;
+  uint32_t digits = 4;
+  uint32_t slots = 1 << 12;
+  bool json = false;
+};
+
+struct Totals {
+  size_t count = 0;
+  double replayed = 0;
+  double recorded = 0;
+};
+
+class Replayer {
+ public:
+  Replayer(const Options &options, const std::vector<Step> &steps)
+      : options_(options), steps_(steps), random_(7) {
+    for (size_t s = 0; s < steps_.size(); ++s) {
+      for (const auto &arg : steps_[s].args) note_uses(arg, s);
+    }
+    build_context();
+  }
+
+  void run();
+  void report(std::ostream &out) const;
+
+ private:
+  const Options &options_;
+  const std::vector<Step> &steps_;
+  std::mt19937 random_;
+  CryptoContext<DCRTPoly> cc_;
+  KeyPair<DCRTPoly> keys_;
+  int freshTowers_ = 0;
+  std::map<std::string, size_t> lastUse_;
+  std::map<std::string, Ctext> live_;
+  std::map<std::string, std::shared_ptr<std::vector<DCRTPoly>>> digits_;
+  std::map<std::string, Totals> totals_;
+  size_t synthesized_ = 0;
+  size_t clamped_ = 0;
+  size_t failed_ = 0;
+  size_t skipped_ = 0;
+  std::string firstFailure_;
+
+  void note_uses(const Operand &operand, size_t step) {
+    if (operand.kind == 'c' || operand.kind == 'k') lastUse_[operand.id] = step;
+    for (const auto &item : operand.items) note_uses(item, step);
+  }
+  void build_context();
+  int level_for(int towers);
+  std::vector<double> values(int slots);
+  Ptext plaintext(const Operand &operand);
+  Ctext ciphertext(const Operand &operand);
+  Ctext synthesize(const Operand &operand);
+  std::vector<Ctext> ciphertexts(const Operand &operand);
+  std::vector<Ptext> plaintexts(const Operand &operand);
+  double execute(const Step &step, Ctext &result);
+};
+
+void Replayer::build_context() {
+  std::set<int32_t> rotations;
+  bool bootstrap = false;
+  for (const auto &step : steps_) {
+    if (step.name == "EvalRotate" || step.name == "EvalFastRotation") {
+      rotations.insert(static_cast<int32_t>(step.args.at(1).integer));
+    } else if (step.name == "EvalMerge") {
+      for (size_t i = 1; i < step.args.at(0).items.size(); ++i) {
+        rotations.insert(-static_cast<int32_t>(i));
+      }
+    } else if (step.name == "EvalBootstrap") {
+      bootstrap = true;
+    }
+  }
+  rotations.erase(0);
+
+  std::vector<uint32_t> levelBudget = {4, 4};
+  auto secretKeyDist = SPARSE_TERNARY;
+  uint32_t depth = options_.depth;
+  if (bootstrap) depth += FHECKKSRNS::GetBootstrapDepth(levelBudget, secretKeyDist);
+
+  CCParams<CryptoContextCKKSRNS> parameters;
+  parameters.SetMultiplicativeDepth(depth);
+  parameters.SetSecurityLevel(HEStd_NotSet);
+  parameters.SetRingDim(options_.ringDim);
+  parameters.SetBatchSize(options_.slots);
+  parameters.SetScalingModSize(options_.scaleBits);
+  parameters.SetFirstModSize(options_.firstMod);
+  parameters.SetNumLargeDigits(options_.digits);
+  parameters.SetScalingTechnique(FLEXIBLEAUTO);
+  parameters.SetSecretKeyDist(secretKeyDist);
+  cc_ = GenCryptoContext(parameters);
+  cc_->Enable(PKE);
+  cc_->Enable(KEYSWITCH);
+  cc_->Enable(LEVELEDSHE);
+  cc_->Enable(ADVANCEDSHE);
+  cc_->Enable(FHE);
+
+  keys_ = cc_->KeyGen();
+  cc_->EvalMultKeyGen(keys_.secretKey);
+  cc_->EvalSumKeyGen(keys_.secretKey);
+  cc_->EvalRotateKeyGen(keys_.secretKey,
+                        std::vector<int32_t>(rotations.begin(), rotations.end()));
+  if (bootstrap) {
+    cc_->EvalBootstrapSetup(levelBudget, {0, 0}, options_.slots);
+    cc_->EvalBootstrapKeyGen(keys_.secretKey, options_.slots);
+  }
+  freshTowers_ = cc_->GetElementParams()->GetParams().size();
+  std::cerr << "[replay] depth " << depth << ", " << freshTowers_ << " towers, "
+            << rotations.size() << " rotation keys"
+            << (bootstrap ? ", bootstrapping" : "") << std::endl;
+}
+
+// OpenFHE level (towers dropped) that leaves `towers` towers.
+int Replayer::level_for(int towers) {
+  if (towers > freshTowers_) {
+    ++clamped_;
+    return 0;
+  }
+  return freshTowers_ - std::max(towers, 1);
+}
+
+std::vector<double> Replayer::values(int slots) {
+  std::uniform_real_distribution<double> uniform(-0.5, 0.5);
+  std::vector<double> data(slots > 0 ? slots : options_.slots);
+  for (auto &value : data) value = uniform(random_);
+  return data;
+}
+
+Ptext Replayer::plaintext(const Operand &operand) {
+  int slots = operand.slots > 0 ? operand.slots : options_.slots;
+  return cc_->MakeCKKSPackedPlaintext(values(slots), std::max(operand.degree, 1),
+                                      level_for(operand.towers), nullptr, slots);
+}
+
+Ctext Replayer::synthesize(const Operand &operand) {
+  ++synthesized_;
+  Operand fresh = operand;
+  fresh.degree = 1;
+  Ctext ciphertext = cc_->Encrypt(keys_.publicKey, plaintext(fresh));
+  if (operand.elements > 2) {
+    ciphertext = cc_->EvalMultNoRelin(ciphertext, ciphertext);
+  } else if (operand.degree > 1) {
+    ciphertext = cc_->EvalMult(ciphertext, plaintext(fresh));
+  }
+  return ciphertext;
+}
+
+Ctext Replayer::ciphertext(const Operand &operand) {
+  auto found = live_.find(operand.id);
+  if (found != live_.end() &&
+      (int)found->second->GetElements()[0].GetNumOfElements() ==
+          std::min(operand.towers, freshTowers_)) {
+    return found->second;
+  }
+  return synthesize(operand);
+}
+
+std::vector<Ctext> Replayer::ciphertexts(const Operand &operand) {
+  std::vector<Ctext> result;
+  for (const auto &item : operand.items) result.push_back(ciphertext(item));
+  return result;
+}
+
+std::vector<Ptext> Replayer::plaintexts(const Operand &operand) {
+  std::vector<Ptext> result;
+  for (const auto &item : operand.items) result.push_back(plaintext(item));
+  return result;
+}
+
+template <typename Fn>
+double timed(Fn fn) {
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs one step and returns its time; a ciphertext result is left in `result`.
+// Returns a negative time for operations the replayer does not know.
+double Replayer::execute(const Step &step, Ctext &result) {
+  const std::string &op = step.name;
+  const auto &a = step.args;
+  if (op == "EvalRotate") {
+    Ctext in = ciphertext(a.at(0));
+    return timed([&] { result = cc_->EvalRotate(in, a.at(1).integer); });
+  }
+  if (op == "EvalFastRotationPrecompute") {
+    Ctext in = ciphertext(a.at(0));
+    std::shared_ptr<std::vector<DCRTPoly>> digits;
+    double t = timed([&] { digits = cc_->EvalFastRotationPrecompute(in); });
+    if (lastUse_.count(step.result.id)) digits_[step.result.id] = digits;
+    return t;
+  }
+  if (op == "EvalFastRotation") {
+    Ctext in = ciphertext(a.at(0));
+    auto found = digits_.find(a.at(3).id);
+    auto digits = found != digits_.end() ? found->second : cc_->EvalFastRotationPrecompute(in);
+    uint32_t m = cc_->GetCyclotomicOrder();
+    return timed([&] { result = cc_->EvalFastRotation(in, a.at(1).integer, m, digits); });
+  }
+  if (op == "EvalMult" || op == "EvalAdd") {
+    bool mult = op == "EvalMult";
+    const Operand &x = a.at(0), &y = a.at(1);
+    if (x.kind == 'p') {
+      Ptext p = plaintext(x);
+      Ctext c = ciphertext(y);
+      return timed([&] { result = mult ? cc_->EvalMult(p, c) : cc_->EvalAdd(c, p); });
+    }
+    Ctext c = ciphertext(x);
+    if (y.kind == 'p') {
+      Ptext p = plaintext(y);
+      return timed([&] { result = mult ? cc_->EvalMult(c, p) : cc_->EvalAdd(c, p); });
+    }
+    if (y.kind == 'd' || y.kind == 'i') {
+      double d = y.kind == 'd' ? y.number : y.integer;
+      return timed([&] { result = mult ? cc_->EvalMult(c, d) : cc_->EvalAdd(c, d); });
+    }
+    Ctext c2 = ciphertext(y);
+    return timed([&] { result = mult ? cc_->EvalMult(c, c2) : cc_->EvalAdd(c, c2); });
+  }
+  if (op == "EvalMultNoRelin") {
+    Ctext x = ciphertext(a.at(0)), y = ciphertext(a.at(1));
+    return timed([&] { result = cc_->EvalMultNoRelin(x, y); });
+  }
+  if (op == "Relinearize") {
+    Ctext in = ciphertext(a.at(0));
+    return timed([&] { result = cc_->Relinearize(in); });
+  }
+  if (op == "EvalAddInPlace") {
+    result = ciphertext(a.at(0))->Clone();
+    if (a.at(1).kind == 'p') {
+      Ptext p = plaintext(a.at(1));
+      return timed([&] { cc_->EvalAddInPlace(result, p); });
+    }
+    Ctext c = ciphertext(a.at(1));
+    return timed([&] { cc_->EvalAddInPlace(result, c); });
+  }
+  if (op == "EvalAddMany" || op == "EvalMerge") {
+    auto in = ciphertexts(a.at(0));
+    bool merge = op == "EvalMerge";
+    return timed([&] { result = merge ? cc_->EvalMerge(in) : cc_->EvalAddMany(in); });
+  }
+  if (op == "EvalSum") {
+    Ctext in = ciphertext(a.at(0));
+    return timed([&] { result = cc_->EvalSum(in, a.at(1).integer); });
+  }
+  if (op == "EvalChebyshevFunction") {
+    Ctext in = ciphertext(a.at(1));
+    auto relu = [](double x) { return x > 0 ? x : 0.0; };
+    return timed([&] {
+      result = cc_->EvalChebyshevFunction(relu, in, a.at(2).number, a.at(3).number,
+                                          a.at(4).integer);
+    });
+  }
+  if (op == "MakeCKKSPackedPlaintext") {
+    std::vector<double> data = values(a.at(0).integer);
+    int slots = step.result.slots > 0 ? step.result.slots : options_.slots;
+    int level = level_for(step.result.towers);
+    return timed([&] {
+      cc_->MakeCKKSPackedPlaintext(data, std::max(step.result.degree, 1), level, nullptr, slots);
+    });
+  }
+  if (op == "EvalBootstrap") {
+    Ctext in = ciphertext(a.at(0));
+    uint32_t iterations = a.size() > 1 ? a[1].integer : 1;
+    uint32_t precision = a.size() > 2 ? a[2].integer : 0;
+    return timed([&] { result = cc_->EvalBootstrap(in, iterations, precision); });
+  }
+  if (op == "Compress") {
+    Ctext in = ciphertext(a.at(0));
+    if ((int)in->GetElements()[0].GetNumOfElements() <= step.result.towers) {
+      result = in;
+      return 0;
+    }
+    return timed([&] { result = cc_->Compress(in, step.result.towers); });
+  }
+  if (op == "FusedInnerProduct") {
+    auto cts = ciphertexts(a.at(0));
+    auto pts = plaintexts(a.at(1));
+    return timed([&] { result = fused_inner_product(cc_, cts, pts); });
+  }
+  if (op == "FusedMultiplyAccumulate") {
+    result = a.at(0).kind == 'c' ? ciphertext(a.at(0))->Clone() : nullptr;
+    Ctext c = ciphertext(a.at(1));
+    Ptext p = plaintext(a.at(2));
+    return timed([&] { fused_multiply_accumulate(cc_, result, c, p); });
+  }
+  return -1;
+}
+
+void Replayer::run() {
+  for (size_t s = 0; s < steps_.size(); ++s) {
+    const Step &step = steps_[s];
+    Totals &totals = totals_[step.name];
+    totals.count++;
+    totals.recorded += step.recorded;
+    Ctext result;
+    try {
+      double t = execute(step, result);
+      if (t < 0) {
+        ++skipped_;
+      } else {
+        totals.replayed += t;
+      }
+    } catch (const std::exception &e) {
+      if (failed_++ == 0) firstFailure_ = step.name + ": " + e.what();
+      result = nullptr;
+    }
+    for (const auto &arg : step.args) {
+      auto use = lastUse_.find(arg.id);
+      if (arg.kind == 'c' && use != lastUse_.end() && use->second == s) live_.erase(arg.id);
+      for (const auto &item : arg.items) {
+        auto itemUse = lastUse_.find(item.id);
+        if (itemUse != lastUse_.end() && itemUse->second == s) live_.erase(item.id);
+      }
+    }
+    if (result && step.result.kind == 'c') {
+      auto use = lastUse_.find(step.result.id);
+      if (use != lastUse_.end() && use->second > s) {
+        live_[step.result.id] = result;
+      } else {
+        live_.erase(step.result.id);
+      }
+    }
+    if (step.name == "EvalFastRotation" || step.name == "EvalFastRotationPrecompute") {
+      for (auto it = digits_.begin(); it != digits_.end();) {
+        it = lastUse_[it->first] <= s ? digits_.erase(it) : std::next(it);
+      }
+    }
+  }
+}
+
+void Replayer::report(std::ostream &out) const {
+  Totals all;
+  for (const auto &entry : totals_) {
+    all.count += entry.second.count;
+    all.replayed += entry.second.replayed;
+    all.recorded += entry.second.recorded;
+  }
+  if (options_.json) {
+    out << std::setprecision(9) << "{\"trace\": \"" << options_.trace
+        << "\", \"ring_dim\": " << options_.ringDim << ", \"depth\": " << options_.depth
+        << ", \"scale_bits\": " << options_.scaleBits << ", \"first_mod\": "
+        << options_.firstMod << ", \"dnum\": " << options_.digits << ", \"ops\": [";
+    bool first = true;
+    for (const auto &entry : totals_) {
+      out << (first ? "" : ", ") << "{\"name\": \"" << entry.first
+          << "\", \"count\": " << entry.second.count
+          << ", \"replay_seconds\": " << entry.second.replayed
+          << ", \"recorded_seconds\": " << entry.second.recorded << "}";
+      first = false;
+    }
+    out << "], \"count\": " << all.count << ", \"replay_seconds\": " << all.replayed
+        << ", \"recorded_seconds\": " << all.recorded << ", \"synthesized\": "
+        << synthesized_ << ", \"clamped\": " << clamped_ << ", \"skipped\": " << skipped_
+        << ", \"failed\": " << failed_ << "}" << std::endl;
+    return;
+  }
+  out << std::left << std::setw(28) << "operation" << std::right << std::setw(8) << "count"
+      << std::setw(14) << "replay s" << std::setw(14) << "recorded s" << "\n";
+  out << std::fixed << std::setprecision(3);
+  for (const auto &entry : totals_) {
+    out << std::left << std::setw(28) << entry.first << std::right << std::setw(8)
+        << entry.second.count << std::setw(14) << entry.second.replayed << std::setw(14)
+        << entry.second.recorded << "\n";
+  }
+  out << std::left << std::setw(28) << "total" << std::right << std::setw(8) << all.count
+      << std::setw(14) << all.replayed << std::setw(14) << all.recorded << "\n";
+  out << synthesized_ << " operands synthesized, " << clamped_ << " clamped to a fresh ciphertext, "
+      << skipped_ << " unknown operations, " << failed_ << " failed";
+  if (failed_) out << " (first: " << firstFailure_ << ")";
+  out << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " TRACE [--ring-dim N] [--depth L] [--scale-bits B]\n"
+              << "       [--first-mod B] [--dnum D] [--slots S] [--json]\n";
+    std::cout << "  Defaults are the parameters of client_key_generation; --depth is the\n"
+              << "  depth between bootstraps, the bootstrapping depth is added if the trace\n"
+              << "  bootstraps.\n";
+    return 2;
+  }
+  Options options;
+  options.trace = argv[1];
+  for (int a = 2; a < argc; ++a) {
+    std::string arg = argv[a];
+    if (arg == "--json") {
+      options.json = true;
+      continue;
+    }
+    if (arg != "--ring-dim" && arg != "--depth" && arg != "--scale-bits" && arg != "--first-mod" &&
+        arg != "--dnum" && arg != "--slots") {
+      throw std::runtime_error("Unknown option " + arg);
+    }
+    if (a + 1 == argc) throw std::runtime_error(arg + " needs a value");
+    uint32_t value = std::stoul(argv[++a]);
+    if (arg == "--ring-dim") options.ringDim = value;
+    else if (arg == "--depth") options.depth = value;
+    else if (arg == "--scale-bits") options.scaleBits = value;
+    else if (arg == "--first-mod") options.firstMod = value;
+    else if (arg == "--dnum") options.digits = value;
+    else options.slots = value;
+  }
+
+  std::vector<Step> steps;
+  for (const auto &op : FHEONTraceRecorder::load(options.trace)) {
+    Step step;
+    step.name = op.name;
+    step.recorded = op.seconds;
+    size_t pos = 0;
+    step.result = parse_operand({op.result}, pos);
+    step.args = parse_operands(op.args);
+    steps.push_back(std::move(step));
+  }
+  std::cerr << "[replay] " << steps.size() << " operations from " << options.trace << std::endl;
+
+  Replayer replayer(options, steps);
+  replayer.run();
+  replayer.report(std::cout);
+  return 0;
+}
@@ -0,0 +1,123 @@
+// Copyright 2025 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "zero_pool.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <random>
+#include <sstream>
+
+namespace {
+
+constexpr const char* kEntryPrefix = "zero_";
+constexpr const char* kClaimedPrefix = "claimed_";
+
+// Short hex digest of the serialized public key.
+std::string key_fingerprint(const fs::path& publicKeyFile) {
+  std::ifstream in(publicKeyFile, std::ios::in | std::ios::binary);
+  if (!in.is_open()) {
+    throw std::runtime_error("Failed to open " + publicKeyFile.string());
+  }
+  std::string bytes((std::istreambuf_iterator<char>(in)),
+                    std::istreambuf_iterator<char>());
+  std::ostringstream hex;
+  hex << std::hex << std::setw(16) << std::setfill('0')
+      << std::hash<std::string>()(bytes);
+  return hex.str();
+}
+
+bool is_entry(const fs::directory_entry& entry) {
+  return entry.path().filename().string().rfind(kEntryPrefix, 0) == 0;
+}
+
+}  // namespace
+
+ZeroEncryptionPool::ZeroEncryptionPool(const fs::path& root,
+                                       const fs::path& publicKeyFile,
+                                       uint32_t level)
+    : dir_(root / key_fingerprint(publicKeyFile) / ("level_" + std::to_string(level))),
+      level_(level) {}
+
+size_t ZeroEncryptionPool::fill(CryptoContext<DCRTPoly> cc,
+                                const PublicKey<DCRTPoly>& pk, size_t count,
+                                IoBackend& io) {
+  // Everything written below is readable by the owner only.
+  mode_t previous = umask(077);
+  fs::create_directories(dir_);
+  fs::permissions(dir_, fs::perms::owner_all, fs::perm_options::replace);
+
+  uint32_t slots = cc->GetCryptoParameters()->GetElementParams()->GetRingDimension() / 2;
+  Plaintext zero = cc->MakeCKKSPackedPlaintext(std::vector<double>(slots, 0.0), 1, level_);
+  std::random_device random;
+  std::vector<IoRequest> writes;
+  try {
+    for (size_t n = 0; n < count; ++n) {
+      std::ostringstream name;
+      name << kEntryPrefix << std::hex << std::setfill('0') << std::setw(8) << random()
+           << std::setw(8) << random() << ".bin";
+      IoRequest req;
+      req.path = dir_ / name.str();
+      req.data = serialize_binary(cc->Encrypt(pk, zero));
+      writes.push_back(std::move(req));
+      if (writes.size() == kIoBatchSize || n + 1 == count) {
+        io.write_batch(writes);
+        writes.clear();
+      }
+    }
+  } catch (...) {
+    umask(previous);
+    throw;
+  }
+  umask(previous);
+  return size();
+}
+
+size_t ZeroEncryptionPool::size() const {
+  std::error_code ec;
+  size_t entries = 0;
+  for (const auto& entry : fs::directory_iterator(dir_, ec)) {
+    if (is_entry(entry)) ++entries;
+  }
+  return entries;
+}
+
+std::vector<fs::path> ZeroEncryptionPool::claim(size_t count) {
+  std::vector<fs::path> claimed;
+  std::error_code ec;
+  const std::string tag = kClaimedPrefix + std::to_string(getpid()) + "_";
+  for (const auto& entry : fs::directory_iterator(dir_, ec)) {
+    if (claimed.size() == count) break;
+    if (!is_entry(entry)) continue;
+    // rename() is atomic: if another client claimed the entry first, ours
+    // fails and the entry is skipped.
+    fs::path target = dir_ / (tag + entry.path().filename().string());
+    std::error_code renameError;
+    fs::rename(entry.path(), target, renameError);
+    if (!renameError) claimed.push_back(target);
+  }
+  return claimed;
+}
+
+void ZeroEncryptionPool::release(const std::vector<fs::path>& claimed) {
+  for (const auto& path : claimed) {
+    std::error_code ec;
+    fs::remove(path, ec);
+  }
+}